@@ -17,21 +17,19 @@
  */
 
 #include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
-#include <chrono>
-#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
 
-#include "../config/bancho_file.hh"
 #include "../config/ipc_file.hh"
 #include "../database/tables/beatmap_table.hh"
-#include "../logger/sentry_logger.hh"
-#include "../thirdparty/json.hh"
-#include "../thirdparty/loguru.hh"
-#include "../utils/curler.hh"
 #include "../utils/string_utils.hh"
 #include "../shiro.hh"
 #include "beatmap.hh"
+#include "beatmap_cache.hh"
 #include "beatmap_helper.hh"
+#include "osu_api.hh"
 
 void shiro::beatmaps::beatmap::fetch(bool force_peppster) {
     if (this->beatmapset_id == -1) {
@@ -42,6 +40,10 @@ void shiro::beatmaps::beatmap::fetch(bool force_peppster) {
     if (!force_peppster) {
         if (fetch_db())
             return;
+
+        // osu! has recently told us that this beatmap doesn't exist
+        if (this->ranked_status == (int32_t) status::unsubmitted)
+            return;
     }
 
     if (!fetch_api())
@@ -49,7 +51,19 @@ void shiro::beatmaps::beatmap::fetch(bool force_peppster) {
 }
 
 bool shiro::beatmaps::beatmap::fetch_db() {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    switch (cache::lookup(this->beatmap_md5, *this)) {
+        case cache::result::hit:
+            return true;
+        case cache::result::unsubmitted:
+            this->ranked_status = (int32_t) status::unsubmitted;
+            return false;
+        case cache::result::miss:
+            break;
+    }
+
+    uint64_t generation = cache::get_generation(this->beatmap_md5);
+
+    auto db = db_connection->get_connection();
     const tables::beatmaps beatmaps_table {};
 
     auto result = db(select(all_of(beatmaps_table)).from(beatmaps_table).where(beatmaps_table.beatmap_md5 == this->beatmap_md5).limit(1u));
@@ -84,199 +98,120 @@ bool shiro::beatmaps::beatmap::fetch_db() {
     this->play_count = row.play_count;
     this->pass_count = row.pass_count;
 
+    cache::store(*this, generation);
     return true;
 }
 
 bool shiro::beatmaps::beatmap::fetch_api() {
     if (this->beatmapset_id == 0) {
-        std::string url = "https://old.ppy.sh/api/get_beatmaps?k=" + config::bancho::api_key + "&b=" + std::to_string(this->beatmap_id);
-        auto [success, output] = utils::curl::get(url);
+        beatmap cached;
 
-        if (!success) {
-            LOG_F(ERROR, "Unable to connect to osu! api: %s.", output.c_str());
-
-            this->ranked_status = (int32_t) status::unknown;
-            return false;
-        }
-
-        json json_result;
+        // Other versions of this beatmap share the beatmap set id
+        if (cache::lookup(this->beatmap_id, cached) == cache::result::hit)
+            this->beatmapset_id = cached.beatmapset_id;
+    }
 
-        try {
-            json_result = json::parse(output);
-        } catch (const json::parse_error &ex) {
-            LOG_F(ERROR, "Unable to parse json response from osu! api: %s.", ex.what());
-            logging::sentry::exception(ex);
+    if (this->beatmapset_id == 0) {
+        std::optional<int32_t> beatmapset_id = osu_api::fetch_beatmapset_id(this->beatmap_id);
 
+        if (!beatmapset_id.has_value()) {
             this->ranked_status = (int32_t) status::unknown;
             return false;
         }
 
-        for (auto &part : json_result) {
-            try {
-                this->beatmapset_id = boost::lexical_cast<int32_t>(std::string(part["beatmapset_id"]));
-            } catch (const boost::bad_lexical_cast &ex) {
-                LOG_F(ERROR, "Unable to cast response of osu! API to valid data types: %s.", ex.what());
-                logging::sentry::exception(ex);
-
-                this->ranked_status = (int32_t) status::unknown;
-                return false;
-            }
-        }
+        this->beatmapset_id = beatmapset_id.value();
     }
 
-    std::string url = "https://old.ppy.sh/api/get_beatmaps?k=" + config::bancho::api_key + "&s=" + std::to_string(this->beatmapset_id);
-    auto [success, output] = utils::curl::get(url);
-
-    if (!success) {
-        LOG_F(ERROR, "Unable to connect to osu! api: %s.", output.c_str());
-
+    if (this->beatmapset_id != 0 && !osu_api::fetch_beatmap_set(this->beatmapset_id)) {
         this->ranked_status = (int32_t) status::unknown;
         return false;
     }
 
-    json json_result;
-    std::string original_md5sum = this->beatmap_md5;
-    bool map_found = false;
-
-    try {
-        json_result = json::parse(output);
-    } catch (const json::parse_error &ex) {
-        LOG_F(ERROR, "Unable to parse json response from osu! api: %s.", ex.what());
-        logging::sentry::exception(ex);
-
-        this->ranked_status = (int32_t) status::unknown;
-        return false;
+    if (!fetch_db()) {
+        // Map was not found when queuing for the beatmap set, the map is not submitted.
+        this->ranked_status = (int32_t) status::unsubmitted;
+        cache::store_unsubmitted(this->beatmap_md5);
     }
 
-    for (auto &part : json_result) {
-        try {
-            std::string artist = part["artist"];
-            std::string title = part["title"];
-            std::string version = part["version"];
-
-            char buffer[128];
-            std::snprintf(buffer, sizeof(buffer), "%s - %s [%s]", artist.c_str(), title.c_str(), version.c_str());
-            this->song_name = buffer;
-
-            this->beatmap_md5 = part["file_md5"];
-            this->beatmapset_id = boost::lexical_cast<int32_t>(std::string(part["beatmapset_id"]));
-            this->beatmap_id = boost::lexical_cast<int32_t>(std::string(part["beatmap_id"]));
-            this->ranked_status = boost::lexical_cast<int32_t>(std::string(part["approved"]));
-            this->hit_length = boost::lexical_cast<int32_t>(std::string(part["hit_length"]));
-            this->play_mode = (uint8_t) boost::lexical_cast<int32_t>(std::string(part["mode"]));
-            this->ar = boost::lexical_cast<float>(std::string(part["diff_approach"]));
-            this->od = boost::lexical_cast<float>(std::string(part["diff_overall"]));
-            this->size = boost::lexical_cast<float>(std::string(part["diff_size"]));
-            this->drain = boost::lexical_cast<float>(std::string(part["diff_drain"]));
-            this->bpm = static_cast<int32_t>(boost::lexical_cast<float>(std::string(part["bpm"])));
-
-            switch ((utils::play_mode) this->play_mode) {
-                case utils::play_mode::standard:
-                    this->diff_std = boost::lexical_cast<float>(std::string(part["difficultyrating"]));
-                    this->aim = boost::lexical_cast<float>(std::string(part["diff_aim"]));
-                    this->speed = boost::lexical_cast<float>(std::string(part["diff_speed"]));
-
-                    // For some older beatmaps the max_combo is null. See ppy/osu-api#130
-                    if (!part["max_combo"].is_null())
-                        this->max_combo = boost::lexical_cast<int32_t>(std::string(part["max_combo"]));
-
-                    break;
-                case utils::play_mode::taiko:
-                    this->diff_taiko = boost::lexical_cast<float>(std::string(part["difficultyrating"]));
-                    break;
-                case utils::play_mode::fruits:
-                    if (!part["difficultyrating"].is_null())
-                        this->diff_ctb = boost::lexical_cast<float>(std::string(part["difficultyrating"]));
-
-                    this->aim = boost::lexical_cast<float>(std::string(part["diff_aim"]));
-
-                    // For some older beatmaps the max_combo is null. See ppy/osu-api#130
-                    if (!part["max_combo"].is_null())
-                        this->max_combo = boost::lexical_cast<int32_t>(std::string(part["max_combo"]));
-
-                    break;
-                case utils::play_mode::mania:
-                    this->diff_mania = boost::lexical_cast<float>(std::string(part["difficultyrating"]));
-                    break;
-            }
-
-            // Beatmap is unranked
-            if (part["approved_date"].is_null())
-                this->ranked_status = (int32_t) status::latest_pending;
-        } catch (const boost::bad_lexical_cast &ex) {
-            LOG_F(ERROR, "Unable to cast response of Bancho API to valid data types: %s.", ex.what());
-            logging::sentry::exception(ex);
+    return true;
+}
 
-            this->ranked_status = (int32_t) status::unknown;
-            return false;
-        }
+void shiro::beatmaps::beatmap::save() {
+    save(std::vector<beatmap> { *this });
+}
 
-        if (this->beatmap_md5 == original_md5sum)
-            map_found = true;
+void shiro::beatmaps::beatmap::save(const std::vector<beatmap> &beatmaps) {
+    if (beatmaps.empty())
+        return;
 
-        std::string last_update = part["last_update"];
+    auto db = db_connection->get_connection();
+    const tables::beatmaps beatmaps_table {};
 
-        std::tm time {};
-        std::stringstream stream(last_update);
-        stream >> std::get_time(&time, "%Y-%m-%d %H:%M:%S");
-        std::chrono::time_point time_point = std::chrono::system_clock::from_time_t(std::mktime(&time));
-        std::chrono::seconds seconds = std::chrono::time_point_cast<std::chrono::seconds>(time_point).time_since_epoch();
-        this->last_update = seconds.count();
+    std::vector<std::string> hashes;
+    hashes.reserve(beatmaps.size());
 
-        save();
+    for (const beatmap &map : beatmaps) {
+        hashes.emplace_back(map.beatmap_md5);
     }
 
-    this->beatmap_md5 = original_md5sum;
+    std::unordered_set<std::string> stored;
+    auto result = db(select(beatmaps_table.beatmap_md5).from(beatmaps_table).where(beatmaps_table.beatmap_md5.in(sqlpp::value_list(hashes))));
 
-    if (!map_found) {
-        // Map was not found when queuing for the beatmap set, the map is not submitted.
-        this->ranked_status = (int32_t) status::unsubmitted;
-        return true;
+    for (const auto &row : result) {
+        stored.emplace(row.beatmap_md5);
     }
 
-    fetch_db();
-    return true;
-}
-
-void shiro::beatmaps::beatmap::save() {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::beatmaps beatmaps_table {};
-
-    db(insert_into(beatmaps_table).set(
-            beatmaps_table.beatmap_id = this->beatmap_id,
-            beatmaps_table.beatmapset_id = this->beatmapset_id,
-            beatmaps_table.game_mode = this->play_mode,
-            beatmaps_table.beatmap_md5 = this->beatmap_md5,
-            beatmaps_table.song_name = this->song_name,
-            beatmaps_table.ar = this->ar,
-            beatmaps_table.od = this->od,
-            beatmaps_table.size = this->size,
-            beatmaps_table.drain = this->drain,
-            beatmaps_table.aim = this->aim,
-            beatmaps_table.speed = this->speed,
-            beatmaps_table.diff_std = this->diff_std,
-            beatmaps_table.diff_taiko = this->diff_taiko,
-            beatmaps_table.diff_ctb = this->diff_ctb,
-            beatmaps_table.diff_mania = this->diff_mania,
-            beatmaps_table.max_combo = this->max_combo,
-            beatmaps_table.hit_length = this->hit_length,
-            beatmaps_table.bpm = this->bpm,
-            beatmaps_table.ranked_status = this->ranked_status,
-            beatmaps_table.ranked_status_freezed = this->ranked_status_freezed,
-            beatmaps_table.last_update = this->last_update,
-            beatmaps_table.play_count = this->play_count,
-            beatmaps_table.pass_count = this->pass_count
-    ));
-}
+    auto insert = insert_into(beatmaps_table).columns(
+            beatmaps_table.beatmap_id, beatmaps_table.beatmapset_id, beatmaps_table.game_mode, beatmaps_table.beatmap_md5,
+            beatmaps_table.song_name, beatmaps_table.ar, beatmaps_table.od, beatmaps_table.size, beatmaps_table.drain,
+            beatmaps_table.aim, beatmaps_table.speed, beatmaps_table.diff_std, beatmaps_table.diff_taiko, beatmaps_table.diff_ctb,
+            beatmaps_table.diff_mania, beatmaps_table.max_combo, beatmaps_table.hit_length, beatmaps_table.bpm,
+            beatmaps_table.ranked_status, beatmaps_table.ranked_status_freezed, beatmaps_table.last_update,
+            beatmaps_table.play_count, beatmaps_table.pass_count
+    );
+
+    bool has_values = false;
+
+    for (const beatmap &map : beatmaps) {
+        // Beatmaps that are already stored keep their row and play counts
+        if (!stored.emplace(map.beatmap_md5).second)
+            continue;
+
+        has_values = true;
+
+        insert.values.add(
+                beatmaps_table.beatmap_id = map.beatmap_id,
+                beatmaps_table.beatmapset_id = map.beatmapset_id,
+                beatmaps_table.game_mode = map.play_mode,
+                beatmaps_table.beatmap_md5 = map.beatmap_md5,
+                beatmaps_table.song_name = map.song_name,
+                beatmaps_table.ar = map.ar,
+                beatmaps_table.od = map.od,
+                beatmaps_table.size = map.size,
+                beatmaps_table.drain = map.drain,
+                beatmaps_table.aim = map.aim,
+                beatmaps_table.speed = map.speed,
+                beatmaps_table.diff_std = map.diff_std,
+                beatmaps_table.diff_taiko = map.diff_taiko,
+                beatmaps_table.diff_ctb = map.diff_ctb,
+                beatmaps_table.diff_mania = map.diff_mania,
+                beatmaps_table.max_combo = map.max_combo,
+                beatmaps_table.hit_length = map.hit_length,
+                beatmaps_table.bpm = map.bpm,
+                beatmaps_table.ranked_status = map.ranked_status,
+                beatmaps_table.ranked_status_freezed = map.ranked_status_freezed,
+                beatmaps_table.last_update = map.last_update,
+                beatmaps_table.play_count = map.play_count,
+                beatmaps_table.pass_count = map.pass_count
+        );
+    }
 
-void shiro::beatmaps::beatmap::update_play_metadata() {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::beatmaps beatmaps_table {};
+    if (has_values)
+        db(insert);
 
-    db(update(beatmaps_table).set(
-            beatmaps_table.play_count = this->play_count,
-            beatmaps_table.pass_count = this->pass_count
-    ).where(beatmaps_table.beatmap_md5 == this->beatmap_md5));
+    for (const beatmap &map : beatmaps) {
+        cache::invalidate(map.beatmap_md5);
+    }
 }
 
 std::string shiro::beatmaps::beatmap::get_url() {
@@ -296,9 +231,13 @@ std::string shiro::beatmaps::beatmap::build_header() {
 }
 
 std::string shiro::beatmaps::beatmap::build_header(const std::vector<scores::score> &scores) {
+    return this->build_header(scores.size());
+}
+
+std::string shiro::beatmaps::beatmap::build_header(size_t score_count) {
     std::stringstream result;
 
-    result << helper::fix_beatmap_status(this->ranked_status) << "|false|" << this->beatmap_id << "|" << this->beatmapset_id << "|" << scores.size() << std::endl;
+    result << helper::fix_beatmap_status(this->ranked_status) << "|false|" << this->beatmap_id << "|" << this->beatmapset_id << "|" << score_count << std::endl;
     result << "0" << std::endl;
     result << this->song_name << std::endl;
     result << "10.0" << std::endl;
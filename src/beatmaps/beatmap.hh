@@ -21,6 +21,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "../scores/score.hh"
 #include "../utils/play_mode.hh"
@@ -70,7 +71,8 @@ namespace shiro::beatmaps {
         // Saves beatmap meta data into the database
         void save();
 
-        void update_play_metadata();
+        // Saves beatmaps that are not stored yet with a single insert
+        static void save(const std::vector<beatmap> &beatmaps);
 
         std::string get_url();
 
@@ -79,6 +81,7 @@ namespace shiro::beatmaps {
 
         // Builds beatmap with score count instead of default pass count
         std::string build_header(const std::vector<scores::score> &scores);
+        std::string build_header(size_t score_count);
 
     };
 
@@ -0,0 +1,309 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "../config/bancho_file.hh"
+#include "../thirdparty/loguru.hh"
+#include "../shiro.hh"
+#include "beatmap_cache.hh"
+#include "beatmap_ranked_status.hh"
+
+namespace shiro::beatmaps::cache {
+
+    struct cached_beatmap {
+        std::shared_ptr<const beatmap> value; // nullptr if the beatmap is not submitted
+        std::chrono::steady_clock::time_point expires;
+        std::list<std::string>::iterator usage;
+    };
+
+    static std::unordered_map<std::string, cached_beatmap> beatmaps;
+    static std::unordered_map<int32_t, std::string> ids; // beatmap id -> beatmap md5
+    static std::list<std::string> usage; // Most recently used beatmap is at the front
+    static std::mutex mutex;
+
+    static size_t unsubmitted = 0;
+
+    // Bumped for a beatmap whenever it is invalidated, so a beatmap that was loaded
+    // concurrently with a save is not cached with outdated meta data
+    static std::array<std::atomic<uint64_t>, 64> generations {};
+
+    static std::atomic<uint64_t> hits { 0 };
+    static std::atomic<uint64_t> unsubmitted_hits { 0 };
+    static std::atomic<uint64_t> misses { 0 };
+    static std::atomic<uint64_t> expirations { 0 };
+    static std::atomic<uint64_t> evictions { 0 };
+    static std::atomic<uint64_t> invalidations { 0 };
+
+    static std::atomic<uint64_t> &get_generation_counter(const std::string &beatmap_md5);
+
+    // Beatmaps with any other status may still change on osu! and are reloaded from time to time
+    static bool is_final(int32_t status_code);
+
+    // Both need to be called while holding the mutex
+    static void insert(const std::string &beatmap_md5, const std::shared_ptr<const beatmap> &value, std::chrono::steady_clock::time_point expires);
+    static void erase(std::unordered_map<std::string, cached_beatmap>::iterator iterator);
+
+}
+
+void shiro::beatmaps::cache::init() {
+    if (config::bancho::beatmap_cache_size == 0) {
+        LOG_F(INFO, "Beatmap caching is disabled.");
+        return;
+    }
+
+    scheduler.schedule_every(1min, "beatmaps::cache::expire", []() {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto iterator = beatmaps.begin(); iterator != beatmaps.end();) {
+            auto current = iterator++;
+
+            if (now < current->second.expires)
+                continue;
+
+            erase(current);
+            expirations++;
+        }
+    });
+}
+
+shiro::beatmaps::cache::result shiro::beatmaps::cache::lookup(const std::string &beatmap_md5, beatmap &map) {
+    if (config::bancho::beatmap_cache_size == 0)
+        return result::miss;
+
+    std::shared_ptr<const beatmap> value = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iterator = beatmaps.find(beatmap_md5);
+
+        if (iterator == beatmaps.end()) {
+            misses++;
+            return result::miss;
+        }
+
+        if (std::chrono::steady_clock::now() >= iterator->second.expires) {
+            erase(iterator);
+            expirations++;
+            misses++;
+            return result::miss;
+        }
+
+        usage.splice(usage.begin(), usage, iterator->second.usage);
+        value = iterator->second.value;
+    }
+
+    if (value == nullptr) {
+        unsubmitted_hits++;
+        return result::unsubmitted;
+    }
+
+    hits++;
+    map = *value;
+
+    return result::hit;
+}
+
+shiro::beatmaps::cache::result shiro::beatmaps::cache::lookup(int32_t beatmap_id, beatmap &map) {
+    if (config::bancho::beatmap_cache_size == 0)
+        return result::miss;
+
+    std::string beatmap_md5;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iterator = ids.find(beatmap_id);
+
+        if (iterator == ids.end()) {
+            misses++;
+            return result::miss;
+        }
+
+        beatmap_md5 = iterator->second;
+    }
+
+    return lookup(beatmap_md5, map);
+}
+
+uint64_t shiro::beatmaps::cache::get_generation(const std::string &beatmap_md5) {
+    return get_generation_counter(beatmap_md5).load();
+}
+
+void shiro::beatmaps::cache::store(const beatmap &map, uint64_t generation) {
+    if (config::bancho::beatmap_cache_size == 0 || map.beatmap_md5.empty())
+        return;
+
+    std::chrono::steady_clock::time_point expires = std::chrono::steady_clock::time_point::max();
+
+    if (!is_final(map.ranked_status))
+        expires = std::chrono::steady_clock::now() + std::chrono::seconds(config::bancho::beatmap_pending_ttl);
+
+    std::shared_ptr<const beatmap> value = std::make_shared<const beatmap>(map);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Beatmap has been saved or updated while it was loaded
+    if (get_generation_counter(map.beatmap_md5).load() != generation)
+        return;
+
+    insert(map.beatmap_md5, value, expires);
+}
+
+void shiro::beatmaps::cache::store_unsubmitted(const std::string &beatmap_md5) {
+    if (config::bancho::beatmap_cache_size == 0 || beatmap_md5.empty())
+        return;
+
+    std::chrono::steady_clock::time_point expires = std::chrono::steady_clock::now() + std::chrono::seconds(config::bancho::beatmap_unsubmitted_ttl);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    insert(beatmap_md5, nullptr, expires);
+}
+
+void shiro::beatmaps::cache::add_play(const std::string &beatmap_md5, bool passed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iterator = beatmaps.find(beatmap_md5);
+
+    if (iterator == beatmaps.end() || iterator->second.value == nullptr)
+        return;
+
+    // Cached beatmaps are shared, so the counts are changed on a copy
+    std::shared_ptr<beatmap> updated = std::make_shared<beatmap>(*iterator->second.value);
+    updated->play_count++;
+
+    if (passed)
+        updated->pass_count++;
+
+    iterator->second.value = updated;
+}
+
+void shiro::beatmaps::cache::invalidate(const std::string &beatmap_md5) {
+    std::lock_guard<std::mutex> lock(mutex);
+    get_generation_counter(beatmap_md5)++;
+
+    auto iterator = beatmaps.find(beatmap_md5);
+
+    if (iterator == beatmaps.end())
+        return;
+
+    erase(iterator);
+    invalidations++;
+}
+
+void shiro::beatmaps::cache::invalidate(int32_t beatmap_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto id_iterator = ids.find(beatmap_id);
+
+    if (id_iterator == ids.end())
+        return;
+
+    get_generation_counter(id_iterator->second)++;
+
+    auto iterator = beatmaps.find(id_iterator->second);
+
+    if (iterator == beatmaps.end())
+        return;
+
+    erase(iterator);
+    invalidations++;
+}
+
+void shiro::beatmaps::cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (std::atomic<uint64_t> &generation : generations) {
+        generation++;
+    }
+
+    invalidations += beatmaps.size();
+
+    beatmaps.clear();
+    ids.clear();
+    usage.clear();
+    unsubmitted = 0;
+}
+
+shiro::beatmaps::cache::statistics shiro::beatmaps::cache::get_statistics() {
+    statistics result;
+
+    result.hits = hits.load();
+    result.unsubmitted_hits = unsubmitted_hits.load();
+    result.misses = misses.load();
+    result.expirations = expirations.load();
+    result.evictions = evictions.load();
+    result.invalidations = invalidations.load();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    result.beatmaps = beatmaps.size() - unsubmitted;
+    result.unsubmitted = unsubmitted;
+
+    return result;
+}
+
+std::atomic<uint64_t> &shiro::beatmaps::cache::get_generation_counter(const std::string &beatmap_md5) {
+    return generations.at(std::hash<std::string>()(beatmap_md5) % generations.size());
+}
+
+bool shiro::beatmaps::cache::is_final(int32_t status_code) {
+    return status_code == (int32_t) status::ranked ||
+           status_code == (int32_t) status::approved ||
+           status_code == (int32_t) status::loved;
+}
+
+void shiro::beatmaps::cache::insert(const std::string &beatmap_md5, const std::shared_ptr<const beatmap> &value, std::chrono::steady_clock::time_point expires) {
+    auto iterator = beatmaps.find(beatmap_md5);
+
+    if (iterator != beatmaps.end())
+        erase(iterator);
+
+    usage.push_front(beatmap_md5);
+    beatmaps.emplace(beatmap_md5, cached_beatmap { value, expires, usage.begin() });
+
+    // A beatmap that got updated on osu! keeps its id but changes its md5, the id points to the latest one stored
+    if (value != nullptr) {
+        ids.insert_or_assign(value->beatmap_id, beatmap_md5);
+    } else {
+        unsubmitted++;
+    }
+
+    while (beatmaps.size() > config::bancho::beatmap_cache_size) {
+        erase(beatmaps.find(usage.back()));
+        evictions++;
+    }
+}
+
+void shiro::beatmaps::cache::erase(std::unordered_map<std::string, cached_beatmap>::iterator iterator) {
+    if (iterator->second.value != nullptr) {
+        auto id_iterator = ids.find(iterator->second.value->beatmap_id);
+
+        if (id_iterator != ids.end() && id_iterator->second == iterator->first)
+            ids.erase(id_iterator);
+    } else {
+        unsubmitted--;
+    }
+
+    usage.erase(iterator->second.usage);
+    beatmaps.erase(iterator);
+}
@@ -0,0 +1,70 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_BEATMAP_CACHE_HH
+#define SHIRO_BEATMAP_CACHE_HH
+
+#include <cstdint>
+#include <string>
+
+#include "beatmap.hh"
+
+namespace shiro::beatmaps::cache {
+
+    enum class result {
+        miss,
+        hit,
+        unsubmitted
+    };
+
+    struct statistics {
+        uint64_t hits = 0;
+        uint64_t unsubmitted_hits = 0;
+        uint64_t misses = 0;
+        uint64_t expirations = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+
+        size_t beatmaps = 0;
+        size_t unsubmitted = 0;
+    };
+
+    void init();
+
+    // Copies cached meta data into the beatmap on a hit
+    result lookup(const std::string &beatmap_md5, beatmap &map);
+    result lookup(int32_t beatmap_id, beatmap &map);
+
+    // Needs to be read before loading a beatmap from the database and passed to store()
+    uint64_t get_generation(const std::string &beatmap_md5);
+
+    void store(const beatmap &map, uint64_t generation);
+    void store_unsubmitted(const std::string &beatmap_md5);
+
+    // Counts a play on the cached beatmap while the play count in the database is not yet updated
+    void add_play(const std::string &beatmap_md5, bool passed);
+
+    void invalidate(const std::string &beatmap_md5);
+    void invalidate(int32_t beatmap_id);
+    void clear();
+
+    statistics get_statistics();
+
+}
+
+#endif //SHIRO_BEATMAP_CACHE_HH
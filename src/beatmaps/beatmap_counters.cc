@@ -0,0 +1,140 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <sqlpp11/exception.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../thirdparty/loguru.hh"
+#include "../shiro.hh"
+#include "beatmap_cache.hh"
+#include "beatmap_counters.hh"
+
+namespace shiro::beatmaps::counters {
+
+    struct delta {
+        int32_t plays = 0;
+        int32_t passes = 0;
+    };
+
+    static std::unordered_map<int32_t, delta> pending; // beatmap row id -> counts since the last flush
+    static std::mutex mutex;
+
+    // Serializes flushes from the scheduler and shutdown
+    static std::mutex flush_mutex;
+
+    static std::string build_update(const std::vector<std::pair<int32_t, delta>> &deltas, size_t begin, size_t end);
+
+}
+
+void shiro::beatmaps::counters::init() {
+    scheduler.schedule_every(30s, "beatmaps::counters::flush", []() {
+        flush();
+    });
+}
+
+void shiro::beatmaps::counters::add(const beatmap &map, bool passed) {
+    // Beatmap is not stored in the database
+    if (map.id <= 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        delta &counts = pending[map.id];
+
+        counts.plays++;
+
+        if (passed)
+            counts.passes++;
+    }
+
+    cache::add_play(map.beatmap_md5, passed);
+}
+
+void shiro::beatmaps::counters::flush() {
+    std::lock_guard<std::mutex> flush_lock(flush_mutex);
+    std::unordered_map<int32_t, delta> deltas;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        deltas.swap(pending);
+    }
+
+    if (deltas.empty())
+        return;
+
+    std::vector<std::pair<int32_t, delta>> sorted(deltas.begin(), deltas.end());
+
+    // Locks rows in the same order on every flush
+    std::sort(sorted.begin(), sorted.end(), [](const auto &left, const auto &right) {
+        return left.first < right.first;
+    });
+
+    // Counts are added to the stored values, so concurrent writers don't overwrite each other.
+    // The statement only contains integers.
+    constexpr size_t batch_size = 500;
+    size_t offset = 0;
+
+    // The pool throws as well when no connection becomes available, which must not lose the counts either
+    try {
+        auto db = db_connection->get_connection();
+
+        for (; offset < sorted.size(); offset += batch_size) {
+            size_t end = std::min(offset + batch_size, sorted.size());
+
+            db->execute(build_update(sorted, offset, end));
+        }
+    } catch (const sqlpp::exception &ex) {
+        LOG_F(ERROR, "Unable to write play counts of %zu beatmaps, retrying with the next flush: %s", sorted.size() - offset, ex.what());
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (size_t i = offset; i < sorted.size(); i++) {
+            const auto &[id, counts] = sorted.at(i);
+            delta &merged = pending[id];
+
+            merged.plays += counts.plays;
+            merged.passes += counts.passes;
+        }
+    }
+}
+
+std::string shiro::beatmaps::counters::build_update(const std::vector<std::pair<int32_t, delta>> &deltas, size_t begin, size_t end) {
+    std::string plays;
+    std::string passes;
+    std::string ids;
+
+    for (size_t i = begin; i < end; i++) {
+        const auto &[id, counts] = deltas.at(i);
+        std::string id_str = std::to_string(id);
+
+        plays += " WHEN " + id_str + " THEN " + std::to_string(counts.plays);
+        passes += " WHEN " + id_str + " THEN " + std::to_string(counts.passes);
+
+        if (!ids.empty())
+            ids += ", ";
+
+        ids += id_str;
+    }
+
+    return "UPDATE `beatmaps` SET play_count = play_count + CASE id" + plays + " ELSE 0 END, "
+           "pass_count = pass_count + CASE id" + passes + " ELSE 0 END WHERE id IN (" + ids + ");";
+}
@@ -16,18 +16,21 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <fstream>
-
 #include "../thirdparty/loguru.hh"
-#include "../utils/curler.hh"
 #include "../utils/filesystem.hh"
 #include "beatmap_helper.hh"
+#include "osu_api.hh"
 
 static fs::path dir = fs::current_path() / "maps";
 
 void shiro::beatmaps::helper::init() {
     if (!fs::exists(dir))
         fs::create_directories(dir);
+
+    store::init(dir);
+
+    // Beatmaps used to be stored as one file each
+    store::migrate(dir);
 }
 
 int32_t shiro::beatmaps::helper::fix_beatmap_status(int32_t status_code) {
@@ -51,25 +54,22 @@ bool shiro::beatmaps::helper::awards_pp(int32_t status_code) {
     return status_code == (int32_t) status::ranked;
 }
 
-std::optional<std::string> shiro::beatmaps::helper::get_location(int32_t beatmap_id, bool download) {
-    std::string beatmap_id_str = std::to_string(beatmap_id);
-    fs::path filename = dir / std::string(beatmap_id_str + ".osu");
+std::optional<shiro::beatmaps::store::beatmap_view> shiro::beatmaps::helper::get_beatmap(int32_t beatmap_id, bool download) {
+    std::optional<store::beatmap_view> view = store::get(beatmap_id);
 
-    if (fs::exists(filename))
-        return filename.u8string();
+    if (view.has_value() || !download)
+        return view;
 
-    if (!download)
-        return std::nullopt;
-
-    auto [success, output] = utils::curl::get("https://old.ppy.sh/osu/" + beatmap_id_str);
+    // Concurrent downloads of the same beatmap share one request
+    auto [success, output] = beatmaps::osu_api::get_osu_file(beatmap_id).get();
 
     if (!success || output.empty()) {
         LOG_F(ERROR, "Unable to connect to osu! api: %s.", output.c_str());
         return std::nullopt;
     }
 
-    std::ofstream stream(filename);
-    stream << output;
+    if (!store::put(beatmap_id, output))
+        return std::nullopt;
 
-    return filename.u8string();
+    return store::get(beatmap_id);
 }
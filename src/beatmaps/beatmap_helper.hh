@@ -24,6 +24,7 @@
 #include <string>
 
 #include "beatmap_ranked_status.hh"
+#include "beatmap_store.hh"
 
 namespace shiro::beatmaps::helper {
 
@@ -35,7 +36,8 @@ namespace shiro::beatmaps::helper {
 
     bool awards_pp(int32_t status_code);
 
-    std::optional<std::string> get_location(int32_t beatmap_id, bool download = true);
+    // Returns the .osu file of the beatmap, downloading it into the beatmap store if needed
+    std::optional<store::beatmap_view> get_beatmap(int32_t beatmap_id, bool download = true);
 
 }
 
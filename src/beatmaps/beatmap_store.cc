@@ -0,0 +1,536 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <lzma.h>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "../thirdparty/loguru.hh"
+#include "beatmap_store.hh"
+
+namespace shiro::beatmaps::store {
+
+    // Index file: header followed by an open addressing hash table keyed by beatmap id
+    struct index_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t capacity; // Always a power of two
+        uint32_t count;
+        uint32_t reserved;
+    };
+
+    struct index_entry {
+        int32_t beatmap_id; // 0 marks an empty slot
+        uint32_t flags;
+        uint64_t offset; // Into the pack file
+        uint32_t stored_size;
+        uint32_t size;
+    };
+
+    static_assert(sizeof(index_header) == 24 && sizeof(index_entry) == 24, "Index layout must not change");
+
+    constexpr char index_magic[8] = { 'S', 'H', 'I', 'R', 'O', 'I', 'D', 'X' };
+    constexpr char pack_magic[8] = { 'S', 'H', 'I', 'R', 'O', 'P', 'A', 'K' };
+    constexpr uint32_t index_version = 1;
+    constexpr uint32_t initial_capacity = 4096;
+
+    constexpr uint32_t compressed_flag = 1 << 0;
+
+    constexpr uint32_t compression_preset = 6;
+
+    static fs::path index_path;
+    static fs::path pack_path;
+
+    static boost::iostreams::mapped_file index_file;
+    static std::shared_ptr<boost::iostreams::mapped_file_source> pack_file = nullptr;
+    static std::ofstream pack_stream;
+    static uint64_t pack_size = 0;
+    static uint64_t uncompressed_size = 0;
+
+    static std::shared_timed_mutex mutex;
+
+    static index_header *get_header();
+    static index_entry *get_entries();
+
+    // Returns the slot of the beatmap or the empty slot where it belongs
+    static index_entry *find_slot(int32_t beatmap_id);
+
+    static bool create_index(const fs::path &path, uint32_t capacity);
+    static void rebuild_index(uint32_t capacity);
+    static void map_index();
+    static void map_pack();
+
+    static std::string compress(const std::string &contents);
+    static bool decompress(const char *input, size_t input_size, std::string &output);
+
+    // Cuts off what a failed append left behind, so the next offset is the end of the file again
+    static void restore_pack();
+
+    // Whether the stored copy of a beatmap can still be read, expects the unique lock to be held
+    static bool is_readable(const index_entry &entry);
+
+}
+
+void shiro::beatmaps::store::init(const fs::path &directory) {
+    index_path = directory / "beatmaps.idx";
+    pack_path = directory / "beatmaps.pack";
+
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+
+    if (!fs::exists(pack_path)) {
+        std::ofstream stream(pack_path, std::ios::binary);
+        stream.write(pack_magic, sizeof(pack_magic));
+    }
+
+    pack_size = fs::file_size(pack_path);
+
+    {
+        char magic[sizeof(pack_magic)] {};
+
+        std::ifstream stream(pack_path, std::ios::binary);
+        stream.read(magic, sizeof(magic));
+
+        if (!stream || std::memcmp(magic, pack_magic, sizeof(magic)) != 0)
+            ABORT_F("Beatmap pack file %s is corrupted.", pack_path.u8string().c_str());
+    }
+
+    pack_stream.open(pack_path, std::ios::binary | std::ios::app);
+
+    if (!pack_stream)
+        ABORT_F("Unable to open beatmap pack file %s.", pack_path.u8string().c_str());
+
+    if (!fs::exists(index_path) && !create_index(index_path, initial_capacity))
+        ABORT_F("Unable to create beatmap index file %s.", index_path.u8string().c_str());
+
+    map_index();
+
+    index_header *header = get_header();
+
+    if (std::memcmp(header->magic, index_magic, sizeof(index_magic)) != 0 || header->version != index_version)
+        ABORT_F("Beatmap index file %s is corrupted.", index_path.u8string().c_str());
+
+    // Entries are written after the pack is appended to, but nothing is synced in between.
+    // After a crash the index can point past the end of the pack, those entries are dropped.
+    bool valid = true;
+
+    for (uint32_t i = 0; i < header->capacity; i++) {
+        const index_entry &entry = get_entries()[i];
+
+        if (entry.beatmap_id == 0)
+            continue;
+
+        if (entry.offset < sizeof(pack_magic) || entry.offset + entry.stored_size > pack_size) {
+            valid = false;
+            continue;
+        }
+
+        uncompressed_size += entry.size;
+    }
+
+    if (!valid) {
+        LOG_F(WARNING, "Beatmap index contains entries past the end of the pack file, rebuilding it.");
+        rebuild_index(header->capacity);
+    }
+
+    map_pack();
+
+    LOG_F(INFO, "Beatmap pack contains %u beatmaps (%lu KiB).", get_header()->count, pack_size / 1024);
+}
+
+std::optional<shiro::beatmaps::store::beatmap_view> shiro::beatmaps::store::get(int32_t beatmap_id) {
+    if (beatmap_id <= 0)
+        return std::nullopt;
+
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    const index_entry *slot = find_slot(beatmap_id);
+
+    if (slot->beatmap_id == 0)
+        return std::nullopt;
+
+    index_entry entry = *slot;
+    std::shared_ptr<boost::iostreams::mapped_file_source> pack = pack_file;
+
+    lock.unlock();
+
+    // The mapping only covers the pack as it was when it was mapped, map it again after appends
+    if (pack == nullptr || entry.offset + entry.stored_size > pack->size()) {
+        std::unique_lock<std::shared_timed_mutex> unique_lock(mutex);
+
+        if (pack_file == nullptr || entry.offset + entry.stored_size > pack_file->size())
+            map_pack();
+
+        pack = pack_file;
+    }
+
+    const char *stored = pack->data() + entry.offset;
+    beatmap_view view;
+
+    if (!(entry.flags & compressed_flag)) {
+        view.owner = pack;
+        view.contents = std::string_view(stored, entry.size);
+
+        return view;
+    }
+
+    std::shared_ptr<std::string> buffer = std::make_shared<std::string>(entry.size, '\0');
+
+    if (!decompress(stored, entry.stored_size, *buffer)) {
+        LOG_F(ERROR, "Unable to decompress beatmap %i from beatmap pack.", beatmap_id);
+        return std::nullopt;
+    }
+
+    view.contents = std::string_view(buffer->data(), buffer->size());
+    view.owner = std::move(buffer);
+
+    return view;
+}
+
+bool shiro::beatmaps::store::put(int32_t beatmap_id, const std::string &contents) {
+    if (beatmap_id <= 0 || contents.empty())
+        return false;
+
+    std::string compressed = compress(contents);
+    bool is_compressed = !compressed.empty() && compressed.size() < contents.size();
+    const std::string &stored = is_compressed ? compressed : contents;
+
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+
+    index_entry *existing = find_slot(beatmap_id);
+    bool replace = existing->beatmap_id != 0;
+
+    if (replace) {
+        if (is_readable(*existing))
+            return true;
+
+        // Nothing else would ever replace the broken copy, the new one is appended and the slot points to it
+        LOG_F(WARNING, "Replacing beatmap %i in beatmap pack, the stored copy can't be decompressed.", beatmap_id);
+    }
+
+    uint64_t offset = pack_size;
+
+    pack_stream.write(stored.data(), stored.size());
+    pack_stream.flush();
+
+    if (!pack_stream) {
+        LOG_F(ERROR, "Unable to append beatmap %i to beatmap pack.", beatmap_id);
+
+        restore_pack();
+        return false;
+    }
+
+    pack_size += stored.size();
+    uncompressed_size += contents.size();
+
+    if (replace)
+        uncompressed_size -= existing->size;
+
+    // Keep the table at most half full so probe sequences stay short
+    if (!replace && (get_header()->count + 1) * 2 > get_header()->capacity)
+        rebuild_index(get_header()->capacity * 2);
+
+    index_entry *slot = find_slot(beatmap_id);
+
+    slot->flags = is_compressed ? compressed_flag : 0;
+    slot->offset = offset;
+    slot->stored_size = (uint32_t) stored.size();
+    slot->size = (uint32_t) contents.size();
+    slot->beatmap_id = beatmap_id;
+
+    if (!replace)
+        get_header()->count++;
+
+    return true;
+}
+
+size_t shiro::beatmaps::store::migrate(const fs::path &directory) {
+    std::vector<fs::path> files;
+
+    for (const fs::directory_entry &file : fs::directory_iterator(directory)) {
+        if (!file.is_regular_file())
+            continue;
+
+        const fs::path &path = file.path();
+
+        // Left behind by interrupted downloads of the old layout
+        if (path.extension() == ".tmp") {
+            fs::remove(path);
+            continue;
+        }
+
+        if (path.extension() == ".osu")
+            files.emplace_back(path);
+    }
+
+    if (files.empty())
+        return 0;
+
+    LOG_F(INFO, "Moving %lu beatmap files into the beatmap pack.", files.size());
+
+    std::atomic<size_t> next { 0 };
+    std::atomic<size_t> migrated { 0 };
+    std::vector<std::thread> workers;
+
+    // Compressing is the slow part and happens outside of the store lock, so spread it over all cores
+    for (uint32_t i = 0; i < std::max(1u, std::thread::hardware_concurrency()); i++) {
+        workers.emplace_back([&files, &next, &migrated]() {
+            for (size_t index = next++; index < files.size(); index = next++) {
+                const fs::path &path = files.at(index);
+                int32_t beatmap_id = 0;
+
+                try {
+                    beatmap_id = std::stoi(path.stem().u8string());
+                } catch (const std::exception &ex) {
+                    LOG_F(WARNING, "Skipping %s while moving beatmaps into the beatmap pack.", path.u8string().c_str());
+                    continue;
+                }
+
+                std::ifstream stream(path, std::ios::binary);
+                std::string contents((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+                stream.close();
+
+                if (contents.empty() || !put(beatmap_id, contents)) {
+                    LOG_F(WARNING, "Unable to move %s into the beatmap pack.", path.u8string().c_str());
+                    continue;
+                }
+
+                fs::remove(path);
+
+                if (++migrated % 10000 == 0)
+                    LOG_F(INFO, "Moved %lu/%lu beatmap files into the beatmap pack.", migrated.load(), files.size());
+            }
+        });
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    LOG_F(INFO, "Moved %lu beatmap files into the beatmap pack.", migrated.load());
+    return migrated;
+}
+
+shiro::beatmaps::store::statistics shiro::beatmaps::store::get_statistics() {
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    statistics stats;
+
+    stats.beatmaps = get_header()->count;
+    stats.pack_size = pack_size;
+    stats.uncompressed_size = uncompressed_size;
+
+    return stats;
+}
+
+shiro::beatmaps::store::index_header *shiro::beatmaps::store::get_header() {
+    return reinterpret_cast<index_header*>(index_file.data());
+}
+
+shiro::beatmaps::store::index_entry *shiro::beatmaps::store::get_entries() {
+    return reinterpret_cast<index_entry*>(index_file.data() + sizeof(index_header));
+}
+
+shiro::beatmaps::store::index_entry *shiro::beatmaps::store::find_slot(int32_t beatmap_id) {
+    uint32_t mask = get_header()->capacity - 1;
+    uint32_t slot = ((uint32_t) beatmap_id * 2654435761u) & mask;
+    index_entry *entries = get_entries();
+
+    // The table is never full, so this always ends on the beatmap or an empty slot
+    while (entries[slot].beatmap_id != 0 && entries[slot].beatmap_id != beatmap_id) {
+        slot = (slot + 1) & mask;
+    }
+
+    return &entries[slot];
+}
+
+bool shiro::beatmaps::store::create_index(const fs::path &path, uint32_t capacity) {
+    boost::iostreams::mapped_file_params params(path.u8string());
+    params.flags = boost::iostreams::mapped_file::readwrite;
+    params.new_file_size = sizeof(index_header) + (size_t) capacity * sizeof(index_entry);
+
+    boost::iostreams::mapped_file file;
+
+    try {
+        file.open(params);
+    } catch (const std::exception &ex) {
+        LOG_F(ERROR, "Unable to create beatmap index file %s: %s", path.u8string().c_str(), ex.what());
+        return false;
+    }
+
+    std::memset(file.data(), 0, file.size());
+
+    index_header *header = reinterpret_cast<index_header*>(file.data());
+    std::memcpy(header->magic, index_magic, sizeof(index_magic));
+    header->version = index_version;
+    header->capacity = capacity;
+
+    return true;
+}
+
+void shiro::beatmaps::store::rebuild_index(uint32_t capacity) {
+    fs::path temporary = index_path;
+    temporary += ".tmp";
+
+    if (!create_index(temporary, capacity))
+        ABORT_F("Unable to rebuild beatmap index file %s.", index_path.u8string().c_str());
+
+    std::vector<index_entry> entries;
+    entries.reserve(get_header()->count);
+
+    for (uint32_t i = 0; i < get_header()->capacity; i++) {
+        const index_entry &entry = get_entries()[i];
+
+        if (entry.beatmap_id == 0 || entry.offset < sizeof(pack_magic) || entry.offset + entry.stored_size > pack_size)
+            continue;
+
+        entries.emplace_back(entry);
+    }
+
+    // Windows can't replace a file that is still mapped
+    index_file.close();
+    fs::rename(temporary, index_path);
+    map_index();
+
+    for (const index_entry &entry : entries) {
+        *find_slot(entry.beatmap_id) = entry;
+    }
+
+    get_header()->count = (uint32_t) entries.size();
+}
+
+void shiro::beatmaps::store::map_index() {
+    boost::iostreams::mapped_file_params params(index_path.u8string());
+    params.flags = boost::iostreams::mapped_file::readwrite;
+
+    try {
+        index_file.open(params);
+    } catch (const std::exception &ex) {
+        ABORT_F("Unable to map beatmap index file %s: %s", index_path.u8string().c_str(), ex.what());
+    }
+
+    if (index_file.size() < sizeof(index_header) ||
+        index_file.size() != sizeof(index_header) + (size_t) get_header()->capacity * sizeof(index_entry))
+        ABORT_F("Beatmap index file %s is corrupted.", index_path.u8string().c_str());
+}
+
+void shiro::beatmaps::store::map_pack() {
+    // Views handed out earlier keep the previous mapping alive
+    std::shared_ptr<boost::iostreams::mapped_file_source> file = std::make_shared<boost::iostreams::mapped_file_source>();
+
+    try {
+        file->open(pack_path.u8string(), (size_t) pack_size);
+    } catch (const std::exception &ex) {
+        ABORT_F("Unable to map beatmap pack file %s: %s", pack_path.u8string().c_str(), ex.what());
+    }
+
+    pack_file = std::move(file);
+}
+
+std::string shiro::beatmaps::store::compress(const std::string &contents) {
+    lzma_options_lzma options {};
+
+    if (lzma_lzma_preset(&options, compression_preset))
+        return "";
+
+    // The preset dictionary is megabytes large and has to be set up for every beatmap, the
+    // dictionary never needs to be larger than the beatmap itself which makes both directions a lot faster
+    uint32_t dictionary_size = LZMA_DICT_SIZE_MIN;
+
+    while (dictionary_size < contents.size() && dictionary_size < options.dict_size) {
+        dictionary_size <<= 1;
+    }
+
+    options.dict_size = dictionary_size;
+
+    lzma_filter filters[] = {
+            { LZMA_FILTER_LZMA2, &options },
+            { LZMA_VLI_UNKNOWN, nullptr }
+    };
+
+    std::string output;
+    output.resize(lzma_stream_buffer_bound(contents.size()));
+
+    size_t position = 0;
+
+    lzma_ret result = lzma_stream_buffer_encode(
+            filters, LZMA_CHECK_CRC32, nullptr,
+            reinterpret_cast<const uint8_t*>(contents.data()), contents.size(),
+            reinterpret_cast<uint8_t*>(&output[0]), &position, output.size()
+    );
+
+    if (result != LZMA_OK)
+        return "";
+
+    output.resize(position);
+    return output;
+}
+
+bool shiro::beatmaps::store::decompress(const char *input, size_t input_size, std::string &output) {
+    uint64_t memory_limit = UINT64_MAX;
+    size_t input_position = 0;
+    size_t output_position = 0;
+
+    lzma_ret result = lzma_stream_buffer_decode(
+            &memory_limit, 0, nullptr,
+            reinterpret_cast<const uint8_t*>(input), &input_position, input_size,
+            reinterpret_cast<uint8_t*>(&output[0]), &output_position, output.size()
+    );
+
+    return result == LZMA_OK && output_position == output.size();
+}
+
+void shiro::beatmaps::store::restore_pack() {
+    std::error_code error;
+
+    pack_stream.close();
+    pack_stream.clear();
+
+    fs::resize_file(pack_path, pack_size, error);
+
+    if (error) {
+        LOG_F(ERROR, "Unable to truncate beatmap pack to %lu bytes: %s", pack_size, error.message().c_str());
+
+        // Keep the garbage but append behind it
+        uint64_t size = fs::file_size(pack_path, error);
+
+        if (!error)
+            pack_size = size;
+    }
+
+    pack_stream.open(pack_path, std::ios::binary | std::ios::app);
+
+    if (!pack_stream)
+        LOG_F(ERROR, "Unable to reopen beatmap pack file %s.", pack_path.u8string().c_str());
+}
+
+bool shiro::beatmaps::store::is_readable(const index_entry &entry) {
+    if (!(entry.flags & compressed_flag))
+        return true;
+
+    if (pack_file == nullptr || entry.offset + entry.stored_size > pack_file->size())
+        map_pack();
+
+    std::string buffer(entry.size, '\0');
+    return decompress(pack_file->data() + entry.offset, entry.stored_size, buffer);
+}
@@ -0,0 +1,59 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_BEATMAP_STORE_HH
+#define SHIRO_BEATMAP_STORE_HH
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "../utils/filesystem.hh"
+
+namespace shiro::beatmaps::store {
+
+    // Contents of a stored .osu file. Uncompressed beatmaps point straight into the mapped pack file,
+    // compressed beatmaps own their decompressed copy. The contents stay valid as long as the view exists.
+    struct beatmap_view {
+        std::shared_ptr<const void> owner = nullptr;
+        std::string_view contents;
+    };
+
+    struct statistics {
+        size_t beatmaps = 0;
+        size_t pack_size = 0; // In bytes
+        size_t uncompressed_size = 0; // In bytes
+    };
+
+    void init(const fs::path &directory);
+
+    std::optional<beatmap_view> get(int32_t beatmap_id);
+
+    // The pack is append-only, beatmaps that are already stored are kept as they are unless they can no longer be read
+    bool put(int32_t beatmap_id, const std::string &contents);
+
+    // Moves loose <beatmap id>.osu files from the old directory layout into the pack
+    size_t migrate(const fs::path &directory);
+
+    statistics get_statistics();
+
+}
+
+#endif //SHIRO_BEATMAP_STORE_HH
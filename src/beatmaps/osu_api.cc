@@ -0,0 +1,454 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <curl/curl.h>
+#include <deque>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../config/bancho_file.hh"
+#include "../logger/sentry_logger.hh"
+#include "../thirdparty/json.hh"
+#include "../thirdparty/loguru.hh"
+#include "../utils/curler.hh"
+#include "../utils/play_mode.hh"
+#include "beatmap.hh"
+#include "beatmap_ranked_status.hh"
+#include "osu_api.hh"
+
+namespace shiro::beatmaps::osu_api {
+
+    struct transfer {
+        std::string key;
+        std::string url;
+        std::string output;
+        std::promise<response> promise;
+        CURL *handle = nullptr;
+    };
+
+    static std::deque<std::unique_ptr<transfer>> queue;
+    static std::unordered_map<std::string, std::shared_future<response>> requests; // Queued and running transfers by key
+    static std::mutex mutex;
+    static std::condition_variable condition;
+
+    static std::thread worker;
+    static bool running = false;
+
+    static std::unordered_map<int32_t, std::shared_future<bool>> beatmap_sets; // Beatmap sets currently being fetched
+    static std::mutex beatmap_sets_mutex;
+
+    static std::shared_future<response> request(const std::string &key, const std::string &url);
+
+    static void work();
+    static void start(CURLM *multi, transfer &t);
+    static void finish(transfer &t, CURLcode status_code);
+
+    static bool load_beatmap_set(int32_t beatmapset_id);
+    static bool parse_beatmap(json &part, beatmap &map);
+
+}
+
+void shiro::beatmaps::osu_api::init() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (running)
+        return;
+
+    running = true;
+    worker = std::thread(work);
+}
+
+void shiro::beatmaps::osu_api::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!running)
+            return;
+
+        running = false;
+    }
+
+    condition.notify_all();
+
+    if (worker.joinable())
+        worker.join();
+}
+
+std::shared_future<shiro::beatmaps::osu_api::response> shiro::beatmaps::osu_api::get_beatmap(int32_t beatmap_id) {
+    std::string url = config::bancho::api_url + "api/get_beatmaps?k=" + config::bancho::api_key + "&b=" + std::to_string(beatmap_id);
+    return request("b:" + std::to_string(beatmap_id), url);
+}
+
+std::shared_future<shiro::beatmaps::osu_api::response> shiro::beatmaps::osu_api::get_beatmap_set(int32_t beatmapset_id) {
+    std::string url = config::bancho::api_url + "api/get_beatmaps?k=" + config::bancho::api_key + "&s=" + std::to_string(beatmapset_id);
+    return request("s:" + std::to_string(beatmapset_id), url);
+}
+
+std::shared_future<shiro::beatmaps::osu_api::response> shiro::beatmaps::osu_api::get_osu_file(int32_t beatmap_id) {
+    std::string url = config::bancho::api_url + "osu/" + std::to_string(beatmap_id);
+    return request("osu:" + std::to_string(beatmap_id), url);
+}
+
+std::optional<int32_t> shiro::beatmaps::osu_api::fetch_beatmapset_id(int32_t beatmap_id) {
+    auto [success, output] = get_beatmap(beatmap_id).get();
+
+    if (!success) {
+        LOG_F(ERROR, "Unable to connect to osu! api: %s.", output.c_str());
+        return std::nullopt;
+    }
+
+    json json_result;
+
+    try {
+        json_result = json::parse(output);
+    } catch (const json::parse_error &ex) {
+        LOG_F(ERROR, "Unable to parse json response from osu! api: %s.", ex.what());
+        logging::sentry::exception(ex);
+
+        return std::nullopt;
+    }
+
+    int32_t beatmapset_id = 0;
+
+    for (auto &part : json_result) {
+        try {
+            beatmapset_id = boost::lexical_cast<int32_t>(std::string(part["beatmapset_id"]));
+        } catch (const boost::bad_lexical_cast &ex) {
+            LOG_F(ERROR, "Unable to cast response of osu! API to valid data types: %s.", ex.what());
+            logging::sentry::exception(ex);
+
+            return std::nullopt;
+        }
+    }
+
+    return beatmapset_id;
+}
+
+bool shiro::beatmaps::osu_api::fetch_beatmap_set(int32_t beatmapset_id) {
+    std::promise<bool> promise;
+    std::shared_future<bool> future;
+
+    {
+        std::lock_guard<std::mutex> lock(beatmap_sets_mutex);
+        auto iterator = beatmap_sets.find(beatmapset_id);
+
+        if (iterator != beatmap_sets.end()) {
+            future = iterator->second;
+        } else {
+            beatmap_sets.emplace(beatmapset_id, promise.get_future().share());
+        }
+    }
+
+    if (future.valid())
+        return future.get();
+
+    bool result = false;
+
+    try {
+        result = load_beatmap_set(beatmapset_id);
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(beatmap_sets_mutex);
+            beatmap_sets.erase(beatmapset_id);
+        }
+
+        promise.set_value(false);
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(beatmap_sets_mutex);
+        beatmap_sets.erase(beatmapset_id);
+    }
+
+    promise.set_value(result);
+    return result;
+}
+
+std::shared_future<shiro::beatmaps::osu_api::response> shiro::beatmaps::osu_api::request(const std::string &key, const std::string &url) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iterator = requests.find(key);
+
+    if (iterator != requests.end())
+        return iterator->second;
+
+    std::unique_ptr<transfer> t = std::make_unique<transfer>();
+    std::shared_future<response> future = t->promise.get_future().share();
+
+    if (!running) {
+        t->promise.set_value({ false, "osu! api client is not running." });
+        return future;
+    }
+
+    t->key = key;
+    t->url = url;
+
+    requests.emplace(key, future);
+    queue.emplace_back(std::move(t));
+
+    condition.notify_one();
+    return future;
+}
+
+void shiro::beatmaps::osu_api::work() {
+    CURLM *multi = curl_multi_init();
+
+    // Concurrent transfers share one connection if osu! speaks HTTP/2
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    std::unordered_map<CURL*, std::unique_ptr<transfer>> active;
+    std::chrono::steady_clock::time_point next_start = std::chrono::steady_clock::now();
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            if (active.empty()) {
+                if (queue.empty()) {
+                    condition.wait(lock, []() {
+                        return !running || !queue.empty();
+                    });
+                } else {
+                    // Waiting for the rate limit
+                    condition.wait_until(lock, next_start, []() {
+                        return !running;
+                    });
+                }
+            }
+
+            if (!running)
+                break;
+
+            uint32_t requests_per_minute = config::bancho::api_requests_per_minute;
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+            while (!queue.empty() && now >= next_start) {
+                std::unique_ptr<transfer> t = std::move(queue.front());
+                queue.pop_front();
+
+                start(multi, *t);
+                active.emplace(t->handle, std::move(t));
+
+                if (requests_per_minute > 0)
+                    next_start = std::max(next_start, now) + std::chrono::microseconds(60000000 / requests_per_minute);
+            }
+        }
+
+        int running_handles = 0;
+        curl_multi_perform(multi, &running_handles);
+
+        int queued_messages = 0;
+
+        while (CURLMsg *message = curl_multi_info_read(multi, &queued_messages)) {
+            if (message->msg != CURLMSG_DONE)
+                continue;
+
+            CURL *handle = message->easy_handle;
+            CURLcode status_code = message->data.result;
+            auto iterator = active.find(handle);
+
+            curl_multi_remove_handle(multi, handle);
+            curl_easy_cleanup(handle);
+
+            if (iterator == active.end())
+                continue;
+
+            finish(*iterator->second, status_code);
+            active.erase(iterator);
+        }
+
+        if (!active.empty())
+            curl_multi_wait(multi, nullptr, 0, 50, nullptr);
+    }
+
+    // Shutting down, nobody should wait forever on transfers that will never finish
+    for (auto &[handle, t] : active) {
+        curl_multi_remove_handle(multi, handle);
+        curl_easy_cleanup(handle);
+
+        finish(*t, CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    std::deque<std::unique_ptr<transfer>> remaining;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining.swap(queue);
+    }
+
+    for (std::unique_ptr<transfer> &t : remaining) {
+        finish(*t, CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    curl_multi_cleanup(multi);
+}
+
+void shiro::beatmaps::osu_api::start(CURLM *multi, transfer &t) {
+    t.handle = curl_easy_init();
+
+    utils::curl::setup_handle(t.handle);
+
+    curl_easy_setopt(t.handle, CURLOPT_WRITEFUNCTION, utils::curl::internal_callback);
+    curl_easy_setopt(t.handle, CURLOPT_WRITEDATA, &t.output);
+    curl_easy_setopt(t.handle, CURLOPT_URL, t.url.c_str());
+
+    // Wait for an HTTP/2 connection that is being established instead of opening another one
+    curl_easy_setopt(t.handle, CURLOPT_PIPEWAIT, 1L);
+
+    curl_multi_add_handle(multi, t.handle);
+}
+
+void shiro::beatmaps::osu_api::finish(transfer &t, CURLcode status_code) {
+    response result;
+
+    if (status_code == CURLE_OK) {
+        logging::sentry::http_request_out(t.url, "GET", status_code, t.url.find("/osu/") == std::string::npos ? t.output : "");
+        result = { true, std::move(t.output) };
+    } else {
+        std::string error = curl_easy_strerror(status_code);
+
+        logging::sentry::http_request_out(t.url, "GET", status_code, error);
+        result = { false, error };
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.erase(t.key);
+    }
+
+    t.promise.set_value(result);
+}
+
+bool shiro::beatmaps::osu_api::load_beatmap_set(int32_t beatmapset_id) {
+    auto [success, output] = get_beatmap_set(beatmapset_id).get();
+
+    if (!success) {
+        LOG_F(ERROR, "Unable to connect to osu! api: %s.", output.c_str());
+        return false;
+    }
+
+    json json_result;
+
+    try {
+        json_result = json::parse(output);
+    } catch (const json::parse_error &ex) {
+        LOG_F(ERROR, "Unable to parse json response from osu! api: %s.", ex.what());
+        logging::sentry::exception(ex);
+
+        return false;
+    }
+
+    std::vector<beatmap> beatmaps;
+    beatmaps.reserve(json_result.size());
+
+    for (auto &part : json_result) {
+        beatmap map;
+
+        if (!parse_beatmap(part, map))
+            return false;
+
+        beatmaps.emplace_back(std::move(map));
+    }
+
+    beatmap::save(beatmaps);
+    return true;
+}
+
+bool shiro::beatmaps::osu_api::parse_beatmap(json &part, beatmap &map) {
+    try {
+        std::string artist = part["artist"];
+        std::string title = part["title"];
+        std::string version = part["version"];
+
+        char buffer[128];
+        std::snprintf(buffer, sizeof(buffer), "%s - %s [%s]", artist.c_str(), title.c_str(), version.c_str());
+        map.song_name = buffer;
+
+        map.beatmap_md5 = part["file_md5"];
+        map.beatmapset_id = boost::lexical_cast<int32_t>(std::string(part["beatmapset_id"]));
+        map.beatmap_id = boost::lexical_cast<int32_t>(std::string(part["beatmap_id"]));
+        map.ranked_status = boost::lexical_cast<int32_t>(std::string(part["approved"]));
+        map.hit_length = boost::lexical_cast<int32_t>(std::string(part["hit_length"]));
+        map.play_mode = (uint8_t) boost::lexical_cast<int32_t>(std::string(part["mode"]));
+        map.ar = boost::lexical_cast<float>(std::string(part["diff_approach"]));
+        map.od = boost::lexical_cast<float>(std::string(part["diff_overall"]));
+        map.size = boost::lexical_cast<float>(std::string(part["diff_size"]));
+        map.drain = boost::lexical_cast<float>(std::string(part["diff_drain"]));
+        map.bpm = static_cast<int32_t>(boost::lexical_cast<float>(std::string(part["bpm"])));
+
+        switch ((utils::play_mode) map.play_mode) {
+            case utils::play_mode::standard:
+                map.diff_std = boost::lexical_cast<float>(std::string(part["difficultyrating"]));
+                map.aim = boost::lexical_cast<float>(std::string(part["diff_aim"]));
+                map.speed = boost::lexical_cast<float>(std::string(part["diff_speed"]));
+
+                // For some older beatmaps the max_combo is null. See ppy/osu-api#130
+                if (!part["max_combo"].is_null())
+                    map.max_combo = boost::lexical_cast<int32_t>(std::string(part["max_combo"]));
+
+                break;
+            case utils::play_mode::taiko:
+                map.diff_taiko = boost::lexical_cast<float>(std::string(part["difficultyrating"]));
+                break;
+            case utils::play_mode::fruits:
+                if (!part["difficultyrating"].is_null())
+                    map.diff_ctb = boost::lexical_cast<float>(std::string(part["difficultyrating"]));
+
+                map.aim = boost::lexical_cast<float>(std::string(part["diff_aim"]));
+
+                // For some older beatmaps the max_combo is null. See ppy/osu-api#130
+                if (!part["max_combo"].is_null())
+                    map.max_combo = boost::lexical_cast<int32_t>(std::string(part["max_combo"]));
+
+                break;
+            case utils::play_mode::mania:
+                map.diff_mania = boost::lexical_cast<float>(std::string(part["difficultyrating"]));
+                break;
+        }
+
+        // Beatmap is unranked
+        if (part["approved_date"].is_null())
+            map.ranked_status = (int32_t) status::latest_pending;
+    } catch (const boost::bad_lexical_cast &ex) {
+        LOG_F(ERROR, "Unable to cast response of Bancho API to valid data types: %s.", ex.what());
+        logging::sentry::exception(ex);
+
+        return false;
+    }
+
+    std::string last_update = part["last_update"];
+
+    std::tm time {};
+    std::stringstream stream(last_update);
+    stream >> std::get_time(&time, "%Y-%m-%d %H:%M:%S");
+    std::chrono::time_point time_point = std::chrono::system_clock::from_time_t(std::mktime(&time));
+    std::chrono::seconds seconds = std::chrono::time_point_cast<std::chrono::seconds>(time_point).time_since_epoch();
+    map.last_update = seconds.count();
+
+    return true;
+}
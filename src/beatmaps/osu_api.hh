@@ -0,0 +1,52 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_OSU_API_HH
+#define SHIRO_OSU_API_HH
+
+#include <cstdint>
+#include <future>
+#include <optional>
+#include <string>
+#include <tuple>
+
+namespace shiro::beatmaps::osu_api {
+
+    // Same format as utils::curl::get
+    using response = std::tuple<bool, std::string>;
+
+    // Starts the thread that performs all requests to osu!
+    void init();
+    void destroy();
+
+    // Concurrent requests for the same resource share one transfer. Transfers are started
+    // no faster than the rate limit configured in bancho.toml allows.
+    std::shared_future<response> get_beatmap(int32_t beatmap_id);
+    std::shared_future<response> get_beatmap_set(int32_t beatmapset_id);
+    std::shared_future<response> get_osu_file(int32_t beatmap_id);
+
+    // Returns std::nullopt if osu! could not be asked, 0 if the beatmap is not submitted
+    std::optional<int32_t> fetch_beatmapset_id(int32_t beatmap_id);
+
+    // Requests all beatmaps of the set and saves new ones into the database with a single insert.
+    // Concurrent calls for the same set wait for the call that is already running.
+    bool fetch_beatmap_set(int32_t beatmapset_id);
+
+}
+
+#endif //SHIRO_OSU_API_HH
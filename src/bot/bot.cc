@@ -34,6 +34,7 @@
 #include "../commands/staff/restrict_command.hh"
 #include "../commands/staff/rtx_command.hh"
 #include "../commands/staff/silence_command.hh"
+#include "../commands/staff/stats_command.hh"
 #include "../config/bot_file.hh"
 #include "../config/db_file.hh"
 #include "../database/tables/user_table.hh"
@@ -51,7 +52,7 @@ std::shared_ptr<shiro::users::user> shiro::bot::bot_user = nullptr;
 static std::unordered_map<std::string, std::function<bool(std::deque<std::string>&, std::shared_ptr<shiro::users::user>, std::string)>> commands_map;
 
 void shiro::bot::init() {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::users user_table {};
 
     auto result = db(select(all_of(user_table)).from(user_table).where(user_table.id == 1).limit(1u));
@@ -100,10 +101,8 @@ void shiro::bot::init() {
 
     bot::bot_user = bot_user;
 
-    scheduler.Schedule(30s, [bot_user](tsc::TaskContext ctx) {
+    scheduler.schedule_every(30s, "bot::clear_queue", [bot_user]() {
         bot_user->queue.clear();
-
-        ctx.Repeat(30s);
     });
 
     LOG_F(INFO, "Bot has been successfully registered as %s and is now online.", config::bot::name.c_str());
@@ -123,6 +122,7 @@ void shiro::bot::init_commands() {
     commands_map.insert(std::make_pair("roll", commands::roll));
     commands_map.insert(std::make_pair("rtx", commands::rtx));
     commands_map.insert(std::make_pair("silence", commands::silence));
+    commands_map.insert(std::make_pair("stats", commands::stats));
 
     LOG_F(INFO, "Bot commands have been successfully loaded. %lu commands available.", commands_map.size());
 }
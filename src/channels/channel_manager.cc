@@ -34,7 +34,7 @@ void shiro::channels::manager::init() {
     if (!channels.empty())
         channels.clear();
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::channels channel_table {};
 
     insert_if_not_exists("#announce", "", true, false, true, 0);
@@ -186,7 +186,7 @@ uint32_t shiro::channels::manager::get_channel_id(const std::string &channel_nam
 }
 
 void shiro::channels::manager::insert_if_not_exists(std::string name, std::string description, bool auto_join, bool hidden, bool read_only, uint64_t permission) {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::channels channel_table {};
 
     auto result = db(select(all_of(channel_table)).from(channel_table).where(channel_table.name == name).limit(1u));
@@ -50,12 +50,15 @@ void shiro::channels::bridge::callback(void *user_data, const loguru::Message &l
 
     future_writer.user_presence(bot_user->presence);
 
+    io::packet_chunk chunk = io::make_chunk(writer);
+    io::packet_chunk future_chunk = io::make_chunk(future_writer);
+
     for (const std::shared_ptr<users::user> &user : channels::manager::get_users_in_channel("#console")) {
         if (user == nullptr || user->user_id == 1)
             continue;
 
-        user->queue.enqueue(writer);
-        user->queue.enqueue_next(future_writer);
+        user->queue.enqueue(chunk);
+        user->queue.enqueue_next(future_chunk);
     }
 }
 
@@ -37,6 +37,7 @@ bool shiro::commands::help(std::deque<std::string> &args, std::shared_ptr<shiro:
     utils::bot::respond("!restrict - Restricts a player", user, channel, true);
     utils::bot::respond("!rtx - Send a rtx to a specific user", user, channel, true);
     utils::bot::respond("!silence - Mutes a player", user, channel, true);
+    utils::bot::respond("!stats - Shows database pool and cache statistics, or scheduled task timings with !stats tasks", user, channel, true);
 
     return true;
 }
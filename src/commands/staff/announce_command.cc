@@ -55,9 +55,7 @@ bool shiro::commands::announce(std::deque<std::string> &args, std::shared_ptr<sh
         return true;
     }
 
-    users::manager::iterate([&writer](std::shared_ptr<users::user> online_user) {
-        online_user->queue.enqueue(writer);
-    }, true);
+    users::manager::broadcast(writer);
 
     utils::bot::respond("Successfully sent a announcement to everyone.", user, channel, true);
     return true;
@@ -56,8 +56,9 @@ bool shiro::commands::clear(std::deque<std::string> &args, std::shared_ptr<shiro
         return true;
     }
 
-    users::manager::iterate([user, &writer](std::shared_ptr<users::user> online_user) {
-        online_user->queue.enqueue(writer);
+    users::manager::broadcast(writer);
+
+    users::manager::iterate([user](std::shared_ptr<users::user> online_user) {
         utils::bot::respond("Your chat was cleared by " + user->presence.username + ".", online_user, config::bot::name, true);
     }, true);
 
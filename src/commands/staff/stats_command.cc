@@ -0,0 +1,133 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+
+#include "../../beatmaps/beatmap_cache.hh"
+#include "../../beatmaps/beatmap_store.hh"
+#include "../../permissions/role_manager.hh"
+#include "../../pp/pp_difficulty_cache.hh"
+#include "../../scores/leaderboard_cache.hh"
+#include "../../shiro.hh"
+#include "../../utils/bot_utils.hh"
+#include "stats_command.hh"
+
+namespace shiro::commands {
+
+    static bool tasks(std::shared_ptr<users::user> user, const std::string &channel);
+
+    static double to_mib(size_t bytes);
+
+}
+
+bool shiro::commands::stats(std::deque<std::string> &args, std::shared_ptr<shiro::users::user> user, std::string channel) {
+    if (args.size() >= 2 || (args.size() == 1 && args.at(0) != "tasks")) {
+        utils::bot::respond("Usage: !stats [tasks]", user, channel, true);
+        return false;
+    }
+
+    if (!roles::manager::has_permission(user, permissions::perms::cmd_stats)) {
+        utils::bot::respond("Permission denied. (" + std::to_string((uint64_t) permissions::perms::cmd_stats) + ")", user, channel, true);
+        return false;
+    }
+
+    if (args.size() == 1)
+        return tasks(user, channel);
+
+    char buffer[256];
+
+    database::statistics pool = db_connection->get_statistics();
+    std::snprintf(
+            buffer, sizeof(buffer),
+            "Database: %zu open, %zu idle, %zu in use, %zu waiting. %llu acquired (avg wait %llu us, max %llu us), %llu created, %llu discarded, %llu timeouts.",
+            pool.open, pool.idle, pool.in_use, pool.waiting,
+            (unsigned long long) pool.acquired,
+            (unsigned long long) (pool.acquired > 0 ? pool.total_wait_time.count() / pool.acquired : 0),
+            (unsigned long long) pool.max_wait_time.count(),
+            (unsigned long long) pool.created, (unsigned long long) pool.discarded, (unsigned long long) pool.timeouts
+    );
+    utils::bot::respond(buffer, user, channel, true);
+
+    beatmaps::cache::statistics beatmap_cache = beatmaps::cache::get_statistics();
+    std::snprintf(
+            buffer, sizeof(buffer),
+            "Beatmap cache: %zu beatmaps, %zu unsubmitted. %llu hits, %llu unsubmitted hits, %llu misses, %llu expirations, %llu evictions, %llu invalidations.",
+            beatmap_cache.beatmaps, beatmap_cache.unsubmitted,
+            (unsigned long long) beatmap_cache.hits, (unsigned long long) beatmap_cache.unsubmitted_hits,
+            (unsigned long long) beatmap_cache.misses, (unsigned long long) beatmap_cache.expirations,
+            (unsigned long long) beatmap_cache.evictions, (unsigned long long) beatmap_cache.invalidations
+    );
+    utils::bot::respond(buffer, user, channel, true);
+
+    beatmaps::store::statistics store = beatmaps::store::get_statistics();
+    std::snprintf(
+            buffer, sizeof(buffer),
+            "Beatmap store: %zu beatmaps, %.1f MiB packed from %.1f MiB.",
+            store.beatmaps, to_mib(store.pack_size), to_mib(store.uncompressed_size)
+    );
+    utils::bot::respond(buffer, user, channel, true);
+
+    scores::leaderboard_cache::statistics leaderboards = scores::leaderboard_cache::get_statistics();
+    std::snprintf(
+            buffer, sizeof(buffer),
+            "Leaderboards: %zu boards, %.1f of %.1f MiB. %llu hits, %llu misses, %llu evictions, %llu updates.",
+            leaderboards.boards, to_mib(leaderboards.memory_usage), to_mib(leaderboards.memory_budget),
+            (unsigned long long) leaderboards.hits, (unsigned long long) leaderboards.misses,
+            (unsigned long long) leaderboards.evictions, (unsigned long long) leaderboards.updates
+    );
+    utils::bot::respond(buffer, user, channel, true);
+
+    pp::difficulty_cache::statistics difficulty = pp::difficulty_cache::get_statistics();
+    std::snprintf(
+            buffer, sizeof(buffer),
+            "Difficulty cache: %zu entries, %.1f of %.1f MiB. %llu hits, %llu misses, %llu evictions.",
+            difficulty.entries, to_mib(difficulty.memory_usage), to_mib(difficulty.memory_budget),
+            (unsigned long long) difficulty.hits, (unsigned long long) difficulty.misses, (unsigned long long) difficulty.evictions
+    );
+    utils::bot::respond(buffer, user, channel, true);
+
+    return true;
+}
+
+bool shiro::commands::tasks(std::shared_ptr<shiro::users::user> user, const std::string &channel) {
+    task_scheduler::statistics scheduled = scheduler.get_statistics();
+    char buffer[256];
+
+    std::snprintf(buffer, sizeof(buffer), "Scheduler: %zu workers, %zu pending, %zu running.", scheduled.workers, scheduled.pending, scheduled.running);
+    utils::bot::respond(buffer, user, channel, true);
+
+    for (const task_scheduler::task_statistics &task : scheduled.tasks) {
+        std::snprintf(
+                buffer, sizeof(buffer),
+                "%s: %llu runs, %llu failures. Runtime avg %.2f ms, max %.2f ms. Lag last %.2f ms, max %.2f ms.",
+                task.name.c_str(),
+                (unsigned long long) task.runs, (unsigned long long) task.failures,
+                task.runs > 0 ? task.total_runtime.count() / 1000.0 / task.runs : 0.0,
+                task.max_runtime.count() / 1000.0,
+                task.last_lag.count() / 1000.0,
+                task.max_lag.count() / 1000.0
+        );
+        utils::bot::respond(buffer, user, channel, true);
+    }
+
+    return true;
+}
+
+double shiro::commands::to_mib(size_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
@@ -31,6 +31,12 @@ uint16_t shiro::config::bancho::concurrency = 64;
 bool shiro::config::bancho::default_supporter = false;
 
 std::string shiro::config::bancho::api_key = "osu! API key";
+std::string shiro::config::bancho::api_url = "https://old.ppy.sh/";
+uint32_t shiro::config::bancho::api_requests_per_minute = 600;
+
+uint32_t shiro::config::bancho::beatmap_cache_size = 10000;
+uint32_t shiro::config::bancho::beatmap_pending_ttl = 600;
+uint32_t shiro::config::bancho::beatmap_unsubmitted_ttl = 600;
 
 std::string shiro::config::bancho::alert = "Welcome to Shiro";
 std::string shiro::config::bancho::title_image = "https://i.ppy.sh/motd.png";
@@ -56,6 +62,12 @@ void shiro::config::bancho::parse() {
     default_supporter = config_file->get_qualified_as<bool>("permissions.default_supporter").value_or(false);
 
     api_key = config_file->get_qualified_as<std::string>("api.key").value_or("osu! API key");
+    api_url = config_file->get_qualified_as<std::string>("api.url").value_or("https://old.ppy.sh/");
+    api_requests_per_minute = config_file->get_qualified_as<uint32_t>("api.requests_per_minute").value_or(600);
+
+    beatmap_cache_size = config_file->get_qualified_as<uint32_t>("beatmaps.cache_size").value_or(10000);
+    beatmap_pending_ttl = config_file->get_qualified_as<uint32_t>("beatmaps.pending_ttl").value_or(600);
+    beatmap_unsubmitted_ttl = config_file->get_qualified_as<uint32_t>("beatmaps.unsubmitted_ttl").value_or(600);
 
     alert = config_file->get_qualified_as<std::string>("motd.alert").value_or("Welcome to Shiro");
     title_image = config_file->get_qualified_as<std::string>("motd.title_image").value_or("https://i.ppy.sh/motd.png");
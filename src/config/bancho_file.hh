@@ -19,6 +19,7 @@
 #ifndef SHIRO_BANCHO_FILE_HH
 #define SHIRO_BANCHO_FILE_HH
 
+#include <cstdint>
 #include <string>
 
 namespace shiro::config::bancho {
@@ -30,6 +31,12 @@ namespace shiro::config::bancho {
     extern bool default_supporter;
 
     extern std::string api_key;
+    extern std::string api_url;
+    extern uint32_t api_requests_per_minute;
+
+    extern uint32_t beatmap_cache_size;
+    extern uint32_t beatmap_pending_ttl;
+    extern uint32_t beatmap_unsubmitted_ttl;
 
     extern std::string alert;
     extern std::string title_image;
@@ -30,6 +30,10 @@ std::string shiro::config::database::database = "shiro";
 std::string shiro::config::database::username = "root";
 std::string shiro::config::database::password = "hunter2";
 
+uint32_t shiro::config::database::pool_size = 16;
+uint32_t shiro::config::database::pool_idle_timeout = 300;
+uint32_t shiro::config::database::pool_wait_timeout = 10;
+
 std::string shiro::config::database::redis_address = "127.0.0.1";
 uint32_t shiro::config::database::redis_port = 6379;
 std::string shiro::config::database::redis_password = "";
@@ -51,6 +55,10 @@ void shiro::config::database::parse() {
     username = config_file->get_qualified_as<std::string>("database.username").value_or("root");
     password = config_file->get_qualified_as<std::string>("database.password").value_or("hunter2");
 
+    pool_size = config_file->get_qualified_as<uint32_t>("database.pool_size").value_or(16);
+    pool_idle_timeout = config_file->get_qualified_as<uint32_t>("database.pool_idle_timeout").value_or(300);
+    pool_wait_timeout = config_file->get_qualified_as<uint32_t>("database.pool_wait_timeout").value_or(10);
+
     redis_address = config_file->get_qualified_as<std::string>("redis.address").value_or("127.0.0.1");
     redis_port = config_file->get_qualified_as<uint32_t>("redis.port").value_or(6379);
     redis_password = config_file->get_qualified_as<std::string>("redis.password").value_or("");
@@ -62,6 +70,7 @@ void shiro::config::database::parse() {
     cli::cli_app.add_option("--db-database", database, "Database in MySQL server to put data into");
     cli::cli_app.add_option("--db-username", username, "Username used to authenticate with MySQL server");
     cli::cli_app.add_option("--db-password", password, "Password used to authenticate with MySQL server");
+    cli::cli_app.add_option("--db-pool-size", pool_size, "Maximum amount of pooled connections to MySQL server");
 
     cli::cli_app.add_option("--redis-address", redis_address, "Address of Redis server to connect to");
     cli::cli_app.add_option("--redis-port", redis_port, "Port of Redis server to connect to");
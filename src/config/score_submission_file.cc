@@ -34,6 +34,8 @@ static std::shared_ptr<cpptoml::table> config_file = nullptr;
 bool shiro::config::score_submission::save_failed_scores = true;
 bool shiro::config::score_submission::save_unranked_scores = false;
 std::string shiro::config::score_submission::overwrite_factor = "pp";
+uint32_t shiro::config::score_submission::leaderboard_cache_size = 64;
+uint32_t shiro::config::score_submission::difficulty_cache_size = 16;
 
 bool shiro::config::score_submission::consider_client_side_flags = false;
 bool shiro::config::score_submission::restrict_notepad_hack = true;
@@ -101,6 +103,8 @@ void shiro::config::score_submission::parse() {
     save_failed_scores = config_file->get_qualified_as<bool>("save_failed_scores").value_or(true);
     save_unranked_scores = config_file->get_qualified_as<bool>("save_unranked_scores").value_or(false);
     overwrite_factor = config_file->get_qualified_as<std::string>("overwrite_factor").value_or("pp");
+    leaderboard_cache_size = config_file->get_qualified_as<uint32_t>("leaderboard_cache_size").value_or(64);
+    difficulty_cache_size = config_file->get_qualified_as<uint32_t>("difficulty_cache_size").value_or(16);
 
     // Anti-cheat
     consider_client_side_flags =  config_file->get_qualified_as<bool>("anti_cheat.consider_client_site_flags").value_or(false);
@@ -27,6 +27,8 @@ namespace shiro::config::score_submission {
     extern bool save_failed_scores;
     extern bool save_unranked_scores;
     extern std::string overwrite_factor;
+    extern uint32_t leaderboard_cache_size;
+    extern uint32_t difficulty_cache_size;
 
     extern bool consider_client_side_flags;
     extern bool restrict_notepad_hack;
@@ -16,25 +16,77 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <iterator>
+
 #include "../config/cli_args.hh"
+#include "../config/db_file.hh"
 #include "../logger/sentry_logger.hh"
 #include "../thirdparty/loguru.hh"
 #include "../shiro.hh"
 #include "tables/beatmap_table.hh"
 #include "tables/channel_table.hh"
 #include "tables/punishments_table.hh"
+#include "tables/recalculations_table.hh"
 #include "tables/relationship_table.hh"
 #include "tables/roles_table.hh"
 #include "tables/score_table.hh"
 #include "tables/user_table.hh"
 #include "database.hh"
 
+// Connections idle for longer than this are pinged before being handed out again
+static constexpr std::chrono::seconds validation_interval = std::chrono::seconds(30);
+
+// Connection currently leased by this thread, handed out again to nested leases
+static thread_local sqlpp::mysql::connection *thread_connection = nullptr;
+
+shiro::database::connection::connection(shiro::database *pool, std::unique_ptr<sqlpp::mysql::connection> handle)
+    : pool(pool)
+    , handle(std::move(handle)) {
+    this->instance = this->handle.get();
+    thread_connection = this->instance;
+}
+
+shiro::database::connection::connection(sqlpp::mysql::connection *borrowed)
+    : instance(borrowed) {
+    // Initialized in initializer list
+}
+
+shiro::database::connection::connection(shiro::database::connection &&other) noexcept
+    : pool(other.pool)
+    , handle(std::move(other.handle))
+    , instance(other.instance) {
+    other.pool = nullptr;
+    other.instance = nullptr;
+}
+
+shiro::database::connection::~connection() {
+    if (this->pool == nullptr || this->handle == nullptr)
+        return;
+
+    if (thread_connection == this->instance)
+        thread_connection = nullptr;
+
+    this->pool->release(std::move(this->handle));
+}
+
+sqlpp::mysql::connection &shiro::database::connection::operator*() {
+    return *this->instance;
+}
+
+sqlpp::mysql::connection *shiro::database::connection::operator->() {
+    return this->instance;
+}
+
 shiro::database::database(const std::string &address, uint32_t port, const std::string &db, const std::string &username, const std::string &password)
     : address(address)
     , port(port)
     , db(db)
     , username(username)
-    , password(password) {
+    , password(password)
+    , pool_size(std::max(config::database::pool_size, 1u))
+    , idle_timeout(config::database::pool_idle_timeout)
+    , wait_timeout(config::database::pool_wait_timeout) {
     auto [argc, argv] = config::cli::get_args();
     sqlpp::mysql::global_library_init(argc, argv);
 }
@@ -60,15 +112,20 @@ void shiro::database::setup() {
     if (!this->is_connected(true))
         return;
 
-    sqlpp::mysql::connection db(this->config);
+    connection db = this->get_connection();
 
-    tables::migrations::beatmaps::create(db);
-    tables::migrations::channels::create(db);
-    tables::migrations::punishments::create(db);
-    tables::migrations::relationships::create(db);
-    tables::migrations::roles::create(db);
-    tables::migrations::scores::create(db);
-    tables::migrations::users::create(db);
+    tables::migrations::beatmaps::create(*db);
+    tables::migrations::channels::create(*db);
+    tables::migrations::punishments::create(*db);
+    tables::migrations::recalculations::create(*db);
+    tables::migrations::relationships::create(*db);
+    tables::migrations::roles::create(*db);
+    tables::migrations::scores::create(*db);
+    tables::migrations::users::create(*db);
+
+    scheduler.schedule_every(1min, "database::reap", [this]() {
+        this->reap();
+    });
 
     LOG_F(INFO, "Successfully connected and structured MySQL database.");
 }
@@ -78,9 +135,9 @@ bool shiro::database::is_connected(bool abort) {
         return false;
 
     try {
-        sqlpp::mysql::connection db(this->config);
+        connection db = this->get_connection();
 
-        return db.is_valid();
+        return db->is_valid();
     } catch (const sqlpp::exception &ex) {
         logging::sentry::exception(ex);
 
@@ -96,3 +153,136 @@ bool shiro::database::is_connected(bool abort) {
 std::shared_ptr<sqlpp::mysql::connection_config> shiro::database::get_config() {
     return this->config;
 }
+
+shiro::database::connection shiro::database::get_connection() {
+    if (thread_connection != nullptr)
+        return connection(thread_connection);
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(this->pool_mutex);
+
+    this->waiting_threads++;
+
+    bool available = this->pool_condition.wait_for(lock, this->wait_timeout, [this]() {
+        return !this->idle_connections.empty() || this->open_connections < this->pool_size;
+    });
+
+    this->waiting_threads--;
+
+    if (!available) {
+        this->timeouts++;
+        throw sqlpp::exception("Timed out waiting for a free MySQL connection (" + std::to_string(this->pool_size) + " in use).");
+    }
+
+    uint64_t waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    this->acquired++;
+    this->total_wait_us += waited;
+
+    uint64_t max_wait = this->max_wait_us.load();
+
+    while (waited > max_wait && !this->max_wait_us.compare_exchange_weak(max_wait, waited)) {
+        // Retry until the maximum has been updated or a longer wait has been recorded
+    }
+
+    idle_connection idle { nullptr, start };
+
+    if (!this->idle_connections.empty()) {
+        idle = std::move(this->idle_connections.back());
+        this->idle_connections.pop_back();
+    } else {
+        // Reserve the slot before connecting so other threads respect the pool size while we are handshaking
+        this->open_connections++;
+    }
+
+    lock.unlock();
+
+    if (idle.handle != nullptr) {
+        if (std::chrono::steady_clock::now() - idle.last_used < validation_interval || idle.handle->is_valid())
+            return connection(this, std::move(idle.handle));
+
+        LOG_F(WARNING, "Discarding broken pooled MySQL connection.");
+
+        this->discarded++;
+        idle.handle.reset();
+    }
+
+    try {
+        return connection(this, this->open());
+    } catch (...) {
+        lock.lock();
+        this->open_connections--;
+        lock.unlock();
+
+        this->pool_condition.notify_one();
+        throw;
+    }
+}
+
+std::unique_ptr<sqlpp::mysql::connection> shiro::database::open() {
+    auto handle = std::make_unique<sqlpp::mysql::connection>(this->config);
+    this->created++;
+
+    return handle;
+}
+
+void shiro::database::release(std::unique_ptr<sqlpp::mysql::connection> handle) {
+    {
+        std::lock_guard<std::mutex> lock(this->pool_mutex);
+        this->idle_connections.push_back({ std::move(handle), std::chrono::steady_clock::now() });
+    }
+
+    this->pool_condition.notify_one();
+}
+
+void shiro::database::reap() {
+    std::vector<idle_connection> expired;
+    auto now = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(this->pool_mutex);
+
+        auto iterator = std::find_if(this->idle_connections.begin(), this->idle_connections.end(), [&](const idle_connection &idle) {
+            return now - idle.last_used < this->idle_timeout;
+        });
+
+        std::move(this->idle_connections.begin(), iterator, std::back_inserter(expired));
+        this->idle_connections.erase(this->idle_connections.begin(), iterator);
+        this->open_connections -= expired.size();
+    }
+
+    if (expired.empty())
+        return;
+
+    size_t count = expired.size();
+
+    // Connections are closed outside of the lock so a slow server does not stall other queries
+    this->discarded += count;
+    expired.clear();
+
+    this->pool_condition.notify_all();
+
+    LOG_F(INFO, "Closed %lu idle MySQL connections.", static_cast<unsigned long>(count));
+}
+
+shiro::database::statistics shiro::database::get_statistics() {
+    statistics stats;
+
+    {
+        std::lock_guard<std::mutex> lock(this->pool_mutex);
+
+        stats.open = this->open_connections;
+        stats.idle = this->idle_connections.size();
+        stats.in_use = this->open_connections - this->idle_connections.size();
+        stats.waiting = this->waiting_threads;
+    }
+
+    stats.acquired = this->acquired;
+    stats.created = this->created;
+    stats.discarded = this->discarded;
+    stats.timeouts = this->timeouts;
+    stats.total_wait_time = std::chrono::microseconds(this->total_wait_us.load());
+    stats.max_wait_time = std::chrono::microseconds(this->max_wait_us.load());
+
+    return stats;
+}
@@ -22,13 +22,69 @@
 #include <sqlpp11/mysql/mysql.h>
 #include <sqlpp11/sqlpp11.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace shiro {
 
     class database {
+    public:
+        // RAII handle to a pooled connection, returns the connection to the pool once it goes out of scope.
+        // Nested leases on the same thread share the outer connection instead of taking another one from the pool.
+        class connection {
+        private:
+            database *pool = nullptr;
+            std::unique_ptr<sqlpp::mysql::connection> handle = nullptr;
+            sqlpp::mysql::connection *instance = nullptr;
+
+        public:
+            connection(database *pool, std::unique_ptr<sqlpp::mysql::connection> handle);
+            explicit connection(sqlpp::mysql::connection *borrowed);
+            connection(connection &&other) noexcept;
+            ~connection();
+
+            connection(const connection&) = delete;
+            connection &operator=(const connection&) = delete;
+            connection &operator=(connection&&) = delete;
+
+            template <typename T>
+            auto operator()(const T &statement) {
+                return (*this->instance)(statement);
+            }
+
+            sqlpp::mysql::connection &operator*();
+            sqlpp::mysql::connection *operator->();
+
+        };
+
+        struct statistics {
+            size_t open = 0;
+            size_t idle = 0;
+            size_t in_use = 0;
+            size_t waiting = 0;
+
+            uint64_t acquired = 0;
+            uint64_t created = 0;
+            uint64_t discarded = 0;
+            uint64_t timeouts = 0;
+
+            // Accumulated and worst time spent waiting for a free connection
+            std::chrono::microseconds total_wait_time { 0 };
+            std::chrono::microseconds max_wait_time { 0 };
+        };
+
     private:
+        struct idle_connection {
+            std::unique_ptr<sqlpp::mysql::connection> handle;
+            std::chrono::steady_clock::time_point last_used;
+        };
+
         std::shared_ptr<sqlpp::mysql::connection_config> config = nullptr;
 
         std::string address;
@@ -38,6 +94,28 @@ namespace shiro {
         std::string username;
         std::string password;
 
+        std::mutex pool_mutex;
+        std::condition_variable pool_condition;
+
+        // Most recently used connection is at the back, reaping starts at the front
+        std::vector<idle_connection> idle_connections;
+        size_t open_connections = 0;
+        size_t waiting_threads = 0;
+
+        size_t pool_size;
+        std::chrono::seconds idle_timeout;
+        std::chrono::seconds wait_timeout;
+
+        std::atomic<uint64_t> acquired { 0 };
+        std::atomic<uint64_t> created { 0 };
+        std::atomic<uint64_t> discarded { 0 };
+        std::atomic<uint64_t> timeouts { 0 };
+        std::atomic<uint64_t> total_wait_us { 0 };
+        std::atomic<uint64_t> max_wait_us { 0 };
+
+        std::unique_ptr<sqlpp::mysql::connection> open();
+        void release(std::unique_ptr<sqlpp::mysql::connection> handle);
+
     public:
         database(const std::string &address, uint32_t port, const std::string &db, const std::string &username, const std::string &password);
 
@@ -47,6 +125,14 @@ namespace shiro {
         bool is_connected(bool abort = false);
         std::shared_ptr<sqlpp::mysql::connection_config> get_config();
 
+        // Blocks until a connection is available, throws sqlpp::exception after the configured wait timeout
+        connection get_connection();
+
+        // Closes connections that have been idle for longer than the idle timeout
+        void reap();
+
+        statistics get_statistics();
+
     };
 
 }
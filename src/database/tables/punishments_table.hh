@@ -21,9 +21,12 @@
 
 #include <sqlpp11/char_sequence.h>
 #include <sqlpp11/column_types.h>
+#include <sqlpp11/exception.h>
 #include <sqlpp11/mysql/connection.h>
 #include <sqlpp11/table.h>
+#include <string>
 
+#include "../../thirdparty/loguru.hh"
 #include "common_tables.hh"
 
 namespace shiro::tables {
@@ -52,6 +55,20 @@ namespace shiro::tables {
 
     namespace migrations::punishments {
 
+        inline void add_index(sqlpp::mysql::connection &db, const std::string &definition) {
+            try {
+                db.execute("ALTER TABLE `punishments` ADD " + definition + ";");
+
+                LOG_F(INFO, "Added %s to punishments table.", definition.c_str());
+            } catch (const sqlpp::exception &ex) {
+                // Index has already been added on a previous start
+                if (std::string(ex.what()).find("Duplicate key name") != std::string::npos)
+                    return;
+
+                LOG_F(WARNING, "Unable to add %s to punishments table: %s", definition.c_str(), ex.what());
+            }
+        }
+
         inline void create(sqlpp::mysql::connection &db) {
             db.execute(
                     "CREATE TABLE IF NOT EXISTS `punishments` "
@@ -59,6 +76,9 @@ namespace shiro::tables {
                     "type TINYINT UNSIGNED NOT NULL, time INT NOT NULL, duration INT DEFAULT NULL, "
                     "active BOOLEAN NOT NULL, reason VARCHAR(128) DEFAULT NULL);"
             );
+
+            // Lets the periodic check for outside changes count active punishments without reading the table
+            add_index(db, "INDEX punishments_active (active)");
         }
 
     }
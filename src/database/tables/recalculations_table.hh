@@ -0,0 +1,59 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_RECALCULATIONS_TABLE_HH
+#define SHIRO_RECALCULATIONS_TABLE_HH
+
+#include <sqlpp11/char_sequence.h>
+#include <sqlpp11/column_types.h>
+#include <sqlpp11/mysql/connection.h>
+#include <sqlpp11/table.h>
+
+#include "common_tables.hh"
+
+namespace shiro::tables {
+
+    struct recalculations_objects {
+        object_struct(play_mode, sqlpp::tinyint_unsigned);
+        object_struct(phase, sqlpp::tinyint_unsigned);
+        object_struct(checkpoint, sqlpp::integer);
+        object_struct(started, sqlpp::integer);
+    };
+
+    database_table(recalculations,
+            recalculations_objects::play_mode,
+            recalculations_objects::phase,
+            recalculations_objects::checkpoint,
+            recalculations_objects::started
+    );
+
+    namespace migrations::recalculations {
+
+        inline void create(sqlpp::mysql::connection &db) {
+            db.execute(
+                    "CREATE TABLE IF NOT EXISTS `recalculations` "
+                    "(play_mode TINYINT UNSIGNED PRIMARY KEY NOT NULL, phase TINYINT UNSIGNED NOT NULL, "
+                    "checkpoint INT NOT NULL, started INT NOT NULL);"
+            );
+        }
+
+    }
+
+}
+
+#endif  // SHIRO_RECALCULATIONS_TABLE_HH
@@ -21,9 +21,12 @@
 
 #include <sqlpp11/char_sequence.h>
 #include <sqlpp11/column_types.h>
+#include <sqlpp11/exception.h>
 #include <sqlpp11/mysql/connection.h>
 #include <sqlpp11/table.h>
+#include <string>
 
+#include "../../thirdparty/loguru.hh"
 #include "common_tables.hh"
 
 namespace shiro::tables {
@@ -78,6 +81,20 @@ namespace shiro::tables {
 
     namespace migrations::scores {
 
+        inline void add_index(sqlpp::mysql::connection &db, const std::string &definition) {
+            try {
+                db.execute("ALTER TABLE `scores` ADD " + definition + ";");
+
+                LOG_F(INFO, "Added %s to scores table.", definition.c_str());
+            } catch (const sqlpp::exception &ex) {
+                // Index has already been added on a previous start
+                if (std::string(ex.what()).find("Duplicate key name") != std::string::npos)
+                    return;
+
+                LOG_F(WARNING, "Unable to add %s to scores table: %s", definition.c_str(), ex.what());
+            }
+        }
+
         inline void create(sqlpp::mysql::connection &db) {
             db.execute(
                     "CREATE TABLE IF NOT EXISTS `scores` "
@@ -89,6 +106,11 @@ namespace shiro::tables {
                     "time INT NOT NULL, play_mode TINYINT NOT NULL, passed BOOLEAN NOT NULL, "
                     "accuracy FLOAT NOT NULL, pp FLOAT NOT NULL, times_watched INT NOT NULL DEFAULT 0);"
             );
+
+            // Indexes are added separately so existing deployments receive them on their next start
+            add_index(db, "UNIQUE INDEX scores_hash (hash)");
+            add_index(db, "INDEX scores_leaderboard (beatmap_md5, play_mode, passed, score)");
+            add_index(db, "INDEX scores_user_pp (user_id, play_mode, pp)");
         }
 
     }
@@ -22,7 +22,7 @@
 void shiro::handler::friends::add::handle(shiro::io::osu_packet &in, shiro::io::osu_writer &out, std::shared_ptr<shiro::users::user> user) {
     int32_t target = in.data.read<int32_t>();
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::relationships relationships_table {};
 
     db(insert_into(relationships_table).set(
@@ -35,6 +35,7 @@
 #include "../users/user.hh"
 #include "../users/user_manager.hh"
 #include "../users/user_punishments.hh"
+#include "../users/user_timeout.hh"
 #include "../utils/bot_utils.hh"
 #include "../utils/login_responses.hh"
 #include "../utils/osu_client.hh"
@@ -203,6 +204,7 @@ void shiro::handler::login::handle(const crow::request &request, crow::response
     user->presence.time_zone = time_zone;
 
     users::manager::login_user(user);
+    users::timeout::watch(user);
 
     response.set_header("cho-token", user->token);
 
@@ -252,21 +254,24 @@ void shiro::handler::login::handle(const crow::request &request, crow::response
         );
     }
 
-    users::manager::iterate([user, &writer, &global_writer](std::shared_ptr<users::user> online_user) {
+    users::manager::iterate([user, &writer](std::shared_ptr<users::user> online_user) {
         if (online_user == user)
             return;
 
         writer.user_presence(online_user->presence);
         writer.user_stats(online_user->stats);
-
-        if (!user->hidden)
-            online_user->queue.enqueue(global_writer);
     }, true);
 
+    if (!user->hidden) {
+        users::manager::broadcast(global_writer, true, false, [user](std::shared_ptr<users::user> online_user) {
+            return online_user != user;
+        });
+    }
+
     std::string result = writer.serialize();
 
     if (!user->queue.is_empty())
-        result.append(user->queue.serialize());
+        user->queue.serialize(result);
 
     response.end(result);
 }
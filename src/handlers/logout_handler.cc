@@ -38,10 +38,7 @@ void shiro::handler::logout::handle(shiro::io::osu_packet &in, shiro::io::osu_wr
 
     writer.user_quit(quit);
 
-    users::manager::iterate([user, &writer](std::shared_ptr<users::user> online_user) {
-        if (online_user->user_id == user->user_id)
-            return;
-
-        online_user->queue.enqueue(writer);
-    }, true);
+    users::manager::broadcast(writer, true, false, [user](std::shared_ptr<users::user> online_user) {
+        return online_user->user_id != user->user_id;
+    });
 }
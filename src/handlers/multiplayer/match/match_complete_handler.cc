@@ -47,6 +47,8 @@ void shiro::handler::multiplayer::match::complete::handle(shiro::io::osu_packet
         io::osu_writer writer;
         writer.match_complete();
 
+        io::packet_chunk chunk = io::make_chunk(writer);
+
         for (size_t i = 0; i < match.multi_slot_id.size(); i++) {
             if (match.multi_slot_status.at(i) != (uint8_t) utils::slot_status::playing)
                 continue;
@@ -58,7 +60,7 @@ void shiro::handler::multiplayer::match::complete::handle(shiro::io::osu_packet
             if (lobby_user == nullptr)
                 continue;
 
-            lobby_user->queue.enqueue(writer);
+            lobby_user->queue.enqueue(chunk);
         }
 
         match.send_update(true);
@@ -45,6 +45,8 @@ void shiro::handler::multiplayer::match::load::handle(shiro::io::osu_packet &in,
         io::osu_writer writer;
         writer.match_all_players_loaded();
 
+        io::packet_chunk chunk = io::make_chunk(writer);
+
         for (size_t i = 0; i < match.multi_slot_id.size(); i++) {
             if (match.multi_slot_status.at(i) != (uint8_t) utils::slot_status::playing)
                 continue;
@@ -54,7 +56,7 @@ void shiro::handler::multiplayer::match::load::handle(shiro::io::osu_packet &in,
             if (lobby_user == nullptr)
                 continue;
 
-            lobby_user->queue.enqueue(writer);
+            lobby_user->queue.enqueue(chunk);
         }
 
         return true;
@@ -34,6 +34,8 @@ void shiro::handler::multiplayer::match::score_update::handle(shiro::io::osu_pac
         score_frame.id = std::distance(match.multi_slot_id.begin(), iterator);
         writer.match_score_update(score_frame);
 
+        io::packet_chunk chunk = io::make_chunk(writer);
+
         for (size_t i = 0; i < match.multi_slot_id.size(); i++) {
             if (match.multi_slot_status.at(i) != (uint8_t) utils::slot_status::playing)
                 continue;
@@ -43,7 +45,7 @@ void shiro::handler::multiplayer::match::score_update::handle(shiro::io::osu_pac
             if (lobby_user == nullptr)
                 continue;
 
-            lobby_user->queue.enqueue(writer);
+            lobby_user->queue.enqueue(chunk);
         }
 
         return true;
@@ -36,6 +36,8 @@ void shiro::handler::multiplayer::match::start::handle(shiro::io::osu_packet &in
 
         match.in_progress = true;
 
+        io::packet_chunk chunk = io::make_chunk(writer);
+
         for (size_t i = 0; i < match.multi_slot_id.size(); i++) {
             if (match.multi_slot_id.at(i) == -1)
                 continue;
@@ -47,7 +49,7 @@ void shiro::handler::multiplayer::match::start::handle(shiro::io::osu_packet &in
             if (lobby_user == nullptr)
                 continue;
 
-            lobby_user->queue.enqueue(writer);
+            lobby_user->queue.enqueue(chunk);
         }
 
         match.send_update(true);
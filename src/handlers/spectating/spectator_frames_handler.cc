@@ -33,7 +33,9 @@ void shiro::handler::spectating::frames::handle(shiro::io::osu_packet &in, shiro
     io::osu_writer writer;
     writer.spectate_frames(frames);
 
+    io::packet_chunk chunk = io::make_chunk(writer);
+
     for (const std::shared_ptr<users::user> &spectator : spectators) {
-        spectator->queue.enqueue(writer);
+        spectator->queue.enqueue(chunk);
     }
 }
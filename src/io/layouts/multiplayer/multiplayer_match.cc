@@ -25,6 +25,8 @@ void shiro::io::layouts::multiplayer_match::send_update(bool global) {
     io::osu_writer writer;
     writer.match_update(*this);
 
+    io::packet_chunk chunk = io::make_chunk(writer);
+
     for (int32_t id : this->multi_slot_id) {
         if (id == -1)
             continue;
@@ -34,7 +36,7 @@ void shiro::io::layouts::multiplayer_match::send_update(bool global) {
         if (user == nullptr)
             continue;
 
-        user->queue.enqueue(writer);
+        user->queue.enqueue(chunk);
     }
 
     if (!global)
@@ -43,13 +45,15 @@ void shiro::io::layouts::multiplayer_match::send_update(bool global) {
     io::osu_writer global_writer;
     global_writer.match_update(*this, true);
 
-    multiplayer::lobby_manager::iterate([this, &global_writer](std::shared_ptr<users::user> user) {
+    io::packet_chunk global_chunk = io::make_chunk(global_writer);
+
+    multiplayer::lobby_manager::iterate([this, &global_chunk](std::shared_ptr<users::user> user) {
         auto iterator = std::find(this->multi_slot_id.begin(), this->multi_slot_id.end(), user->user_id);
 
         if (iterator != this->multi_slot_id.end())
             return;
 
-        user->queue.enqueue(global_writer);
+        user->queue.enqueue(global_chunk);
     });
 }
 
@@ -25,15 +25,12 @@ shiro::io::buffer shiro::io::layouts::spectate_frames::marshal() {
 
     buf.write<int16_t>(this->replay_frames.size());
 
-    for (replay_frame frame : this->replay_frames) {
-        buffer replay_frame_buf = frame.marshal();
-        buf.append(replay_frame_buf);
+    for (replay_frame &frame : this->replay_frames) {
+        buf.append(frame.marshal());
     }
 
     buf.write<uint8_t>(this->action);
-
-    buffer score_frame_buf = this->score_frame.marshal();
-    buf.append(score_frame_buf);
+    buf.append(this->score_frame.marshal());
 
     return buf;
 }
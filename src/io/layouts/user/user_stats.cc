@@ -21,17 +21,16 @@
 #include <limits>
 
 #include "../../../pp/pp_recalculator.hh"
-#include "../../../scores/score.hh"
-#include "../../../scores/score_helper.hh"
+#include "../../../scores/top_plays.hh"
 #include "../../../utils/osu_string.hh"
 #include "../../../utils/play_mode.hh"
 #include "user_stats.hh"
 
 void shiro::io::layouts::user_stats::recalculate_accuracy() {
-    std::vector<scores::score> scores = scores::helper::fetch_top100_user((utils::play_mode) this->play_mode, this->user_id);
+    std::vector<scores::top_plays::play> scores = scores::top_plays::get((utils::play_mode) this->play_mode, this->user_id);
     float accuracy = 0.0f;
 
-    for (const scores::score &score : scores) {
+    for (const scores::top_plays::play &score : scores) {
         accuracy += score.accuracy;
     }
 
@@ -43,11 +42,11 @@ void shiro::io::layouts::user_stats::recalculate_pp() {
     if (pp::recalculator::in_progess())
         return;
 
-    std::vector<scores::score> scores = scores::helper::fetch_top100_user((utils::play_mode) this->play_mode, this->user_id);
+    std::vector<scores::top_plays::play> scores = scores::top_plays::get((utils::play_mode) this->play_mode, this->user_id);
     float pp = 0; // Here it is a float to keep decimal points, round it when setting final pp value
 
     for (size_t i = 0; i < scores.size(); i++) {
-        scores::score score = scores.at(i);
+        const scores::top_plays::play &score = scores.at(i);
 
         pp += (score.pp * std::pow(0.95, i));
     }
@@ -16,46 +16,35 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include "osu_buffer.hh"
 
-void shiro::io::buffer::allocate(size_t amount) {
-    for (size_t i = 0; i < amount; i++) {
-        this->bytes.emplace_back((uint8_t) 0x0);
-    }
+shiro::io::buffer::buffer(std::string data)
+    : bytes(std::move(data)) {
+    // Initialized in initializer list
 }
 
-void shiro::io::buffer::append(std::string data) {
-    for (const char &c : data) {
-        this->write<uint8_t>(c);
-    }
+void shiro::io::buffer::reserve(size_t amount) {
+    this->bytes.reserve(this->bytes.size() + amount);
 }
 
-void shiro::io::buffer::append(buffer &buf) {
-    this->append(buf.serialize());
+void shiro::io::buffer::append(std::string_view data) {
+    this->bytes.append(data.data(), data.size());
 }
 
-shiro::io::buffer::buffer(const buffer &buf) {
-    for (uint8_t byte : buf.bytes) {
-        this->write<uint8_t>(byte);
-    }
+void shiro::io::buffer::append(const buffer &buf) {
+    this->bytes.append(buf.bytes);
 }
 
-shiro::io::buffer::buffer(std::string data) {
-    for (const char &c : data) {
-        this->write<uint8_t>(c);
-    }
-}
-
-void shiro::io::buffer::write_string(std::string data) {
+void shiro::io::buffer::write_string(std::string_view data) {
     this->append(data);
 }
 
-void shiro::io::buffer::write_array(std::vector<int32_t> data) {
+void shiro::io::buffer::write_array(const std::vector<int32_t> &data) {
     this->write<int16_t>(data.size());
 
-    for (int32_t item : data) {
-        this->write<int32_t>(item);
-    }
+    this->bytes.append(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(int32_t));
 }
 
 std::string shiro::io::buffer::read_string() {
@@ -63,7 +52,6 @@ std::string shiro::io::buffer::read_string() {
         int32_t total = 0;
         int32_t shift = 0;
 
-        std::string result;
         uint8_t byte = this->read<uint8_t>();
 
         if ((byte & 0x80) == 0) {
@@ -84,42 +72,55 @@ std::string shiro::io::buffer::read_string() {
             } while (!end);
         }
 
-        for (int32_t i = 0; i < total; i++) {
-            result += this->read<uint8_t>();
-        }
-
-        return result;
+        return std::string(this->read_view(total));
     }
 
     return "";
 }
 
 std::vector<int32_t> shiro::io::buffer::read_array() {
-    std::vector<int32_t> result;
     uint16_t size = this->read<uint16_t>();
+    std::string_view data = this->read_view(size * sizeof(int32_t));
 
-    for (uint16_t i = 0; i < size; i++) {
-        result.emplace_back(this->read<int32_t>());
-    }
+    std::vector<int32_t> result(data.size() / sizeof(int32_t));
+    std::memcpy(result.data(), data.data(), result.size() * sizeof(int32_t));
 
     return result;
 }
 
-std::string shiro::io::buffer::serialize() {
-    return std::string(this->bytes.begin(), this->bytes.end());
+std::string_view shiro::io::buffer::read_view(size_t amount) {
+    size_t available = this->position < this->bytes.size() ? this->bytes.size() - this->position : 0;
+    std::string_view result(this->bytes.data() + std::min(this->position, this->bytes.size()), std::min(amount, available));
+
+    this->position += amount;
+    return result;
+}
+
+std::string_view shiro::io::buffer::view() const {
+    return this->bytes;
+}
+
+std::string shiro::io::buffer::serialize() const {
+    return this->bytes;
+}
+
+std::string shiro::io::buffer::release() {
+    std::string result = std::move(this->bytes);
+    this->clear();
+
+    return result;
 }
 
-bool shiro::io::buffer::can_read(size_t amount) {
-    return amount <= this->written_size - this->position;
+bool shiro::io::buffer::can_read(size_t amount) const {
+    return this->position <= this->bytes.size() && amount <= this->bytes.size() - this->position;
 }
 
-bool shiro::io::buffer::is_empty() {
-    return this->written_size == 0;
+bool shiro::io::buffer::is_empty() const {
+    return this->bytes.empty();
 }
 
 void shiro::io::buffer::clear() {
     this->bytes.clear();
-    this->written_size = 0;
     this->position = 0;
 }
 
@@ -131,6 +132,6 @@ void shiro::io::buffer::advance(size_t amount) {
     this->position += amount;
 }
 
-size_t shiro::io::buffer::get_size() {
-    return this->written_size;
+size_t shiro::io::buffer::get_size() const {
+    return this->bytes.size();
 }
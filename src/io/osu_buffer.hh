@@ -20,62 +20,74 @@
 #define SHIRO_OSU_BUFFER_HH
 
 #include <cstdint>
-#include <sstream>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace shiro::io {
 
     class buffer {
     private:
-        std::vector<uint8_t> bytes;
+        // Written bytes are kept in one contiguous string so they can be handed out without copying
+        std::string bytes;
 
-        size_t written_size = 0;
         size_t position = 0;
 
-        void allocate(size_t amount);
-
     public:
         buffer() = default;
-        buffer(const buffer &buf);
+        buffer(const buffer &buf) = default;
+        buffer(buffer &&buf) noexcept = default;
         explicit buffer(std::string data);
 
-        void append(std::string data);
-        void append(buffer &buf);
+        buffer &operator=(const buffer &buf) = default;
+        buffer &operator=(buffer &&buf) noexcept = default;
+
+        void reserve(size_t amount);
+
+        void append(std::string_view data);
+        void append(const buffer &buf);
 
         template <typename t = uint8_t>
         void write(t data) {
-            this->allocate(sizeof(t));
-            uint8_t *data_arr = reinterpret_cast<uint8_t*>(&data);
-
-            for (size_t i = 0; i < sizeof(t); i++)
-                this->bytes.at(this->written_size++) = data_arr[i];
+            this->bytes.append(reinterpret_cast<const char*>(&data), sizeof(t));
         }
 
         template <typename t = uint8_t>
         t read() {
-            t data = *reinterpret_cast<t*>((uintptr_t)this->bytes.data() + this->position);
-            this->position += sizeof(t);
+            t data {};
 
+            if (this->can_read(sizeof(t)))
+                std::memcpy(&data, this->bytes.data() + this->position, sizeof(t));
+
+            this->position += sizeof(t);
             return data;
         }
 
-        void write_string(std::string data);
-        void write_array(std::vector<int32_t> data);
+        void write_string(std::string_view data);
+        void write_array(const std::vector<int32_t> &data);
 
         std::string read_string();
         std::vector<int32_t> read_array();
 
-        std::string serialize();
+        // Returns a view into the buffer and advances past it, valid until the buffer is modified
+        std::string_view read_view(size_t amount);
+
+        std::string_view view() const;
+
+        std::string serialize() const;
+
+        // Moves the written bytes out of the buffer, leaving it empty
+        std::string release();
 
-        bool can_read(size_t amount);
-        bool is_empty();
+        bool can_read(size_t amount) const;
+        bool is_empty() const;
 
         void clear();
         void seek(size_t position);
         void advance(size_t amount);
 
-        size_t get_size();
+        size_t get_size() const;
 
     };
 
@@ -192,7 +192,7 @@ void shiro::io::osu_writer::match_change_password(std::string password) {
 }
 
 std::string shiro::io::osu_writer::serialize() {
-    return this->buf.serialize();
+    return this->buf.release();
 }
 
 shiro::io::buffer &shiro::io::osu_writer::get_buffer() {
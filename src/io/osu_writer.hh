@@ -45,17 +45,15 @@ namespace shiro::io {
 
         template <typename t = serializable>
         void write(packet_id id, t data) {
-            buf.write<int16_t>((int16_t) id);
-            buf.write<uint8_t>(0);
-            buf.write<int32_t>(data.get_size());
-            buf.append(data.marshal().serialize());
+            this->write(id, data.marshal());
         }
 
-        void write(packet_id id, buffer &buf) {
+        void write(packet_id id, const buffer &data) {
+            buf.reserve(7 + data.get_size());
             buf.write<int16_t>((int16_t) id);
             buf.write<uint8_t>(0);
-            buf.write<int32_t>(buf.get_size());
-            buf.append(buf);
+            buf.write<int32_t>((int32_t) data.get_size());
+            buf.append(data);
         }
 
     public:
@@ -117,6 +115,7 @@ namespace shiro::io {
         void match_player_skipped(int32_t slot_id);
         void match_change_password(std::string password);
 
+        // Moves the written packets out of the writer, leaving it empty
         std::string serialize();
         buffer &get_buffer();
 
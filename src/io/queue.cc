@@ -16,39 +16,117 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include "queue.hh"
 
+shiro::io::packet_chunk shiro::io::make_chunk(shiro::io::osu_writer &writer) {
+    return std::make_shared<const std::string>(writer.get_buffer().view());
+}
+
+shiro::io::packet_chunk shiro::io::make_chunk(shiro::io::buffer &buffer) {
+    return std::make_shared<const std::string>(buffer.view());
+}
+
+shiro::io::queue::~queue() {
+    take(this->packet_queue);
+    take(this->next_queue);
+}
+
+void shiro::io::queue::push(std::atomic<node*> &head, packet_chunk chunk) {
+    if (chunk == nullptr || chunk->empty())
+        return;
+
+    node *entry = new node { std::move(chunk), head.load(std::memory_order_relaxed) };
+
+    while (!head.compare_exchange_weak(entry->next, entry, std::memory_order_release, std::memory_order_relaxed)) {
+        // entry->next has been updated to the current head, try again
+    }
+}
+
+std::vector<shiro::io::packet_chunk> shiro::io::queue::take(std::atomic<node*> &head) {
+    node *entry = head.exchange(nullptr, std::memory_order_acquire);
+    std::vector<packet_chunk> result;
+
+    while (entry != nullptr) {
+        node *next = entry->next;
+
+        result.emplace_back(std::move(entry->chunk));
+        delete entry;
+
+        entry = next;
+    }
+
+    // The stack hands out the most recent chunk first
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+void shiro::io::queue::promote_next() {
+    for (packet_chunk &chunk : take(this->next_queue)) {
+        push(this->packet_queue, std::move(chunk));
+    }
+}
+
 void shiro::io::queue::enqueue(shiro::io::osu_writer &writer) {
-    buffer buf = writer.get_buffer();
-    this->packet_queue.append(buf);
+    push(this->packet_queue, make_chunk(writer));
 }
 
 void shiro::io::queue::enqueue(shiro::io::buffer &buffer) {
-    this->packet_queue.append(buffer);
+    push(this->packet_queue, make_chunk(buffer));
+}
+
+void shiro::io::queue::enqueue(shiro::io::packet_chunk chunk) {
+    push(this->packet_queue, std::move(chunk));
 }
 
 void shiro::io::queue::enqueue_next(shiro::io::osu_writer &writer) {
-    buffer buf = writer.get_buffer();
-    this->next_queue.append(buf);
+    push(this->next_queue, make_chunk(writer));
 }
 
 void shiro::io::queue::enqueue_next(shiro::io::buffer &buffer) {
-    this->next_queue.append(buffer);
+    push(this->next_queue, make_chunk(buffer));
+}
+
+void shiro::io::queue::enqueue_next(shiro::io::packet_chunk chunk) {
+    push(this->next_queue, std::move(chunk));
 }
 
 void shiro::io::queue::clear() {
-    this->packet_queue.clear();
-    this->packet_queue.append(this->next_queue);
-    this->next_queue.clear();
+    take(this->packet_queue);
+    this->promote_next();
 }
 
 bool shiro::io::queue::is_empty() {
-    return this->packet_queue.is_empty();
+    return this->packet_queue.load(std::memory_order_acquire) == nullptr;
+}
+
+std::vector<shiro::io::packet_chunk> shiro::io::queue::drain() {
+    std::vector<packet_chunk> chunks = take(this->packet_queue);
+    this->promote_next();
+
+    return chunks;
 }
 
 std::string shiro::io::queue::serialize() {
-    std::string result = this->packet_queue.serialize();
-    this->packet_queue.clear();
+    std::string result;
+    this->serialize(result);
 
     return result;
 }
+
+void shiro::io::queue::serialize(std::string &target) {
+    std::vector<packet_chunk> chunks = this->drain();
+    size_t size = target.size();
+
+    for (const packet_chunk &chunk : chunks) {
+        size += chunk->size();
+    }
+
+    // Gather all chunks into the response with a single allocation
+    target.reserve(size);
+
+    for (const packet_chunk &chunk : chunks) {
+        target.append(*chunk);
+    }
+}
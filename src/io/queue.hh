@@ -19,34 +19,67 @@
 #ifndef SHIRO_QUEUE_HH
 #define SHIRO_QUEUE_HH
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "osu_buffer.hh"
 #include "osu_writer.hh"
 
 namespace shiro::io {
 
+    // Serialized packets are immutable once enqueued and shared between every queue they are put in
+    using packet_chunk = std::shared_ptr<const std::string>;
+
+    packet_chunk make_chunk(osu_writer &writer);
+    packet_chunk make_chunk(buffer &buffer);
+
+    // Lock-free multi-producer, single-consumer packet queue. Any thread may enqueue
+    // packets, the owning user's poll drains them all at once.
     class queue {
     private:
-        io::buffer packet_queue;
-        io::buffer next_queue;
+        struct node {
+            packet_chunk chunk;
+            node *next = nullptr;
+        };
+
+        std::atomic<node*> packet_queue { nullptr };
+        std::atomic<node*> next_queue { nullptr };
+
+        static void push(std::atomic<node*> &head, packet_chunk chunk);
+
+        // Detaches every node from the stack and returns them in the order they were pushed
+        static std::vector<packet_chunk> take(std::atomic<node*> &head);
+
+        void promote_next();
 
     public:
         queue() = default;
+        ~queue();
+
+        queue(const queue&) = delete;
+        queue &operator=(const queue&) = delete;
 
         void enqueue(osu_writer &writer);
         void enqueue(buffer &buffer);
+        void enqueue(packet_chunk chunk);
 
         // These methods enqueue the corresponding writer / buffer to be put into the queue
         // as soon as the current packet queue has been sent to the user.
         void enqueue_next(osu_writer &writer);
         void enqueue_next(buffer &buffer);
+        void enqueue_next(packet_chunk chunk);
 
         void clear();
         bool is_empty();
 
-        // This function additionally clears the queue
+        // Drains all pending chunks in enqueue order, use this when the chunks can be sent as-is
+        std::vector<packet_chunk> drain();
+
+        // These functions additionally clear the queue
         std::string serialize();
+        void serialize(std::string &target);
 
     };
 
@@ -53,12 +53,14 @@ void shiro::multiplayer::match_manager::create_match(shiro::io::layouts::multipl
     io::osu_writer global_writer;
     global_writer.match_new(match, true);
 
-    lobby_manager::iterate([match, &global_writer](std::shared_ptr<users::user> user) {
+    io::packet_chunk global_chunk = io::make_chunk(global_writer);
+
+    lobby_manager::iterate([match, &global_chunk](std::shared_ptr<users::user> user) {
         // The host literally created this and does implicitly know about this match already
         if (user->user_id == match.host_id)
             return;
 
-        user->queue.enqueue(global_writer);
+        user->queue.enqueue(global_chunk);
     });
 
     std::shared_ptr<users::user> host = users::manager::get_user_by_id(match.host_id);
@@ -201,8 +203,10 @@ bool shiro::multiplayer::match_manager::leave_match(std::shared_ptr<shiro::users
         io::osu_writer writer;
         writer.match_disband(match_id);
 
-        lobby_manager::iterate([match, &writer](std::shared_ptr<users::user> user) {
-            user->queue.enqueue(writer);
+        io::packet_chunk chunk = io::make_chunk(writer);
+
+        lobby_manager::iterate([&chunk](std::shared_ptr<users::user> user) {
+            user->queue.enqueue(chunk);
         });
 
         return true;
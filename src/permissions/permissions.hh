@@ -39,7 +39,8 @@ namespace shiro::permissions {
         cmd_restrict = 1LL << 38,
         cmd_silence = 1LL << 39,
         cmd_recalculate = 1LL << 40,
-        cmd_restart = 1LL << 41
+        cmd_restart = 1LL << 41,
+        cmd_stats = 1LL << 42
     };
 
 }
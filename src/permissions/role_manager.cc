@@ -26,7 +26,7 @@
 std::vector<shiro::permissions::role> shiro::roles::manager::roles;
 
 void shiro::roles::manager::init() {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::roles roles_table {};
 
     auto result = db(select(all_of(roles_table)).from(roles_table).unconditionally());
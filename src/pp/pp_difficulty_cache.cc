@@ -0,0 +1,129 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "../config/score_submission_file.hh"
+#include "../thirdparty/loguru.hh"
+#include "pp_difficulty_cache.hh"
+
+namespace shiro::pp::difficulty_cache {
+
+    struct cached_difficulty {
+        oppai_difficulty value;
+        std::list<uint64_t>::iterator usage;
+    };
+
+    // Rough estimate of one entry, unordered_map and list nodes are counted as value plus two pointers
+    constexpr size_t entry_size = sizeof(std::pair<const uint64_t, cached_difficulty>) + sizeof(uint64_t) + 4 * sizeof(void*);
+
+    static std::unordered_map<uint64_t, cached_difficulty> difficulties;
+    static std::list<uint64_t> usage; // Most recently used difficulty is at the front
+    static std::mutex mutex;
+
+    static size_t max_entries = 0;
+
+    static std::atomic<uint64_t> hits { 0 };
+    static std::atomic<uint64_t> misses { 0 };
+    static std::atomic<uint64_t> evictions { 0 };
+
+    static uint64_t make_key(int32_t beatmap_id, uint8_t mode, int32_t mods);
+
+}
+
+void shiro::pp::difficulty_cache::init() {
+    size_t memory_budget = (size_t) config::score_submission::difficulty_cache_size * 1024 * 1024;
+    max_entries = memory_budget / entry_size;
+
+    if (max_entries == 0)
+        LOG_F(INFO, "Beatmap difficulty caching is disabled.");
+}
+
+std::optional<shiro::pp::oppai_difficulty> shiro::pp::difficulty_cache::fetch(const shiro::beatmaps::beatmap &beatmap, uint8_t mode, int32_t mods) {
+    // .osu files are never replaced once downloaded, so the beatmap id identifies the parsed beatmap
+    uint64_t key = make_key(beatmap.beatmap_id, mode, oppai_wrapper::get_difficulty_mods(mods));
+
+    if (max_entries > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iterator = difficulties.find(key);
+
+        if (iterator != difficulties.end()) {
+            usage.splice(usage.begin(), usage, iterator->second.usage);
+            hits++;
+
+            return iterator->second.value;
+        }
+    }
+
+    misses++;
+
+    std::optional<oppai_difficulty> result = oppai_wrapper::calculate_difficulty(beatmap, mode, mods);
+
+    // Beatmaps that can't be downloaded right now are not cached so they are tried again next time
+    if (!result.has_value() || max_entries == 0)
+        return result;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Another thread may have parsed the same beatmap in the mean time
+    if (difficulties.find(key) != difficulties.end())
+        return result;
+
+    usage.emplace_front(key);
+    difficulties.emplace(key, cached_difficulty { result.value(), usage.begin() });
+
+    while (difficulties.size() > max_entries) {
+        difficulties.erase(usage.back());
+        usage.pop_back();
+        evictions++;
+    }
+
+    return result;
+}
+
+void shiro::pp::difficulty_cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    difficulties.clear();
+    usage.clear();
+}
+
+shiro::pp::difficulty_cache::statistics shiro::pp::difficulty_cache::get_statistics() {
+    statistics stats;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.entries = difficulties.size();
+    }
+
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.memory_usage = stats.entries * entry_size;
+    stats.memory_budget = max_entries * entry_size;
+
+    return stats;
+}
+
+uint64_t shiro::pp::difficulty_cache::make_key(int32_t beatmap_id, uint8_t mode, int32_t mods) {
+    // Difficulty changing mods all fit into the lower 16 bits
+    return ((uint64_t) (uint32_t) beatmap_id << 32) | ((uint64_t) mode << 16) | (uint64_t) (mods & 0xFFFF);
+}
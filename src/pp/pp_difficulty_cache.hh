@@ -0,0 +1,51 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_PP_DIFFICULTY_CACHE_HH
+#define SHIRO_PP_DIFFICULTY_CACHE_HH
+
+#include <cstdint>
+#include <optional>
+
+#include "../beatmaps/beatmap.hh"
+#include "wrapper/oppai_wrapper.hh"
+
+namespace shiro::pp::difficulty_cache {
+
+    struct statistics {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+
+        size_t entries = 0;
+        size_t memory_usage = 0; // In bytes
+        size_t memory_budget = 0; // In bytes
+    };
+
+    void init();
+
+    // Returns the cached difficulty or parses the beatmap with the difficulty changing mods of the given mods
+    std::optional<oppai_difficulty> fetch(const beatmaps::beatmap &beatmap, uint8_t mode, int32_t mods);
+
+    void clear();
+
+    statistics get_statistics();
+
+}
+
+#endif //SHIRO_PP_DIFFICULTY_CACHE_HH
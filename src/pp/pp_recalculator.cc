@@ -16,251 +16,647 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <ctime>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <sqlpp11/exception.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../beatmaps/beatmap.hh"
+#include "../beatmaps/beatmap_helper.hh"
+#include "../beatmaps/beatmap_ranked_status.hh"
+#include "../config/db_file.hh"
+#include "../database/tables/beatmap_table.hh"
+#include "../database/tables/recalculations_table.hh"
 #include "../database/tables/score_table.hh"
 #include "../database/tables/user_table.hh"
-#include "../beatmaps/beatmap_helper.hh"
+#include "../logger/sentry_logger.hh"
 #include "../ranking/ranking_helper.hh"
 #include "../scores/score.hh"
 #include "../scores/score_helper.hh"
+#include "../scores/top_plays.hh"
 #include "../thirdparty/loguru.hh"
 #include "../users/user.hh"
 #include "../users/user_manager.hh"
-#include "../utils/vector_utils.hh"
 #include "../shiro.hh"
 #include "pp_recalculator.hh"
 #include "pp_score_metric.hh"
 
-bool shiro::pp::recalculator::running = false;
-size_t shiro::pp::recalculator::running_threads = 0;
-std::shared_timed_mutex shiro::pp::recalculator::mutex;
+namespace shiro::pp::recalculator {
+
+    SQLPP_ALIAS_PROVIDER(beatmap_count);
+
+    enum class phase : uint8_t {
+        scores = 0,
+        users = 1
+    };
+
+    struct job {
+        utils::play_mode mode = utils::play_mode::standard;
+        std::string mode_name = "";
+        std::chrono::steady_clock::time_point start;
+
+        std::mutex mutex;
+        std::condition_variable done;
+        uint32_t active_workers = 0;
+
+        // Score phase: beatmaps are handed out in batches in order of their row id
+        int32_t cursor = 0; // Highest beatmap row id that has been handed out
+        bool exhausted = false;
+        std::set<int32_t> pending; // First beatmap row id of every batch that is still being worked on
+
+        // User phase
+        std::vector<int32_t> users;
+        std::atomic<size_t> user_cursor { 0 };
+
+        std::atomic<uint64_t> beatmaps { 0 };
+        std::atomic<uint64_t> scores { 0 };
+        std::atomic<uint64_t> updated { 0 };
+        std::atomic<uint64_t> processed_users { 0 };
+        uint64_t total_beatmaps = 0;
+
+        std::atomic<bool> failed { false };
+    };
+
+    // Row of the recalculations table, every play mode that is being recalculated has one
+    struct progress {
+        utils::play_mode mode = utils::play_mode::standard;
+        phase current_phase = phase::scores;
+        int32_t checkpoint = 0;
+    };
+
+    constexpr size_t beatmap_batch_size = 16;
+    constexpr size_t user_batch_size = 100;
+    constexpr size_t update_batch_size = 500;
+    constexpr std::chrono::seconds report_interval = std::chrono::seconds(30);
+
+    static bool running = false;
+    static std::shared_timed_mutex mutex;
+
+    static bool try_start();
+    static uint32_t get_worker_count(uint32_t threads);
+
+    // Runs the interrupted recalculations one after another
+    static void resume(std::vector<progress> interrupted, uint32_t threads);
+
+    static void run(utils::play_mode mode, uint32_t threads, phase start_phase, int32_t checkpoint);
+    static void run_workers(job &j, uint32_t threads, phase current_phase);
+    static void report(job &j, phase current_phase);
+    static void finish(job &j);
+
+    static void recalculate_scores(job &j);
+    static bool claim_beatmaps(job &j, std::vector<beatmaps::beatmap> &batch);
+    static void recalculate_beatmap(job &j, const beatmaps::beatmap &map, std::vector<std::pair<int32_t, float>> &updates);
+    static void complete_beatmaps(job &j, int32_t first_id);
+
+    static void recalculate_users(job &j);
+    static std::vector<int32_t> fetch_users(utils::play_mode mode);
+
+    static void save_progress(utils::play_mode mode, phase current_phase, int32_t checkpoint);
+    static std::vector<int32_t> get_pp_statuses();
+    static std::string get_pp_column(utils::play_mode mode);
+
+}
+
+void shiro::pp::recalculator::init() {
+    auto db = db_connection->get_connection();
+    const tables::recalculations recalculations_table {};
+
+    auto result = db(select(all_of(recalculations_table)).from(recalculations_table).unconditionally());
+
+    std::vector<progress> interrupted;
+
+    for (const auto &row : result) {
+        progress p;
+        p.mode = (utils::play_mode) (uint8_t) row.play_mode;
+        p.current_phase = (phase) (uint8_t) row.phase;
+        p.checkpoint = row.checkpoint;
+
+        interrupted.emplace_back(p);
+    }
+
+    if (interrupted.empty() || !try_start())
+        return;
+
+    std::thread(resume, std::move(interrupted), get_worker_count(std::thread::hardware_concurrency())).detach();
+}
 
 void shiro::pp::recalculator::begin(shiro::utils::play_mode mode, uint32_t threads) {
-    if (running) {
+    if (!try_start()) {
         LOG_F(ERROR, "PP recalculation was called while already recalculating.");
         return;
     }
 
-    if (threads >= 2)
-        threads /= 2; // Only use half of the available threads for pp recalculation
-
-    std::vector<int32_t> users;
     std::string game_mode = utils::play_mode_to_string(mode);
 
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::users user_table {};
+    {
+        // Stored before any work happens so an interruption at any point can be resumed
+        auto db = db_connection->get_connection();
+        const tables::recalculations recalculations_table {};
+
+        db(remove_from(recalculations_table).where(recalculations_table.play_mode == (uint8_t) mode));
+        db(insert_into(recalculations_table).set(
+                recalculations_table.play_mode = (uint8_t) mode,
+                recalculations_table.phase = (uint8_t) phase::scores,
+                recalculations_table.checkpoint = 0,
+                recalculations_table.started = (int32_t) std::time(nullptr)
+        ));
+    }
 
-    auto result = db(select(all_of(user_table)).from(user_table).unconditionally());
+    std::thread(run, mode, get_worker_count(threads), phase::scores, 0).detach();
 
-    for (const auto &row : result) {
-        // Bots usually don't have scores, so let's skip them
-        if ((uint32_t) row.roles == 0xDEADCAFE)
-            continue;
+    io::osu_writer writer;
+    writer.announce(
+            "Global PP recalculation has begun for all scores in " + game_mode + ". "
+            "PP on scores may not match user overall pp amount. "
+            "Global rank and user pp updates have been paused."
+    );
 
-        int32_t play_count = 0;
+    users::manager::broadcast(writer);
+}
 
-        switch (mode) {
-            case utils::play_mode::standard:
-                play_count = (int32_t) row.play_count_std;
-                break;
-            case utils::play_mode::taiko:
-                play_count = (int32_t) row.play_count_taiko;
-                break;
-            case utils::play_mode::fruits:
-                play_count = (int32_t) row.play_count_ctb;
-                break;
-            case utils::play_mode::mania:
-                play_count = (int32_t) row.play_count_mania;
-                break;
-        }
+void shiro::pp::recalculator::resume(std::vector<progress> interrupted, uint32_t threads) {
+    for (size_t i = 0; i < interrupted.size(); i++) {
+        const progress &p = interrupted.at(i);
+        std::string mode_name = utils::play_mode_to_string(p.mode);
 
-        // No need to recalculate users that don't have any scores
-        if (play_count <= 0)
+        // The first one is started by init, every recalculation that ends gives up running again
+        if (i > 0 && !try_start()) {
+            LOG_F(WARNING, "Unable to resume pp recalculation in %s while another one is running, it will be resumed on the next start.", mode_name.c_str());
             continue;
+        }
 
-        users.emplace_back(row.id);
+        LOG_F(INFO, "Resuming interrupted pp recalculation in %s after beatmap #%i.", mode_name.c_str(), p.checkpoint);
+
+        run(p.mode, threads, p.current_phase, p.checkpoint);
     }
+}
 
-    if (users.empty())
-        return;
+bool shiro::pp::recalculator::in_progess() {
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    return running;
+}
 
+bool shiro::pp::recalculator::try_start() {
     std::unique_lock<std::shared_timed_mutex> lock(mutex);
+
+    if (running)
+        return false;
+
     running = true;
-    lock.unlock(); // Unlock to avoid deadlocks
+    return true;
+}
+
+uint32_t shiro::pp::recalculator::get_worker_count(uint32_t threads) {
+    if (threads >= 2)
+        threads /= 2; // Only use half of the available threads for pp recalculation
+
+    // Every worker holds a database connection while writing, leave enough for everyone else
+    uint32_t max_workers = std::max(1u, config::database::pool_size / 2);
+
+    return std::clamp(threads, 1u, max_workers);
+}
+
+void shiro::pp::recalculator::run(shiro::utils::play_mode mode, uint32_t threads, phase start_phase, int32_t checkpoint) {
+    job j;
+    j.mode = mode;
+    j.mode_name = utils::play_mode_to_string(mode);
+    j.cursor = checkpoint;
 
-    LOG_F(INFO, "Starting pp recalculation in %s for %lu users with %u threads.", game_mode.c_str(), users.size(), threads);
+    try {
+        if (start_phase == phase::scores) {
+            auto db = db_connection->get_connection();
+            const tables::beatmaps beatmaps_table {};
 
-    bool evenly_distributable = users.size() % threads == 0;
-    ptrdiff_t chunk_size = users.size() / threads;
+            auto result = db(select(sqlpp::count(beatmaps_table.id).as(beatmap_count)).from(beatmaps_table).where(
+                    beatmaps_table.id > checkpoint and
+                    beatmaps_table.ranked_status.in(sqlpp::value_list(get_pp_statuses()))
+            ));
 
-    if (!evenly_distributable)
-        chunk_size += 1;
+            if (!result.empty())
+                j.total_beatmaps = result.front().beatmap_count;
 
-    // If there are more (or equal the amount of) users than threads, every thread can calculate up to one user.
-    if (threads >= users.size()) {
-        chunk_size = 1;
-        LOG_F(WARNING, "Thread amount is bigger or equal the amount of users.");
+            LOG_F(INFO, "Recalculating scores in %s on %lu beatmaps with %u threads.", j.mode_name.c_str(), j.total_beatmaps, threads);
+
+            run_workers(j, threads, phase::scores);
+
+            if (j.failed)
+                throw sqlpp::exception("A worker was unable to recalculate scores.");
+
+            save_progress(mode, phase::users, j.cursor);
+        }
+
+        j.users = fetch_users(mode);
+
+        LOG_F(INFO, "Recalculating overall pp in %s for %lu users with %u threads.", j.mode_name.c_str(), j.users.size(), threads);
+
+        run_workers(j, threads, phase::users);
+
+        if (j.failed)
+            throw sqlpp::exception("A worker was unable to recalculate user pp.");
+    } catch (const sqlpp::exception &ex) {
+        LOG_F(ERROR, "PP recalculation in %s was interrupted, it will be resumed on the next start: %s", j.mode_name.c_str(), ex.what());
+        logging::sentry::exception(ex);
+
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+        running = false;
+
+        return;
+    }
+
+    finish(j);
+}
+
+void shiro::pp::recalculator::run_workers(job &j, uint32_t threads, phase current_phase) {
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+
+    j.start = std::chrono::steady_clock::now();
+    j.active_workers = threads;
+
+    for (uint32_t i = 0; i < threads; i++) {
+        workers.emplace_back([&j, current_phase]() {
+            try {
+                if (current_phase == phase::scores) {
+                    recalculate_scores(j);
+                } else {
+                    recalculate_users(j);
+                }
+            } catch (const sqlpp::exception &ex) {
+                LOG_F(ERROR, "Unable to write recalculated pp: %s", ex.what());
+                logging::sentry::exception(ex);
+
+                j.failed = true;
+            }
+
+            std::lock_guard<std::mutex> lock(j.mutex);
+            j.active_workers--;
+            j.done.notify_all();
+        });
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(j.mutex);
+
+        while (!j.done.wait_for(lock, report_interval, [&j]() { return j.active_workers == 0; })) {
+            lock.unlock();
+            report(j, current_phase);
+            lock.lock();
+        }
     }
 
-    auto chunks = utils::chunk(users.begin(), users.end(), chunk_size);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
 
-    if (threads < users.size())
-        LOG_F(INFO, "Distributing work across %u threads: every thread calculates up to %lu users. (%lu chunks)", threads, chunk_size, chunks.size());
+void shiro::pp::recalculator::report(job &j, phase current_phase) {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - j.start).count();
 
-    for (size_t i = 0; i < chunks.size(); i++) {
-        auto [begin, end] = chunks.at(i);
+    if (current_phase == phase::users) {
+        LOG_F(INFO, "PP recalculation in %s: %lu/%lu users.", j.mode_name.c_str(), j.processed_users.load(), j.users.size());
+        return;
+    }
+
+    uint64_t beatmaps = j.beatmaps.load();
+    uint64_t scores = j.scores.load();
 
-        std::vector<int32_t> chunked_users(begin, end);
-        std::thread thread(recalculate, mode, chunked_users);
+    double beatmap_rate = beatmaps / elapsed;
+    uint64_t remaining = j.total_beatmaps > beatmaps ? j.total_beatmaps - beatmaps : 0;
+    uint64_t eta = beatmap_rate > 0 ? (uint64_t) (remaining / beatmap_rate) : 0;
 
-        std::stringstream stream;
-        stream << "0x" << thread.get_id();
+    LOG_F(
+            INFO, "PP recalculation in %s: %lu/%lu beatmaps, %lu scores (%.0f scores/s, %lu changed), ETA %lum %lus.",
+            j.mode_name.c_str(), beatmaps, j.total_beatmaps, scores, scores / elapsed, j.updated.load(), eta / 60, eta % 60
+    );
+}
 
+void shiro::pp::recalculator::finish(job &j) {
+    {
         std::unique_lock<std::shared_timed_mutex> lock(mutex);
-        running_threads++;
-        lock.unlock(); // Unlock to avoid deadlocks
+        running = false;
+    }
+
+    // Cached top plays still carry the old pp values
+    scores::top_plays::clear();
+
+    // Recalculate global ranks now that user pp is updated
+    ranking::helper::recalculate_ranks(j.mode);
 
-        LOG_F(INFO, "Thread %s started recalculating with chunk %lu. (%lu users)", stream.str().c_str(), i, chunked_users.size());
+    {
+        auto db = db_connection->get_connection();
+        const tables::recalculations recalculations_table {};
 
-        // Let the thread do it's work
-        thread.detach();
+        db(remove_from(recalculations_table).where(recalculations_table.play_mode == (uint8_t) j.mode));
     }
 
+    LOG_F(INFO, "PP recalculation in %s has finished: %lu scores changed.", j.mode_name.c_str(), j.updated.load());
+
     io::osu_writer writer;
-    writer.announce(
-            "Global PP recalculation has begun for all scores in " + game_mode + ". "
-            "PP on scores may not match user overall pp amount. "
-            "Global rank and user pp updates have been paused."
-    );
+    writer.announce("PP recalculation has ended. Your pp amount and global rank have been updated.");
 
+    // Rank recalculation only sends out users whose rank moved, but everyone's pp may have changed
     users::manager::iterate([&writer](std::shared_ptr<users::user> user) {
-        user->queue.enqueue(writer);
+        if (user->hidden) {
+            user->refresh_stats();
+            return;
+        }
+
+        writer.user_stats(user->stats);
+        writer.user_presence(user->presence);
     }, true);
 
-    LOG_F(INFO, "All recalculation threads have been started. Let's get this train rolling.");
+    users::manager::broadcast(writer);
 }
 
-void shiro::pp::recalculator::end(shiro::utils::play_mode mode) {
-    std::unique_lock<std::shared_timed_mutex> shared_lock(mutex);
+void shiro::pp::recalculator::recalculate_scores(job &j) {
+    std::vector<beatmaps::beatmap> batch;
 
-    running_threads--;
+    while (!j.failed && claim_beatmaps(j, batch)) {
+        std::vector<std::pair<int32_t, float>> updates;
 
-    if (running_threads > 0) {
-        LOG_F(INFO, "Still %lu threads running.", running_threads);
-        return;
-    }
+        for (const beatmaps::beatmap &map : batch) {
+            recalculate_beatmap(j, map, updates);
+            j.beatmaps++;
+        }
 
-    running = false;
+        if (!updates.empty()) {
+            auto db = db_connection->get_connection();
 
-    // Recalculate overall pp for all users now
-    // TODO: This code is repeated in user_stats.cc, needs to be refactored asap
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::users user_table {};
+            // All changed scores of the batch are written in one transaction, the statements only contain numbers
+            db->start_transaction();
 
-    auto result = db(select(all_of(user_table)).from(user_table).unconditionally());
+            try {
+                for (size_t offset = 0; offset < updates.size(); offset += update_batch_size) {
+                    size_t end = std::min(offset + update_batch_size, updates.size());
 
-    for (const auto &row : result) {
-        std::vector<scores::score> scores = scores::helper::fetch_top100_user(mode, row.id);
-        float raw_pp = 0; // Here it is a float to keep decimal points, round it when setting final pp value
+                    std::string cases;
+                    std::string ids;
+
+                    for (size_t i = offset; i < end; i++) {
+                        const auto &[score_id, pp] = updates.at(i);
+
+                        cases += " WHEN " + std::to_string(score_id) + " THEN " + std::to_string(pp);
+
+                        if (!ids.empty())
+                            ids += ", ";
 
-        for (size_t i = 0; i < scores.size(); i++) {
-            scores::score score = scores.at(i);
+                        ids += std::to_string(score_id);
+                    }
 
-            raw_pp += (score.pp * std::pow(0.95, i));
+                    db->execute("UPDATE `scores` SET pp = CASE id" + cases + " ELSE pp END WHERE id IN (" + ids + ");");
+                }
+
+                db->commit_transaction();
+            } catch (...) {
+                db->rollback_transaction(false);
+                throw;
+            }
+
+            j.updated += updates.size();
         }
 
-        std::shared_ptr<users::user> user = users::manager::get_user_by_id(row.id);
-        int16_t pp = std::clamp(static_cast<int16_t>(raw_pp), (int16_t) 0, std::numeric_limits<int16_t>::max());
+        complete_beatmaps(j, batch.front().id);
+    }
+}
 
-        switch (mode) {
-            case utils::play_mode::standard:
-                db(update(user_table).set(user_table.pp_std = pp).where(user_table.id == row.id));
+bool shiro::pp::recalculator::claim_beatmaps(job &j, std::vector<beatmaps::beatmap> &batch) {
+    std::lock_guard<std::mutex> lock(j.mutex);
 
-                if (user != nullptr && user->stats.play_mode == (uint8_t) utils::play_mode::standard)
-                    user->stats.pp = pp;
+    if (j.exhausted)
+        return false;
 
-                break;
-            case utils::play_mode::taiko:
-                db(update(user_table).set(user_table.pp_taiko = pp).where(user_table.id == row.id));
+    auto db = db_connection->get_connection();
+    const tables::beatmaps beatmaps_table {};
 
-                if (user != nullptr && user->stats.play_mode == (uint8_t) utils::play_mode::taiko)
-                    user->stats.pp = pp;
+    auto result = db(select(
+            beatmaps_table.id, beatmaps_table.beatmap_id, beatmaps_table.beatmap_md5, beatmaps_table.ranked_status
+    ).from(beatmaps_table).where(
+            beatmaps_table.id > j.cursor and
+            beatmaps_table.ranked_status.in(sqlpp::value_list(get_pp_statuses()))
+    ).order_by(beatmaps_table.id.asc()).limit(beatmap_batch_size));
 
-                break;
-            case utils::play_mode::fruits:
-                db(update(user_table).set(user_table.pp_ctb = pp).where(user_table.id == row.id));
+    batch.clear();
 
-                if (user != nullptr && user->stats.play_mode == (uint8_t) utils::play_mode::fruits)
-                    user->stats.pp = pp;
+    for (const auto &row : result) {
+        beatmaps::beatmap map;
 
-                break;
-            case utils::play_mode::mania:
-                db(update(user_table).set(user_table.pp_mania = pp).where(user_table.id == row.id));
+        map.id = row.id;
+        map.beatmap_id = row.beatmap_id;
+        map.beatmap_md5 = row.beatmap_md5;
+        map.ranked_status = row.ranked_status;
 
-                if (user != nullptr && user->stats.play_mode == (uint8_t) utils::play_mode::mania)
-                    user->stats.pp = pp;
+        batch.emplace_back(std::move(map));
+    }
 
-                break;
+    if (batch.empty()) {
+        j.exhausted = true;
+        return false;
+    }
+
+    j.cursor = batch.back().id;
+    j.pending.emplace(batch.front().id);
+
+    return true;
+}
+
+void shiro::pp::recalculator::recalculate_beatmap(job &j, const beatmaps::beatmap &map, std::vector<std::pair<int32_t, float>> &updates) {
+    std::vector<scores::score> scores;
+
+    {
+        auto db = db_connection->get_connection();
+        const tables::scores score_table {};
+
+        auto result = db(select(
+                score_table.id, score_table.user_id, score_table.mods, score_table.max_combo, score_table._300_count,
+                score_table._100_count, score_table._50_count, score_table.miss_count, score_table.pp
+        ).from(score_table).where(
+                score_table.beatmap_md5 == map.beatmap_md5 and
+                score_table.play_mode == (uint8_t) j.mode
+        ));
+
+        for (const auto &row : result) {
+            scores::score s;
+
+            s.id = row.id;
+            s.user_id = row.user_id;
+            s.beatmap_md5 = map.beatmap_md5;
+            s.mods = row.mods;
+            s.max_combo = row.max_combo;
+            s._300_count = row._300_count;
+            s._100_count = row._100_count;
+            s._50_count = row._50_count;
+            s.miss_count = row.miss_count;
+            s.pp = row.pp;
+            s.play_mode = (uint8_t) j.mode;
+
+            scores.emplace_back(std::move(s));
         }
     }
 
-    // Recalculate global ranks now that user pp is updated
-    ranking::helper::recalculate_ranks(mode);
+    if (scores.empty())
+        return;
 
-    io::osu_writer writer;
-    writer.announce("PP recalculation has ended. Your pp amount and global rank have been updated.");
+    // Difficulty is shared through the difficulty cache, a beatmap is parsed once per set of difficulty changing mods
+    for (const scores::score &score : scores) {
+        float pp = pp::calculate(map, score);
+        float abs_difference = std::fabs(pp - score.pp);
 
-    users::manager::iterate([&writer](std::shared_ptr<users::user> user) {
-        user->refresh_stats();
-        user->queue.enqueue(writer);
-    }, true);
+        j.scores++;
+
+        if (abs_difference < 0.001f)
+            continue;
+
+        bool increase = pp > score.pp;
+        const char *prefix = increase ? "+" : "-";
+
+        if (abs_difference > 1)
+            LOG_F(MAX, "Recalculation: Score #%i (user id %i): %fpp -> %fpp (%s%fpp)", score.id, score.user_id, score.pp, pp, prefix, abs_difference);
+
+        updates.emplace_back(score.id, pp);
+    }
 }
 
-bool shiro::pp::recalculator::in_progess() {
-    std::shared_lock<std::shared_timed_mutex> lock(mutex);
-    return running;
+void shiro::pp::recalculator::complete_beatmaps(job &j, int32_t first_id) {
+    int32_t checkpoint = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(j.mutex);
+        j.pending.erase(first_id);
+
+        // Batches are handed out in order, so every beatmap before the oldest unfinished batch is done
+        checkpoint = j.pending.empty() ? j.cursor : *j.pending.begin() - 1;
+    }
+
+    save_progress(j.mode, phase::scores, checkpoint);
 }
 
-void shiro::pp::recalculator::recalculate(shiro::utils::play_mode mode, std::vector<int32_t> users) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::scores score_table {};
+void shiro::pp::recalculator::recalculate_users(job &j) {
+    std::string column = get_pp_column(j.mode);
 
-    for (int32_t user_id : users) {
-        std::vector<scores::score> scores = scores::helper::fetch_all_user_scores(user_id);
+    while (!j.failed) {
+        size_t begin = j.user_cursor.fetch_add(user_batch_size);
 
-        if (scores.empty())
-            continue;
+        if (begin >= j.users.size())
+            return;
+
+        size_t end = std::min(begin + user_batch_size, j.users.size());
 
-        for (const scores::score &score : scores) {
-            beatmaps::beatmap map;
-            map.beatmap_md5 = score.beatmap_md5;
+        std::string cases;
+        std::string ids;
 
-            // On recalculation we would hit osu! API too often so we exclusively allow database fetching
-            if (!map.fetch_db()) {
-                LOG_F(WARNING, "Score #%i was set on a beatmap that is not in the database. Skipping...", score.id);
-                continue;
+        for (size_t i = begin; i < end; i++) {
+            int32_t user_id = j.users.at(i);
+            std::vector<scores::score> scores = scores::helper::fetch_top100_user(j.mode, user_id);
+            float raw_pp = 0; // Here it is a float to keep decimal points, round it when setting final pp value
+
+            for (size_t k = 0; k < scores.size(); k++) {
+                raw_pp += (scores.at(k).pp * std::pow(0.95, k));
             }
 
-            if (!beatmaps::helper::awards_pp(beatmaps::helper::fix_beatmap_status(map.ranked_status)))
-                continue;
+            int16_t pp = std::clamp(static_cast<int16_t>(raw_pp), (int16_t) 0, std::numeric_limits<int16_t>::max());
+            std::shared_ptr<users::user> user = users::manager::get_user_by_id(user_id);
+
+            if (user != nullptr && user->stats.play_mode == (uint8_t) j.mode)
+                user->stats.pp = pp;
+
+            cases += " WHEN " + std::to_string(user_id) + " THEN " + std::to_string(pp);
+
+            if (!ids.empty())
+                ids += ", ";
+
+            ids += std::to_string(user_id);
+
+            j.processed_users++;
+        }
+
+        auto db = db_connection->get_connection();
+        db->execute("UPDATE `users` SET " + column + " = CASE id" + cases + " ELSE " + column + " END WHERE id IN (" + ids + ");");
+    }
+}
+
+std::vector<int32_t> shiro::pp::recalculator::fetch_users(shiro::utils::play_mode mode) {
+    std::vector<int32_t> users;
+
+    auto db = db_connection->get_connection();
+    const tables::users user_table {};
 
-            float pp = pp::calculate(map, score);
-            float abs_difference = std::fabs(pp - score.pp);
+    auto result = db(select(all_of(user_table)).from(user_table).unconditionally().order_by(user_table.id.asc()));
 
-            bool increase = pp > score.pp;
-            const char *prefix = increase ? "+" : "-";
+    for (const auto &row : result) {
+        // Bots usually don't have scores, so let's skip them
+        if ((uint32_t) row.roles == 0xDEADCAFE)
+            continue;
 
-            if (abs_difference > 1)
-                LOG_F(MAX, "Recalculation: Score #%i (user id %i): %fpp -> %fpp (%s%fpp)", score.id, user_id, score.pp, pp, prefix, abs_difference);
+        int32_t play_count = 0;
 
-            db(update(score_table).set(score_table.pp = pp).where(score_table.id == score.id));
+        switch (mode) {
+            case utils::play_mode::standard:
+                play_count = (int32_t) row.play_count_std;
+                break;
+            case utils::play_mode::taiko:
+                play_count = (int32_t) row.play_count_taiko;
+                break;
+            case utils::play_mode::fruits:
+                play_count = (int32_t) row.play_count_ctb;
+                break;
+            case utils::play_mode::mania:
+                play_count = (int32_t) row.play_count_mania;
+                break;
         }
+
+        // No need to recalculate users that don't have any scores
+        if (play_count <= 0)
+            continue;
+
+        users.emplace_back(row.id);
+    }
+
+    return users;
+}
+
+void shiro::pp::recalculator::save_progress(shiro::utils::play_mode mode, phase current_phase, int32_t checkpoint) {
+    auto db = db_connection->get_connection();
+
+    // Batches finish out of order, the checkpoint must never move backwards
+    db->execute(
+            "UPDATE `recalculations` SET phase = " + std::to_string((uint8_t) current_phase) + ", "
+            "checkpoint = GREATEST(checkpoint, " + std::to_string(checkpoint) + ") "
+            "WHERE play_mode = " + std::to_string((uint8_t) mode) + ";"
+    );
+}
+
+std::vector<int32_t> shiro::pp::recalculator::get_pp_statuses() {
+    std::vector<int32_t> statuses;
+
+    for (int32_t status = (int32_t) beatmaps::status::unknown; status <= (int32_t) beatmaps::status::loved; status++) {
+        if (beatmaps::helper::awards_pp(beatmaps::helper::fix_beatmap_status(status)))
+            statuses.emplace_back(status);
     }
 
-    std::stringstream stream;
-    stream << "0x" << std::this_thread::get_id();
+    return statuses;
+}
 
-    LOG_F(INFO, "Thread %s finished pp calculation.", stream.str().c_str());
+std::string shiro::pp::recalculator::get_pp_column(shiro::utils::play_mode mode) {
+    switch (mode) {
+        case utils::play_mode::standard:
+            return "pp_std";
+        case utils::play_mode::taiko:
+            return "pp_taiko";
+        case utils::play_mode::fruits:
+            return "pp_ctb";
+        case utils::play_mode::mania:
+            return "pp_mania";
+    }
 
-    // We're done, let the end callback know that
-    end(mode);
+    return "pp_std";
 }
@@ -16,9 +16,11 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <optional>
 #include <utility>
 
 #include "wrapper/oppai_wrapper.hh"
+#include "pp_difficulty_cache.hh"
 #include "pp_score_metric.hh"
 
 float shiro::pp::calculate(shiro::beatmaps::beatmap beatmap, shiro::scores::score score) {
@@ -37,9 +39,12 @@ float shiro::pp::calculate(shiro::beatmaps::beatmap beatmap, shiro::scores::scor
 }
 
 float shiro::pp::calculate_std(shiro::beatmaps::beatmap beatmap, shiro::scores::score score) {
-    oppai_wrapper wrapper(std::move(beatmap), std::move(score));
+    std::optional<oppai_difficulty> difficulty = difficulty_cache::fetch(beatmap, score.play_mode, score.mods);
 
-    return wrapper.calculate();
+    if (!difficulty.has_value())
+        return 0.0f;
+
+    return oppai_wrapper::calculate(difficulty.value(), score);
 }
 
 // For now this just uses oppai-ng and thus does not award correct pp for converted maps
@@ -18,47 +18,93 @@
 
 #define OPPAI_IMPLEMENTATION
 
+#include <memory>
+#include <string_view>
+
 #include "../../beatmaps/beatmap_helper.hh"
 #include "../../thirdparty/oppai.hh"
 #include "../../utils/mods.hh"
 #include "oppai_wrapper.hh"
 
-shiro::pp::oppai_wrapper::oppai_wrapper(shiro::beatmaps::beatmap beatmap, shiro::scores::score score) {
-    std::optional<std::string> beatmap_file = beatmaps::helper::get_location(beatmap.beatmap_id);
+std::optional<shiro::pp::oppai_difficulty> shiro::pp::oppai_wrapper::calculate_difficulty(const shiro::beatmaps::beatmap &beatmap, uint8_t mode, int32_t mods) {
+    std::optional<beatmaps::store::beatmap_view> beatmap_file = beatmaps::helper::get_beatmap(beatmap.beatmap_id);
 
     if (!beatmap_file.has_value())
-        return;
-
-    this->ez = ezpp_new();
+        return std::nullopt;
 
-    // Call ezpp_dup instead of ezpp so it strdup's the const char* into an char*
-    ezpp_dup(this->ez, beatmap_file.value().c_str());
+    const std::string_view &contents = beatmap_file->contents;
+    std::unique_ptr<struct ezpp, decltype(&ezpp_free)> ez(ezpp_new(), ezpp_free);
 
-    ezpp_set_mode(this->ez, score.play_mode);
-    ezpp_set_mods(this->ez, score.mods);
-    ezpp_set_combo(this->ez, score.max_combo);
+    // Auto calc is disabled by default, the beatmap is parsed with these settings by ezpp_data
+    ezpp_set_mode(ez.get(), mode);
+    ezpp_set_mods(ez.get(), get_difficulty_mods(mods));
 
-    this->ez->n300 = score._300_count;
-    this->ez->n100 = score._100_count;
-    this->ez->n50 = score._50_count;
-    ezpp_set_nmiss(this->ez, score.miss_count);
+    // oppai only reads the beatmap, so it is parsed straight from the view without copying it
+    if (ezpp_data(ez.get(), const_cast<char*>(contents.data()), (int) contents.size()) < 0)
+        return std::nullopt;
 
-    // Enable auto calc now so the next call to ezpp_set below will calculate the whole beatmap difficulty
-    ezpp_set_autocalc(this->ez, true);
+    // oppai takes the play mode from the beatmap file, converted beatmaps are calculated in their original mode
+    oppai_difficulty difficulty;
+    difficulty.mode = (uint8_t) ez->mode;
+    difficulty.mods = ez->mods;
+    difficulty.ar = ez->ar;
+    difficulty.od = ez->od;
+    difficulty.odms = ez->odms;
+    difficulty.stars = ez->stars;
+    difficulty.aim_stars = ez->aim_stars;
+    difficulty.speed_stars = ez->speed_stars;
+    difficulty.max_combo = ez->max_combo;
+    difficulty.circles = ez->ncircles;
+    difficulty.sliders = ez->nsliders;
+    difficulty.objects = ez->nobjects;
 
-    ezpp_set_score_version(this->ez, (score.mods & (int32_t) utils::mods::score_v2) ? 2 : 1);
+    return difficulty;
 }
 
-shiro::pp::oppai_wrapper::~oppai_wrapper() {
-    if (this->ez == nullptr)
-        return;
+float shiro::pp::oppai_wrapper::calculate(const shiro::pp::oppai_difficulty &difficulty, const shiro::scores::score &score) {
+    // ezpp has a large parser buffer, every thread keeps one around instead of allocating it per score
+    thread_local std::unique_ptr<struct ezpp, decltype(&ezpp_free)> ez(ezpp_new(), ezpp_free);
 
-    ezpp_free(this->ez);
-}
+    ez->mode = difficulty.mode;
+    ez->mods = difficulty.mods | score.mods;
+    ez->score_version = (score.mods & (int32_t) utils::mods::score_v2) ? 2 : 1;
+
+    ez->ar = difficulty.ar;
+    ez->od = difficulty.od;
+    ez->odms = difficulty.odms;
+    ez->stars = difficulty.stars;
+    ez->aim_stars = difficulty.aim_stars;
+    ez->speed_stars = difficulty.speed_stars;
+    ez->max_combo = difficulty.max_combo;
+    ez->ncircles = difficulty.circles;
+    ez->nsliders = difficulty.sliders;
+    ez->nobjects = difficulty.objects;
+
+    ez->combo = score.max_combo;
+    ez->n100 = score._100_count;
+    ez->n50 = score._50_count;
+    ez->nmiss = score.miss_count;
+    ez->n300 = ez->nobjects - ez->n100 - ez->n50 - ez->nmiss;
 
-float shiro::pp::oppai_wrapper::calculate() {
-    if (this->ez == nullptr)
-        return 0.0f;
+    // Same as the end of calc() in oppai, without parsing and applying mods again
+    switch (ez->mode) {
+        case MODE_STD:
+            if (pp_std(ez.get()) < 0)
+                return 0.0f;
+
+            break;
+        case MODE_TAIKO:
+            if (pp_taiko(ez.get()) < 0)
+                return 0.0f;
+
+            break;
+        default:
+            return 0.0f;
+    }
+
+    return ez->pp;
+}
 
-    return ezpp_pp(this->ez);
+int32_t shiro::pp::oppai_wrapper::get_difficulty_mods(int32_t mods) {
+    return mods & MODS_MAP_CHANGING;
 }
@@ -19,22 +19,45 @@
 #ifndef SHIRO_OPPAI_WRAPPER_HH
 #define SHIRO_OPPAI_WRAPPER_HH
 
+#include <optional>
+
 #include "../../thirdparty/oppai.hh"
 #include "../../beatmaps/beatmap.hh"
 #include "../../scores/score.hh"
 
 namespace shiro::pp {
 
-    class oppai_wrapper {
-    private:
-        ezpp_t ez = nullptr;
+    // Result of parsing a beatmap and calculating its difficulty in one play mode with one set of
+    // difficulty changing mods. Everything else oppai needs to calculate pp of a score on it.
+    struct oppai_difficulty {
+        uint8_t mode = 0;
+        int32_t mods = 0;
+
+        float ar = 0.0f;
+        float od = 0.0f;
+        float odms = 0.0f;
+
+        float stars = 0.0f;
+        float aim_stars = 0.0f;
+        float speed_stars = 0.0f;
 
+        int32_t max_combo = 0;
+        int32_t circles = 0;
+        int32_t sliders = 0;
+        int32_t objects = 0;
+    };
+
+    class oppai_wrapper {
     public:
-        oppai_wrapper(beatmaps::beatmap beatmap, scores::score score);
-        ~oppai_wrapper();
+        oppai_wrapper() = delete;
+
+        static std::optional<oppai_difficulty> calculate_difficulty(const beatmaps::beatmap &beatmap, uint8_t mode, int32_t mods);
 
-        float calculate();
+        // Only calculates pp from accuracy and combo, the difficulty needs to match the mode and difficulty mods of the score
+        static float calculate(const oppai_difficulty &difficulty, const scores::score &score);
 
+        // Strips all mods that don't change beatmap difficulty
+        static int32_t get_difficulty_mods(int32_t mods);
     };
 
 }
@@ -0,0 +1,248 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "rank_index.hh"
+
+void shiro::ranking::rank_index::build(const std::vector<std::pair<int32_t, float>> &users) {
+    std::unique_lock<std::shared_timed_mutex> lock(this->mutex);
+
+    std::fill(this->tree.begin(), this->tree.end(), 0);
+    this->buckets.clear();
+    this->users.clear();
+
+    for (const auto &[user_id, pp] : users) {
+        if (!this->users.emplace(user_id, pp).second)
+            continue;
+
+        size_t slot = get_slot(pp);
+
+        this->buckets[slot].push_back({ pp, user_id });
+        this->tree.at(slot)++;
+    }
+
+    for (auto &[_, bucket] : this->buckets) {
+        std::sort(bucket.begin(), bucket.end(), ranks_before);
+    }
+
+    // Turn the bucket counts into a Fenwick tree in linear time
+    for (size_t i = 1; i <= bucket_count; i++) {
+        size_t parent = i + (i & -i);
+
+        if (parent <= bucket_count)
+            this->tree.at(parent) += this->tree.at(i);
+    }
+}
+
+std::vector<shiro::ranking::rank_index::rank_change> shiro::ranking::rank_index::update(int32_t user_id, float pp) {
+    std::unique_lock<std::shared_timed_mutex> lock(this->mutex);
+    std::vector<rank_change> changes;
+
+    if (std::isnan(pp))
+        pp = 0.0f;
+
+    int32_t old_rank = 0;
+    auto iterator = this->users.find(user_id);
+
+    if (iterator != this->users.end()) {
+        entry old_entry { iterator->second, user_id };
+
+        if (old_entry.pp == pp)
+            return changes;
+
+        old_rank = this->rank_of(old_entry);
+
+        size_t slot = get_slot(old_entry.pp);
+        std::vector<entry> &bucket = this->buckets.at(slot);
+
+        bucket.erase(std::lower_bound(bucket.begin(), bucket.end(), old_entry, ranks_before));
+        this->add(slot, -1);
+
+        if (bucket.empty())
+            this->buckets.erase(slot);
+
+        iterator->second = pp;
+    } else {
+        this->users.emplace(user_id, pp);
+    }
+
+    entry new_entry { pp, user_id };
+    size_t slot = get_slot(pp);
+    std::vector<entry> &bucket = this->buckets[slot];
+
+    bucket.insert(std::upper_bound(bucket.begin(), bucket.end(), new_entry, ranks_before), new_entry);
+    this->add(slot, 1);
+
+    int32_t new_rank = this->rank_of(new_entry);
+
+    if (old_rank == new_rank)
+        return changes;
+
+    changes.emplace_back(user_id, new_rank);
+
+    // Everyone between the old and the new position moves by exactly one rank
+    if (old_rank == 0) {
+        this->collect(changes, new_rank + 1, (int32_t) this->users.size());
+    } else if (new_rank < old_rank) {
+        this->collect(changes, new_rank + 1, old_rank);
+    } else {
+        this->collect(changes, old_rank, new_rank - 1);
+    }
+
+    return changes;
+}
+
+std::vector<shiro::ranking::rank_index::rank_change> shiro::ranking::rank_index::remove(int32_t user_id) {
+    std::unique_lock<std::shared_timed_mutex> lock(this->mutex);
+    std::vector<rank_change> changes;
+
+    auto iterator = this->users.find(user_id);
+
+    if (iterator == this->users.end())
+        return changes;
+
+    entry old_entry { iterator->second, user_id };
+    int32_t old_rank = this->rank_of(old_entry);
+
+    size_t slot = get_slot(old_entry.pp);
+    std::vector<entry> &bucket = this->buckets.at(slot);
+
+    bucket.erase(std::lower_bound(bucket.begin(), bucket.end(), old_entry, ranks_before));
+    this->add(slot, -1);
+
+    if (bucket.empty())
+        this->buckets.erase(slot);
+
+    this->users.erase(iterator);
+
+    changes.emplace_back(user_id, 0);
+    this->collect(changes, old_rank, (int32_t) this->users.size());
+
+    return changes;
+}
+
+int32_t shiro::ranking::rank_index::get_rank(int32_t user_id) const {
+    std::shared_lock<std::shared_timed_mutex> lock(this->mutex);
+
+    auto iterator = this->users.find(user_id);
+
+    if (iterator == this->users.end())
+        return 0;
+
+    return this->rank_of({ iterator->second, user_id });
+}
+
+int32_t shiro::ranking::rank_index::get_user(int32_t rank) const {
+    std::shared_lock<std::shared_timed_mutex> lock(this->mutex);
+
+    if (rank < 1 || rank > (int32_t) this->users.size())
+        return 0;
+
+    return this->user_at(rank);
+}
+
+float shiro::ranking::rank_index::get_pp(int32_t user_id) const {
+    std::shared_lock<std::shared_timed_mutex> lock(this->mutex);
+
+    auto iterator = this->users.find(user_id);
+
+    if (iterator == this->users.end())
+        return 0.0f;
+
+    return iterator->second;
+}
+
+bool shiro::ranking::rank_index::contains(int32_t user_id) const {
+    std::shared_lock<std::shared_timed_mutex> lock(this->mutex);
+
+    return this->users.find(user_id) != this->users.end();
+}
+
+size_t shiro::ranking::rank_index::size() const {
+    std::shared_lock<std::shared_timed_mutex> lock(this->mutex);
+
+    return this->users.size();
+}
+
+bool shiro::ranking::rank_index::ranks_before(const entry &left, const entry &right) {
+    if (left.pp != right.pp)
+        return left.pp > right.pp;
+
+    return left.user_id < right.user_id;
+}
+
+size_t shiro::ranking::rank_index::get_slot(float pp) {
+    // Slot 1 holds the highest pp values, pp above the bucket range shares the first slot
+    float bucket = std::clamp(std::floor(pp), 0.0f, (float) (bucket_count - 1));
+
+    return bucket_count - (size_t) bucket;
+}
+
+void shiro::ranking::rank_index::add(size_t slot, int32_t delta) {
+    for (; slot <= bucket_count; slot += slot & -slot) {
+        this->tree.at(slot) += delta;
+    }
+}
+
+int32_t shiro::ranking::rank_index::prefix(size_t slot) const {
+    int32_t sum = 0;
+
+    for (; slot > 0; slot -= slot & -slot) {
+        sum += this->tree.at(slot);
+    }
+
+    return sum;
+}
+
+size_t shiro::ranking::rank_index::find(int32_t rank) const {
+    size_t position = 0;
+
+    for (size_t step = bucket_count; step > 0; step >>= 1) {
+        if (position + step <= bucket_count && this->tree.at(position + step) < rank) {
+            position += step;
+            rank -= this->tree.at(position);
+        }
+    }
+
+    return position + 1;
+}
+
+int32_t shiro::ranking::rank_index::rank_of(const entry &value) const {
+    size_t slot = get_slot(value.pp);
+    const std::vector<entry> &bucket = this->buckets.at(slot);
+
+    auto position = std::lower_bound(bucket.begin(), bucket.end(), value, ranks_before) - bucket.begin();
+
+    return this->prefix(slot - 1) + (int32_t) position + 1;
+}
+
+int32_t shiro::ranking::rank_index::user_at(int32_t rank) const {
+    size_t slot = this->find(rank);
+    const std::vector<entry> &bucket = this->buckets.at(slot);
+
+    return bucket.at(rank - this->prefix(slot - 1) - 1).user_id;
+}
+
+void shiro::ranking::rank_index::collect(std::vector<rank_change> &changes, int32_t from, int32_t to) const {
+    for (int32_t rank = from; rank <= to; rank++) {
+        changes.emplace_back(this->user_at(rank), rank);
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_RANK_INDEX_HH
+#define SHIRO_RANK_INDEX_HH
+
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace shiro::ranking {
+
+    // Order-statistic index over the pp of every ranked user in one play mode.
+    // Users are ordered by pp (descending) and user id, which makes their rank unique.
+    // A Fenwick tree over integer pp buckets answers rank-by-user and user-by-rank
+    // queries as well as updates in O(log n).
+    class rank_index {
+    public:
+        // Pair of user id and the rank this user has now
+        using rank_change = std::pair<int32_t, int32_t>;
+
+        void build(const std::vector<std::pair<int32_t, float>> &users);
+
+        // Both return every user whose rank has changed, including the updated user
+        std::vector<rank_change> update(int32_t user_id, float pp);
+        std::vector<rank_change> remove(int32_t user_id);
+
+        int32_t get_rank(int32_t user_id) const;
+        int32_t get_user(int32_t rank) const;
+        float get_pp(int32_t user_id) const;
+
+        bool contains(int32_t user_id) const;
+        size_t size() const;
+
+    private:
+        struct entry {
+            float pp = 0.0f;
+            int32_t user_id = 0;
+        };
+
+        static constexpr size_t bucket_count = 1 << 15;
+
+        static bool ranks_before(const entry &left, const entry &right);
+        static size_t get_slot(float pp);
+
+        void add(size_t slot, int32_t delta);
+        int32_t prefix(size_t slot) const;
+        size_t find(int32_t rank) const;
+
+        int32_t rank_of(const entry &value) const;
+        int32_t user_at(int32_t rank) const;
+
+        void collect(std::vector<rank_change> &changes, int32_t from, int32_t to) const;
+
+        std::vector<int32_t> tree = std::vector<int32_t>(bucket_count + 1, 0);
+        std::unordered_map<size_t, std::vector<entry>> buckets;
+        std::unordered_map<int32_t, float> users;
+
+        mutable std::shared_timed_mutex mutex;
+
+    };
+
+}
+
+#endif //SHIRO_RANK_INDEX_HH
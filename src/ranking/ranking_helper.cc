@@ -16,139 +16,94 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../database/tables/punishments_table.hh"
 #include "../database/tables/user_table.hh"
 #include "../pp/pp_recalculator.hh"
+#include "../thirdparty/loguru.hh"
 #include "../users/user_activity.hh"
 #include "../users/user_manager.hh"
 #include "../users/user_punishments.hh"
 #include "../utils/play_mode.hh"
+#include "../utils/punishment_type.hh"
+#include "../shiro.hh"
+#include "rank_index.hh"
 #include "ranking_helper.hh"
 
-int32_t shiro::ranking::helper::get_leaderboard_position(uint8_t mode, std::string username) {
-    if (username.empty())
-        return 0;
+namespace shiro::ranking::helper {
 
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::users user_table {};
+    // One index per play mode, indexed by the numeric value of utils::play_mode
+    static std::array<rank_index, 4> indexes;
 
-    auto result = db(select(all_of(user_table)).from(user_table).unconditionally());
+    // Serializes index updates with the rank write back, so concurrent score submissions
+    // cannot persist ranks out of order
+    static std::array<std::mutex, 4> write_mutexes;
 
-    if (result.empty())
-        return 0;
+    // Usernames of ranked users, so leaderboard lookups don't need the database
+    static std::unordered_map<int32_t, std::string> names;
+    static std::unordered_map<std::string, int32_t> ids;
+    static std::shared_timed_mutex names_mutex;
 
-    std::vector<std::pair<std::string, float>> users;
+    static void remember_name(int32_t user_id, const std::string &username);
+    static int32_t get_ranked_id(const std::string &username);
+    static std::string get_ranked_name(int32_t user_id);
 
-    for (const auto &row : result) {
-        if ((int32_t) row.id == 1)
-            continue;
+    static std::unordered_set<int32_t> fetch_punished_users();
 
-        if (!users::punishments::has_scores(row.id))
-            continue;
+    static void persist(const utils::play_mode &mode, const std::vector<rank_index::rank_change> &changes);
+    // The updated user is always sent out, their pp and accuracy changed even if their rank did not
+    static void publish(const utils::play_mode &mode, const std::vector<rank_index::rank_change> &changes, int32_t updated_user_id = 0);
 
-        switch (mode) {
-            case (uint8_t) utils::play_mode::standard:
-                users.emplace_back(std::make_pair(row.username, row.pp_std));
-                break;
-            case (uint8_t) utils::play_mode::taiko:
-                users.emplace_back(std::make_pair(row.username, row.pp_taiko));
-                break;
-            case (uint8_t) utils::play_mode::fruits:
-                users.emplace_back(std::make_pair(row.username, row.pp_ctb));
-                break;
-            case (uint8_t) utils::play_mode::mania:
-                users.emplace_back(std::make_pair(row.username, row.pp_mania));
-                break;
-        }
-    }
+}
 
-    std::sort(users.begin(), users.end(), [](const std::pair<std::string, float> &s_left, const std::pair<std::string, float> &s_right) {
-        return s_left.second > s_right.second;
-    });
+int32_t shiro::ranking::helper::get_leaderboard_position(uint8_t mode, std::string username) {
+    if (username.empty() || mode >= indexes.size())
+        return 0;
 
-    for (size_t i = 0; i < users.size(); i++) {
-        const auto &[name, _] = users.at(i);
+    int32_t user_id = get_ranked_id(username);
 
-        if (username == name)
-            return i + 1;
-    }
+    if (user_id == 0)
+        return 0;
 
-    return 0;
+    return indexes.at(mode).get_rank(user_id);
 }
 
 std::string shiro::ranking::helper::get_leaderboard_user(uint8_t mode, int32_t pos) {
-    if (pos < 1)
+    if (pos < 1 || mode >= indexes.size())
         return "";
 
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::users user_table {};
-
-    auto result = db(select(all_of(user_table)).from(user_table).unconditionally());
+    int32_t user_id = indexes.at(mode).get_user(pos);
 
-    if (result.empty())
+    if (user_id == 0)
         return "";
 
-    std::vector<std::pair<std::string, float>> users;
-
-    for (const auto &row : result) {
-        if ((int32_t) row.id == 1)
-            continue;
-
-        if (!users::punishments::has_scores(row.id))
-            continue;
-
-        switch (mode) {
-            case (uint8_t) utils::play_mode::standard:
-                users.emplace_back(std::make_pair(row.username, row.pp_std));
-                break;
-            case (uint8_t) utils::play_mode::taiko:
-                users.emplace_back(std::make_pair(row.username, row.pp_taiko));
-                break;
-            case (uint8_t) utils::play_mode::fruits:
-                users.emplace_back(std::make_pair(row.username, row.pp_ctb));
-                break;
-            case (uint8_t) utils::play_mode::mania:
-                users.emplace_back(std::make_pair(row.username, row.pp_mania));
-                break;
-        }
-    }
-
-    std::sort(users.begin(), users.end(), [](const std::pair<std::string, float> &s_left, const std::pair<std::string, float> &s_right) {
-        return s_left.second > s_right.second;
-    });
-
-    try {
-        return users.at(pos - 1).first;
-    } catch (const std::out_of_range &ex) {
-        return "";
-    }
+    return get_ranked_name(user_id);
 }
 
 int16_t shiro::ranking::helper::get_pp_for_user(uint8_t mode, std::string username) {
-    if (username.empty())
+    if (username.empty() || mode >= indexes.size())
         return 0;
 
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::users user_table {};
-
-    auto result = db(select(all_of(user_table)).from(user_table).where(user_table.username == username).limit(1u));
+    int32_t user_id = get_ranked_id(username);
 
-    if (result.empty())
+    if (user_id == 0)
         return 0;
 
-    const auto &row = result.front();
+    return (int16_t) indexes.at(mode).get_pp(user_id);
+}
 
-    switch (mode) {
-        case (uint8_t) utils::play_mode::standard:
-            return row.pp_std;
-        case (uint8_t) utils::play_mode::taiko:
-            return row.pp_taiko;
-        case (uint8_t) utils::play_mode::fruits:
-            return row.pp_ctb;
-        case (uint8_t) utils::play_mode::mania:
-            return row.pp_mania;
-    }
+void shiro::ranking::helper::init() {
+    for (uint8_t mode = 0; mode < indexes.size(); mode++) {
+        recalculate_ranks((utils::play_mode) mode);
 
-    return 0;
+        LOG_F(INFO, "Ranked %lu users in %s.", indexes.at(mode).size(), utils::play_mode_to_string((utils::play_mode) mode).c_str());
+    }
 }
 
 void shiro::ranking::helper::recalculate_ranks(const shiro::utils::play_mode &mode) {
@@ -156,14 +111,20 @@ void shiro::ranking::helper::recalculate_ranks(const shiro::utils::play_mode &mo
     if (pp::recalculator::in_progess())
         return;
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    size_t index = (size_t) mode;
+
+    if (index >= indexes.size())
+        return;
+
+    std::lock_guard<std::mutex> lock(write_mutexes.at(index));
+
+    auto db = db_connection->get_connection();
     const tables::users user_table {};
 
     auto result = db(select(all_of(user_table)).from(user_table).unconditionally());
 
-    if (result.empty())
-        return;
-
+    std::unordered_set<int32_t> punished_users = fetch_punished_users();
+    std::unordered_map<int32_t, int32_t> stored_ranks;
     std::vector<std::pair<int32_t, float>> users;
 
     for (const auto &row : result) {
@@ -176,106 +137,260 @@ void shiro::ranking::helper::recalculate_ranks(const shiro::utils::play_mode &mo
         //if (users::activity::is_inactive(row.id, mode))
         //    continue;
 
-        if (!users::punishments::has_scores(row.id))
+        if (punished_users.find((int32_t) row.id) != punished_users.end())
             continue;
 
+        remember_name((int32_t) row.id, row.username);
+
         switch (mode) {
             case utils::play_mode::standard:
                 if ((int32_t) row.play_count_std <= 0)
                     continue;
 
                 users.emplace_back(std::make_pair<int32_t, float>(row.id, row.pp_std));
+                stored_ranks.emplace((int32_t) row.id, (int32_t) row.rank_std);
                 break;
             case utils::play_mode::taiko:
                 if ((int32_t) row.play_count_taiko <= 0)
                     continue;
 
                 users.emplace_back(std::make_pair<int32_t, float>(row.id, row.pp_taiko));
+                stored_ranks.emplace((int32_t) row.id, (int32_t) row.rank_taiko);
                 break;
             case utils::play_mode::fruits:
                 if ((int32_t) row.play_count_ctb <= 0)
                     continue;
 
                 users.emplace_back(std::make_pair<int32_t, float>(row.id, row.pp_ctb));
+                stored_ranks.emplace((int32_t) row.id, (int32_t) row.rank_ctb);
                 break;
             case utils::play_mode::mania:
                 if ((int32_t) row.play_count_mania <= 0)
                     continue;
 
                 users.emplace_back(std::make_pair<int32_t, float>(row.id, row.pp_mania));
+                stored_ranks.emplace((int32_t) row.id, (int32_t) row.rank_mania);
                 break;
         }
     }
 
-    std::sort(users.begin(), users.end(), [](const std::pair<int32_t, float> &s_left, const std::pair<int32_t, float> &s_right) {
-        return s_left.second > s_right.second;
-    });
+    rank_index &ranks = indexes.at(index);
+    ranks.build(users);
 
-    // At this point, the users array is sorted by rank, this means the 0th element is rank #1
+    // Only write back and send out ranks that differ from what is already stored
+    std::vector<rank_index::rank_change> changes;
 
-    for (size_t i = 0; i < users.size(); i++) {
-        auto [user_id, pp] = users.at(i);
-        int32_t rank = (int32_t) i + 1;
+    for (const auto &[user_id, rank] : stored_ranks) {
+        int32_t new_rank = ranks.get_rank(user_id);
 
-        std::shared_ptr<users::user> user = users::manager::get_user_by_id(user_id);
+        if (new_rank != rank)
+            changes.emplace_back(user_id, new_rank);
+    }
 
-        switch (mode) {
-            case utils::play_mode::standard:
-                db(update(user_table).set(
-                        user_table.rank_std = rank
-                ).where(user_table.id == user_id));
-
-                if (user != nullptr && user->stats.play_mode == (uint8_t) utils::play_mode::standard) {
-                    user->stats.rank = rank;
-                    user->presence.rank = rank;
-                }
-                break;
-            case utils::play_mode::taiko:
-                db(update(user_table).set(
-                        user_table.rank_taiko = rank
-                ).where(user_table.id == user_id));
-
-                if (user != nullptr && user->stats.play_mode == (uint8_t) utils::play_mode::taiko) {
-                    user->stats.rank = rank;
-                    user->presence.rank = rank;
-                }
-                break;
-            case utils::play_mode::fruits:
-                db(update(user_table).set(
-                        user_table.rank_ctb = rank
-                ).where(user_table.id == user_id));
-
-                if (user != nullptr && user->stats.play_mode == (uint8_t) utils::play_mode::fruits) {
-                    user->stats.rank = rank;
-                    user->presence.rank = rank;
-                }
-                break;
-            case utils::play_mode::mania:
-                db(update(user_table).set(
-                        user_table.rank_mania = rank
-                ).where(user_table.id == user_id));
-
-                if (user != nullptr && user->stats.play_mode == (uint8_t) utils::play_mode::mania) {
-                    user->stats.rank = rank;
-                    user->presence.rank = rank;
-                }
-                break;
+    persist(mode, changes);
+    publish(mode, changes);
+}
+
+void shiro::ranking::helper::update_user(const shiro::utils::play_mode &mode, int32_t user_id, float pp) {
+    // Global pp recalculation is currently in progress.
+    if (pp::recalculator::in_progess())
+        return;
+
+    size_t index = (size_t) mode;
+
+    if (index >= indexes.size() || user_id == 1)
+        return;
+
+    if (get_ranked_name(user_id).empty())
+        remember_name(user_id, users::manager::get_username_by_id(user_id));
+
+    std::vector<rank_index::rank_change> changes;
+
+    {
+        std::lock_guard<std::mutex> lock(write_mutexes.at(index));
+
+        changes = indexes.at(index).update(user_id, pp);
+        persist(mode, changes);
+    }
+
+    publish(mode, changes, user_id);
+}
+
+void shiro::ranking::helper::remove_user(int32_t user_id) {
+    for (size_t index = 0; index < indexes.size(); index++) {
+        utils::play_mode mode = (utils::play_mode) index;
+        std::vector<rank_index::rank_change> changes;
+
+        {
+            std::lock_guard<std::mutex> lock(write_mutexes.at(index));
+
+            changes = indexes.at(index).remove(user_id);
+            persist(mode, changes);
+        }
+
+        publish(mode, changes);
+    }
+}
+
+void shiro::ranking::helper::restore_user(int32_t user_id) {
+    if (!users::punishments::has_scores(user_id))
+        return;
+
+    auto db = db_connection->get_connection();
+    const tables::users user_table {};
+
+    auto result = db(select(all_of(user_table)).from(user_table).where(user_table.id == user_id).limit(1u));
+
+    if (result.empty())
+        return;
+
+    const auto &row = result.front();
+    remember_name(user_id, row.username);
+
+    if ((int32_t) row.play_count_std > 0)
+        update_user(utils::play_mode::standard, user_id, row.pp_std);
+
+    if ((int32_t) row.play_count_taiko > 0)
+        update_user(utils::play_mode::taiko, user_id, row.pp_taiko);
+
+    if ((int32_t) row.play_count_ctb > 0)
+        update_user(utils::play_mode::fruits, user_id, row.pp_ctb);
+
+    if ((int32_t) row.play_count_mania > 0)
+        update_user(utils::play_mode::mania, user_id, row.pp_mania);
+}
+
+void shiro::ranking::helper::remember_name(int32_t user_id, const std::string &username) {
+    if (username.empty())
+        return;
+
+    std::unique_lock<std::shared_timed_mutex> lock(names_mutex);
+
+    names.insert_or_assign(user_id, username);
+    ids.insert_or_assign(username, user_id);
+}
+
+int32_t shiro::ranking::helper::get_ranked_id(const std::string &username) {
+    std::shared_lock<std::shared_timed_mutex> lock(names_mutex);
+    auto iterator = ids.find(username);
+
+    if (iterator == ids.end())
+        return 0;
+
+    return iterator->second;
+}
+
+std::string shiro::ranking::helper::get_ranked_name(int32_t user_id) {
+    std::shared_lock<std::shared_timed_mutex> lock(names_mutex);
+    auto iterator = names.find(user_id);
+
+    if (iterator == names.end())
+        return "";
+
+    return iterator->second;
+}
+
+std::unordered_set<int32_t> shiro::ranking::helper::fetch_punished_users() {
+    auto db = db_connection->get_connection();
+    const tables::punishments punishments_table {};
+
+    auto result = db(select(punishments_table.user_id).from(punishments_table).where(
+            punishments_table.active == true and (
+                punishments_table.type == (uint16_t) utils::punishment_type::restrict or
+                punishments_table.type == (uint16_t) utils::punishment_type::ban
+            )
+    ));
+
+    std::unordered_set<int32_t> users;
+
+    for (const auto &row : result) {
+        users.emplace((int32_t) row.user_id);
+    }
+
+    return users;
+}
+
+void shiro::ranking::helper::persist(const shiro::utils::play_mode &mode, const std::vector<rank_index::rank_change> &changes) {
+    if (changes.empty())
+        return;
+
+    std::string column;
+
+    switch (mode) {
+        case utils::play_mode::standard:
+            column = "rank_std";
+            break;
+        case utils::play_mode::taiko:
+            column = "rank_taiko";
+            break;
+        case utils::play_mode::fruits:
+            column = "rank_ctb";
+            break;
+        case utils::play_mode::mania:
+            column = "rank_mania";
+            break;
+    }
+
+    // Write changed ranks in batches instead of one update per user, the statement only contains integers
+    constexpr size_t batch_size = 500;
+    auto db = db_connection->get_connection();
+
+    for (size_t offset = 0; offset < changes.size(); offset += batch_size) {
+        size_t end = std::min(offset + batch_size, changes.size());
+
+        std::string cases;
+        std::string ids;
+
+        for (size_t i = offset; i < end; i++) {
+            const auto &[user_id, rank] = changes.at(i);
+
+            cases += " WHEN " + std::to_string(user_id) + " THEN " + std::to_string(rank);
+
+            if (!ids.empty())
+                ids += ", ";
+
+            ids += std::to_string(user_id);
         }
+
+        db->execute("UPDATE `users` SET " + column + " = CASE id" + cases + " ELSE " + column + " END WHERE id IN (" + ids + ");");
     }
+}
 
+void shiro::ranking::helper::publish(const shiro::utils::play_mode &mode, const std::vector<rank_index::rank_change> &changes, int32_t updated_user_id) {
     io::osu_writer writer;
+    bool updated = false;
+    bool updated_user_sent = false;
+
+    for (const auto &[user_id, rank] : changes) {
+        std::shared_ptr<users::user> user = users::manager::get_user_by_id(user_id);
 
-    // First we add all user stats/presence updates to the global writer
-    users::manager::iterate([&writer](std::shared_ptr<users::user> online_user) {
-        if (online_user->hidden)
-            return;
+        if (user == nullptr || user->stats.play_mode != (uint8_t) mode)
+            continue;
+
+        user->stats.rank = rank;
+        user->presence.rank = rank;
+
+        if (user->hidden)
+            continue;
+
+        writer.user_stats(user->stats);
+        writer.user_presence(user->presence);
+        updated = true;
 
-        writer.user_stats(online_user->stats);
-        writer.user_presence(online_user->presence);
-    }, true);
+        if (user_id == updated_user_id)
+            updated_user_sent = true;
+    }
+
+    if (updated_user_id != 0 && !updated_user_sent) {
+        std::shared_ptr<users::user> user = users::manager::get_user_by_id(updated_user_id);
+
+        if (user != nullptr && user->stats.play_mode == (uint8_t) mode && !user->hidden) {
+            writer.user_stats(user->stats);
+            updated = true;
+        }
+    }
 
-    // After we have all user updates in the writer, we can send them out globally
-    users::manager::iterate([&writer](std::shared_ptr<users::user> online_user) {
-        online_user->queue.enqueue(writer);
-    }, true);
+    // Other users are only sent out if their rank actually moved
+    if (updated)
+        users::manager::broadcast(writer);
 }
@@ -28,14 +28,26 @@
 
 namespace shiro::ranking::helper {
 
+    // Leaderboard lookups are answered from the in-memory rank index and never hit the database
     int32_t get_leaderboard_position(uint8_t mode, std::string username);
 
     std::string get_leaderboard_user(uint8_t mode, int32_t pos);
 
     int16_t get_pp_for_user(uint8_t mode, std::string username);
 
+    // Builds the in-memory rank index of every play mode, needs to be called once on startup
+    void init();
+
+    // Rebuilds the rank index of a play mode from the database
     void recalculate_ranks(const utils::play_mode &mode);
 
+    // Moves a user in the rank index after their pp changed, only users whose rank moved are updated
+    void update_user(const utils::play_mode &mode, int32_t user_id, float pp);
+
+    // Removes or re-adds a user to the rank index of every play mode, used for punishments
+    void remove_user(int32_t user_id);
+    void restore_user(int32_t user_id);
+
 }
 
 #endif //SHIRO_RANKING_HELPER_HH
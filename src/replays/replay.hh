@@ -20,9 +20,9 @@
 #define SHIRO_REPLAY_HH
 
 #include <string>
-#include <vector>
 
 #include "../scores/score.hh"
+#include "replay_frames.hh"
 
 namespace shiro::replays {
 
@@ -42,7 +42,7 @@ namespace shiro::replays {
     class replay {
     private:
         scores::score score;
-        std::vector<action> actions;
+        replays::frames columns;
         std::string raw_replay;
 
     public:
@@ -50,7 +50,7 @@ namespace shiro::replays {
 
         void parse();
 
-        std::vector<action> get_actions();
+        const replays::frames &get_frames() const;
 
         std::string to_string() const;
 
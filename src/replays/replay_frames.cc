@@ -0,0 +1,220 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <lzma.h>
+
+#include "replay.hh"
+#include "replay_frames.hh"
+
+namespace shiro::replays {
+
+    // Decoded data is handed to the parser in chunks of this size, frames are well below 64 bytes
+    constexpr size_t chunk_size = 16 * 1024;
+
+    // Longest coordinate that is parsed, osu! writes at most a handful of digits
+    constexpr size_t max_float_length = 31;
+
+    static void parse_frame(const char *position, const char *end, frames &result);
+
+    static const char *parse_float(const char *position, const char *end, float &result);
+
+}
+
+size_t shiro::replays::frames::size() const {
+    return this->time_deltas.size();
+}
+
+bool shiro::replays::frames::empty() const {
+    return this->time_deltas.empty();
+}
+
+void shiro::replays::frames::reserve(size_t amount) {
+    this->time_deltas.reserve(amount);
+    this->x.reserve(amount);
+    this->y.reserve(amount);
+    this->keys.reserve(amount);
+}
+
+void shiro::replays::frames::clear() {
+    this->time_deltas.clear();
+    this->x.clear();
+    this->y.clear();
+    this->keys.clear();
+}
+
+shiro::replays::action shiro::replays::frames::at(size_t index) const {
+    action result;
+
+    result.w = this->time_deltas.at(index);
+    result.x = this->x.at(index);
+    result.y = this->y.at(index);
+    result.z = this->keys.at(index);
+
+    return result;
+}
+
+bool shiro::replays::decode_frames(std::string_view compressed, frames &result) {
+    lzma_stream stream = LZMA_STREAM_INIT;
+
+    // osu! writes replays in the legacy .lzma format, the auto decoder also accepts .xz
+    if (lzma_auto_decoder(&stream, UINT64_MAX, 0) != LZMA_OK)
+        return false;
+
+    // Roughly one frame per eight compressed bytes
+    result.reserve(result.size() + compressed.size() / 8);
+
+    char buffer[chunk_size];
+    size_t pending = 0;
+    bool skipping = false;
+
+    stream.next_in = reinterpret_cast<const uint8_t*>(compressed.data());
+    stream.avail_in = compressed.size();
+
+    lzma_ret status = LZMA_OK;
+
+    while (status == LZMA_OK) {
+        stream.next_out = reinterpret_cast<uint8_t*>(buffer + pending);
+        stream.avail_out = chunk_size - pending;
+
+        status = lzma_code(&stream, LZMA_FINISH);
+
+        const char *begin = buffer;
+        const char *end = buffer + chunk_size - stream.avail_out;
+        const char *last = end;
+
+        while (last != begin && *(last - 1) != ',') {
+            last--;
+        }
+
+        if (last == begin) {
+            // A chunk without a single separator can't contain a valid frame, drop it until the next one
+            if (end - begin == (std::ptrdiff_t) chunk_size) {
+                pending = 0;
+                skipping = true;
+                continue;
+            }
+
+            pending = end - begin;
+            continue;
+        }
+
+        if (skipping) {
+            begin = static_cast<const char*>(std::memchr(begin, ',', last - begin)) + 1;
+            skipping = false;
+        }
+
+        parse_frames(std::string_view(begin, last - begin), result);
+
+        pending = end - last;
+        std::memmove(buffer, last, pending);
+    }
+
+    lzma_end(&stream);
+
+    if (status != LZMA_STREAM_END) {
+        result.clear();
+        return false;
+    }
+
+    // Replays don't necessarily end with a separator
+    if (!skipping)
+        parse_frames(std::string_view(buffer, pending), result);
+
+    return true;
+}
+
+void shiro::replays::parse_frames(std::string_view decompressed, frames &result) {
+    const char *position = decompressed.data();
+    const char *end = position + decompressed.size();
+
+    while (position < end) {
+        const char *frame_end = static_cast<const char*>(std::memchr(position, ',', end - position));
+
+        if (frame_end == nullptr)
+            frame_end = end;
+
+        parse_frame(position, frame_end, result);
+        position = frame_end + 1;
+    }
+}
+
+void shiro::replays::parse_frame(const char *position, const char *end, frames &result) {
+    int64_t w = 0;
+    float x = 0.0f;
+    float y = 0.0f;
+    int32_t z = 0;
+
+    std::from_chars_result parsed = std::from_chars(position, end, w);
+
+    if (parsed.ec != std::errc() || parsed.ptr == end || *parsed.ptr != '|')
+        return;
+
+    // Floating point from_chars is missing from libstdc++ 8 and libc++, coordinates go through strtof instead
+    const char *field = parse_float(parsed.ptr + 1, end, x);
+
+    if (field == nullptr || field == end || *field != '|')
+        return;
+
+    field = parse_float(field + 1, end, y);
+
+    if (field == nullptr || field == end || *field != '|')
+        return;
+
+    parsed = std::from_chars(field + 1, end, z);
+
+    // Additional fields after the buttons are ignored
+    if (parsed.ec != std::errc() || (parsed.ptr != end && *parsed.ptr != '|'))
+        return;
+
+    result.time_deltas.push_back(w);
+    result.x.push_back(x);
+    result.y.push_back(y);
+    result.keys.push_back(z);
+}
+
+const char *shiro::replays::parse_float(const char *position, const char *end, float &result) {
+    const char *field_end = static_cast<const char*>(std::memchr(position, '|', end - position));
+
+    if (field_end == nullptr)
+        field_end = end;
+
+    size_t length = field_end - position;
+
+    // strtof needs a terminated string and would otherwise accept leading whitespace
+    if (length == 0 || length > max_float_length || std::isspace(static_cast<unsigned char>(*position)))
+        return nullptr;
+
+    char field[max_float_length + 1];
+    std::memcpy(field, position, length);
+    field[length] = '\0';
+
+    char *parsed_end = nullptr;
+    errno = 0;
+
+    result = std::strtof(field, &parsed_end);
+
+    if (parsed_end != field + length || errno == ERANGE)
+        return nullptr;
+
+    return field_end;
+}
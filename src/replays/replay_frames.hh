@@ -0,0 +1,58 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_REPLAY_FRAMES_HH
+#define SHIRO_REPLAY_FRAMES_HH
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace shiro::replays {
+
+    class action;
+
+    // Replay frames stored column by column, index i of every column belongs to the same frame
+    struct frames {
+        std::vector<int64_t> time_deltas;
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<int32_t> keys;
+
+        size_t size() const;
+
+        bool empty() const;
+
+        void reserve(size_t amount);
+
+        void clear();
+
+        action at(size_t index) const;
+
+    };
+
+    // Decompresses a replay (.lzma or .xz) and parses frames while it is being decoded.
+    // Returns false and leaves result empty if the stream is invalid or truncated.
+    bool decode_frames(std::string_view compressed, frames &result);
+
+    // Parses already decompressed w|x|y|z, frames, malformed frames are skipped
+    void parse_frames(std::string_view decompressed, frames &result);
+
+}
+
+#endif //SHIRO_REPLAY_FRAMES_HH
@@ -20,11 +20,19 @@
 
 #include <boost/iostreams/filtering_streambuf.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
-#include <boost/iostreams/filter/lzma.hpp> // Segfaults: https://stackoverflow.com/questions/50071513/c-boost-and-lzma-decompression
 #include <boost/iostreams/copy.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
 #include <fstream>
+#include <iterator>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 #include "../beatmaps/beatmap_helper.hh"
 #include "../config/score_submission_file.hh"
@@ -36,13 +44,89 @@
 #include "../utils/osu_string.hh"
 #include "../utils/time_utils.hh"
 #include "replay.hh"
+#include "replay_frames.hh"
 #include "replay_manager.hh"
 
-static fs::path dir = fs::current_path() / "replays";
+namespace shiro::replays {
+
+    // Everything needed to build the .osr file of a submitted score
+    struct job {
+        scores::score s;
+        std::string username = "";
+        int32_t game_version = 0;
+        std::shared_ptr<const std::string> replay = nullptr;
+
+        uint32_t attempts = 0;
+        std::chrono::steady_clock::time_point retry_at;
+
+        bool spooled = false;
+    };
+
+    // Above this many queued replays they are saved on the submitting thread again
+    constexpr size_t max_queued = 256;
+    constexpr uint32_t max_attempts = 5;
+
+    static fs::path dir = fs::current_path() / "replays";
+
+    // Every queued replay is spooled here until its .osr has been written, leftovers are queued again on start
+    static fs::path spool_dir = dir / "spool";
+
+    static std::deque<job> ready;
+    static std::vector<job> delayed; // Waiting for their next attempt
+    static std::unordered_map<int32_t, std::shared_ptr<const std::string>> queued; // score id -> raw replay
+    static std::mutex mutex;
+    static std::condition_variable condition;
+    static std::thread worker;
+    static bool stopping = false;
+
+    static void process();
+    static bool write_replay(const job &j);
+
+    static bool spool(const job &j);
+    static void unspool(int32_t score_id);
+    static void load_spool();
+
+    static fs::path get_spool_path(int32_t score_id);
+
+    // Replays are spread over 256 directories by the last byte of their score id
+    static fs::path get_path(int32_t score_id);
+
+    // Writes into a temporary file first so readers never see a partially written replay
+    static bool write_file(const fs::path &path, const std::string &contents);
+
+    static bool skip_string(std::istream &stream);
+
+    // Moves replays from the old flat layout into their shard, zlib compressed replays are decompressed
+    static void migrate();
+
+}
 
 void shiro::replays::init() {
-    if (!fs::exists(dir))
-        fs::create_directories(dir);
+    for (uint32_t shard = 0; shard < 256; shard++) {
+        char name[3];
+        std::snprintf(name, sizeof(name), "%02x", shard);
+
+        fs::create_directories(dir / name);
+    }
+
+    fs::create_directories(spool_dir);
+
+    migrate();
+    load_spool();
+
+    worker = std::thread(process);
+}
+
+void shiro::replays::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    condition.notify_all();
+
+    if (worker.joinable())
+        worker.join();
 }
 
 void shiro::replays::save_replay(const shiro::scores::score &s, const beatmaps::beatmap &beatmap, int32_t game_version, std::string replay) {
@@ -52,14 +136,218 @@ void shiro::replays::save_replay(const shiro::scores::score &s, const beatmaps::
     if (!scores::helper::is_ranked(s, beatmap) && !config::score_submission::save_unranked_scores)
         return;
 
-    fs::path filename = dir / std::string(std::to_string(s.id) + ".osr");
     std::shared_ptr<users::user> user = users::manager::get_user_by_id(s.user_id);
 
     if (user == nullptr)
         return;
 
-    if (fs::exists(filename))
-        fs::remove(filename);
+    job j;
+    j.s = s;
+    j.username = user->presence.username;
+    j.game_version = game_version;
+    j.replay = std::make_shared<const std::string>(std::move(replay));
+
+    // The score is already stored, the raw replay has to be on disk before it is only held in memory
+    j.spooled = spool(j);
+
+    if (!j.spooled)
+        LOG_F(WARNING, "Unable to spool replay of score #%i, it will be lost if the server stops before it is saved.", s.id);
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // Keep the client waiting rather than queueing without bounds
+    if (stopping || ready.size() + delayed.size() >= max_queued) {
+        lock.unlock();
+
+        if (write_replay(j)) {
+            if (j.spooled)
+                unspool(s.id);
+
+            return;
+        }
+
+        if (j.spooled) {
+            LOG_F(ERROR, "Unable to save replay of score #%i, it will be saved again on the next start.", s.id);
+        } else {
+            LOG_F(ERROR, "Unable to save replay of score #%i, the replay has been lost.", s.id);
+        }
+
+        return;
+    }
+
+    queued.insert_or_assign(s.id, j.replay);
+    ready.emplace_back(std::move(j));
+
+    lock.unlock();
+    condition.notify_one();
+}
+
+std::string shiro::replays::calculate_diagram(const shiro::scores::score &s, std::string raw_replay) {
+    replays::frames frames;
+
+    if (!decode_frames(raw_replay, frames) || frames.empty())
+        return "";
+
+    std::stringstream stream;
+    const std::vector<float> &x = frames.x;
+    float last_x = 0.0f;
+
+    for (size_t i = 0; i < x.size(); i++) {
+        if (((x[i] - last_x) > 2000.0f) || (i == (x.size() - 1)) || (i == 0)) {
+            last_x = x[i];
+
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.2f|%.2f,", x[i], frames.y[i]);
+
+            stream << buffer;
+        }
+    }
+
+    return stream.str();
+}
+
+std::string shiro::replays::get_raw_replay(const shiro::scores::score &s) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iterator = queued.find(s.id);
+
+        if (iterator != queued.end())
+            return *iterator->second;
+    }
+
+    std::ifstream stream(get_path(s.id), std::ios::binary);
+
+    if (!stream)
+        return "";
+
+    // Only the header is parsed to find the replay frames, the rest of the file is never read
+    stream.ignore(5); // Play mode and game version
+
+    // Beatmap md5, username and replay hash
+    for (int32_t i = 0; i < 3; i++) {
+        if (!skip_string(stream))
+            return "";
+    }
+
+    stream.ignore(23); // Hit counts, score, combo, full combo and mods
+
+    if (!skip_string(stream)) // Life bar diagram
+        return "";
+
+    stream.ignore(8); // Timestamp
+
+    int32_t size = 0;
+    stream.read(reinterpret_cast<char*>(&size), sizeof(size));
+
+    if (!stream || size < 0)
+        return "";
+
+    std::string result;
+    result.resize((size_t) size);
+
+    stream.read(&result[0], size);
+
+    if (stream.gcount() != size)
+        return "";
+
+    return result;
+}
+
+bool shiro::replays::has_replay(const shiro::scores::score &s) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (queued.find(s.id) != queued.end())
+            return true;
+    }
+
+    return fs::exists(get_path(s.id));
+}
+
+void shiro::replays::process() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+
+        for (auto iterator = delayed.begin(); iterator != delayed.end();) {
+            if (iterator->retry_at > now && !stopping) {
+                iterator++;
+                continue;
+            }
+
+            ready.emplace_back(std::move(*iterator));
+            iterator = delayed.erase(iterator);
+        }
+
+        if (ready.empty()) {
+            if (stopping)
+                break;
+
+            if (delayed.empty()) {
+                condition.wait(lock);
+                continue;
+            }
+
+            auto next = std::min_element(delayed.begin(), delayed.end(), [](const job &left, const job &right) {
+                return left.retry_at < right.retry_at;
+            });
+
+            condition.wait_until(lock, next->retry_at);
+            continue;
+        }
+
+        job j = std::move(ready.front());
+        ready.pop_front();
+
+        lock.unlock();
+        bool saved = write_replay(j);
+        lock.lock();
+
+        if (saved) {
+            queued.erase(j.s.id);
+
+            if (j.spooled) {
+                lock.unlock();
+                unspool(j.s.id);
+                lock.lock();
+            }
+
+            continue;
+        }
+
+        j.attempts++;
+
+        if (j.attempts < max_attempts && !stopping) {
+            // 2, 4, 8 and 16 seconds
+            j.retry_at = std::chrono::steady_clock::now() + std::chrono::seconds(1 << j.attempts);
+
+            LOG_F(WARNING, "Unable to save replay of score #%i, trying again in %i seconds.", j.s.id, 1 << j.attempts);
+            delayed.emplace_back(std::move(j));
+            continue;
+        }
+
+        queued.erase(j.s.id);
+
+        if (j.spooled) {
+            LOG_F(ERROR, "Unable to save replay of score #%i, it will be saved again on the next start.", j.s.id);
+            continue;
+        }
+
+        lock.unlock();
+
+        if (spool(j)) {
+            LOG_F(ERROR, "Unable to save replay of score #%i, it will be saved again on the next start.", j.s.id);
+        } else {
+            LOG_F(ERROR, "Unable to save replay of score #%i, the replay has been lost.", j.s.id);
+        }
+
+        lock.lock();
+    }
+}
+
+bool shiro::replays::write_replay(const job &j) {
+    const scores::score &s = j.s;
 
     // Convert raw replay into full osu! replay file
     // Reference: https://osu.ppy.sh/help/wiki/osu!_File_Formats/Osr_(file_format)
@@ -70,17 +358,17 @@ void shiro::replays::save_replay(const shiro::scores::score &s, const beatmaps::
     std::snprintf(hash_buffer, sizeof(hash_buffer), "%ip%io%io%it%ia%sr%ie%sy%so%liu%s%i%s",
             s._100_count + s._300_count, s._50_count, s.gekis_count, s.katus_count, s.miss_count,
             s.beatmap_md5.c_str(), s.max_combo, s.fc ? "True" : "False",
-            user->presence.username.c_str(), s.total_score, s.rank.c_str(), s.mods, "True");
+            j.username.c_str(), s.total_score, s.rank.c_str(), s.mods, "True");
 
     std::string beatmap_md5 = utils::osu_string(s.beatmap_md5);
-    std::string username = utils::osu_string(user->presence.username);
+    std::string username = utils::osu_string(j.username);
     std::string hash = utils::osu_string(utils::crypto::md5::hash(hash_buffer));
-    std::string diagram = utils::osu_string(calculate_diagram(s, replay), true);
+    std::string diagram = utils::osu_string(calculate_diagram(s, *j.replay), true);
 
     io::buffer buffer;
 
     buffer.write<uint8_t>(s.play_mode);
-    buffer.write<int32_t>(game_version);
+    buffer.write<int32_t>(j.game_version);
 
     buffer.write_string(beatmap_md5);
     buffer.write_string(username);
@@ -101,106 +389,231 @@ void shiro::replays::save_replay(const shiro::scores::score &s, const beatmaps::
     buffer.write_string(diagram);
     buffer.write<int64_t>(utils::time::get_current_time_ticks());
 
-    buffer.write<int32_t>(replay.size());
-    buffer.write_string(replay);
+    buffer.write<int32_t>(j.replay->size());
+    buffer.write_string(*j.replay);
 
     buffer.write<int64_t>(s.id);
 
-    std::ofstream stream(filename, std::ios::trunc);
-    stream << buffer.serialize();
-    stream.close();
+    // Replay frames are already lzma compressed by the client, compressing the file again gains close to nothing
+    return write_file(get_path(s.id), buffer.release());
+}
 
-    // If the replay is bigger than 1 mib, compress it
-    // TODO: Implement a smarter compression method than zlib
-    if (fs::file_size(filename) >= 1048576) {
-        fs::remove(filename);
+bool shiro::replays::spool(const job &j) {
+    const scores::score &s = j.s;
+    io::buffer buffer;
+
+    buffer.write<int32_t>(s.id);
+    buffer.write<int32_t>(s.user_id);
+    buffer.write<uint8_t>(s.play_mode);
+    buffer.write<int32_t>(j.game_version);
+
+    buffer.write_string(utils::osu_string(s.beatmap_md5));
+    buffer.write_string(utils::osu_string(s.rank));
+    buffer.write_string(utils::osu_string(j.username));
+
+    buffer.write<int32_t>(s._300_count);
+    buffer.write<int32_t>(s._100_count);
+    buffer.write<int32_t>(s._50_count);
+    buffer.write<int32_t>(s.gekis_count);
+    buffer.write<int32_t>(s.katus_count);
+    buffer.write<int32_t>(s.miss_count);
 
-        filename = dir / std::string(std::to_string(s.id) + ".osr.zz");
+    buffer.write<int64_t>(s.total_score);
+    buffer.write<int32_t>(s.max_combo);
+    buffer.write<uint8_t>(s.fc);
+    buffer.write<uint8_t>(s.passed);
+    buffer.write<int32_t>(s.mods);
 
-        std::stringstream original;
-        std::stringstream compressed;
+    buffer.write<int32_t>(j.replay->size());
+    buffer.write_string(*j.replay);
 
-        original << buffer.serialize();
+    return write_file(get_spool_path(s.id), buffer.release());
+}
 
-        boost::iostreams::filtering_streambuf<boost::iostreams::input> output;
-        output.push(boost::iostreams::zlib_compressor());
-        output.push(original);
+void shiro::replays::unspool(int32_t score_id) {
+    std::error_code error;
+    fs::remove(get_spool_path(score_id), error);
+
+    if (error)
+        LOG_F(WARNING, "Unable to remove spooled replay of score #%i: %s", score_id, error.message().c_str());
+}
 
-        boost::iostreams::copy(output, compressed);
+void shiro::replays::load_spool() {
+    for (const fs::directory_entry &file : fs::directory_iterator(spool_dir)) {
+        if (!file.is_regular_file() || file.path().extension() != ".job")
+            continue;
 
-        stream = std::ofstream(filename, std::ios::trunc);
-        stream << compressed.str();
+        std::ifstream stream(file.path(), std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
         stream.close();
 
-        LOG_F(WARNING, "Uncompressed replay was >1mb, saved replay with zlib compression.");
+        io::buffer buffer(contents);
+        job j;
+        scores::score &s = j.s;
+
+        s.id = buffer.read<int32_t>();
+        s.user_id = buffer.read<int32_t>();
+        s.play_mode = buffer.read<uint8_t>();
+        j.game_version = buffer.read<int32_t>();
+
+        s.beatmap_md5 = buffer.read_string();
+        s.rank = buffer.read_string();
+        j.username = buffer.read_string();
+
+        s._300_count = buffer.read<int32_t>();
+        s._100_count = buffer.read<int32_t>();
+        s._50_count = buffer.read<int32_t>();
+        s.gekis_count = buffer.read<int32_t>();
+        s.katus_count = buffer.read<int32_t>();
+        s.miss_count = buffer.read<int32_t>();
+
+        s.total_score = buffer.read<int64_t>();
+        s.max_combo = buffer.read<int32_t>();
+        s.fc = buffer.read<uint8_t>();
+        s.passed = buffer.read<uint8_t>();
+        s.mods = buffer.read<int32_t>();
+
+        int32_t size = buffer.read<int32_t>();
+
+        if (size < 0 || !buffer.can_read((size_t) size)) {
+            LOG_F(ERROR, "Spooled replay %s is corrupted.", file.path().filename().u8string().c_str());
+            continue;
+        }
+
+        j.replay = std::make_shared<const std::string>(buffer.read_view((size_t) size));
+
+        // The spool file stays until the replay has been saved
+        j.spooled = true;
+
+        queued.insert_or_assign(s.id, j.replay);
+        ready.emplace_back(std::move(j));
     }
+
+    if (!ready.empty())
+        LOG_F(INFO, "Saving %lu replays that could not be saved earlier.", ready.size());
 }
 
-std::string shiro::replays::calculate_diagram(const shiro::scores::score &s, std::string raw_replay) {
-    std::unique_ptr<replays::replay> replay = std::make_unique<replays::replay>(s, raw_replay);
+fs::path shiro::replays::get_path(int32_t score_id) {
+    char shard[3];
+    std::snprintf(shard, sizeof(shard), "%02x", (uint32_t) score_id & 0xFF);
 
-    replay->parse();
+    return dir / shard / std::string(std::to_string(score_id) + ".osr");
+}
 
-    if (replay->get_actions().empty())
-        return "";
+fs::path shiro::replays::get_spool_path(int32_t score_id) {
+    return spool_dir / std::string(std::to_string(score_id) + ".job");
+}
 
-    std::stringstream stream;
-    float last_x = 0.0f;
+bool shiro::replays::write_file(const fs::path &path, const std::string &contents) {
+    fs::path temporary = path;
+    temporary += ".tmp";
 
-    for (size_t i = 0; i < replay->get_actions().size(); i++) {
-        replays::action action = replay->get_actions().at(i);
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        stream.write(contents.data(), contents.size());
 
-        if (((action.x - last_x) > 2000.0f) || (i == (replay->get_actions().size() - 1)) || (i == 0)) {
-            last_x = action.x;
+        if (!stream)
+            return false;
+    }
 
-            char buffer[32];
-            std::snprintf(buffer, sizeof(buffer), "%.2f|%.2f,", action.x, action.y);
+    std::error_code error;
+    fs::rename(temporary, path, error);
 
-            stream << buffer;
-        }
+    return !error;
+}
+
+bool shiro::replays::skip_string(std::istream &stream) {
+    int marker = stream.get();
+
+    if (marker == 0)
+        return true;
+
+    if (marker != 11)
+        return false;
+
+    uint64_t length = 0;
+    uint32_t shift = 0;
+
+    while (true) {
+        int byte = stream.get();
+
+        if (byte == std::istream::traits_type::eof() || shift > 63)
+            return false;
+
+        length |= (uint64_t) (byte & 0x7F) << shift;
+        shift += 7;
+
+        if ((byte & 0x80) == 0)
+            break;
     }
 
-    return stream.str();
+    stream.ignore((std::streamsize) length);
+    return (bool) stream;
 }
 
-std::string shiro::replays::get_replay(const shiro::scores::score &s) {
-    if (!has_replay(s))
-        return "";
+void shiro::replays::migrate() {
+    size_t migrated = 0;
 
-    fs::path filename = dir / std::string(std::to_string(s.id) + ".osr.zz");
-    std::stringstream result;
+    for (const fs::directory_entry &file : fs::directory_iterator(dir)) {
+        if (!file.is_regular_file())
+            continue;
 
-    if (fs::exists(filename)) {
-        std::ifstream stream = std::ifstream(filename);
+        const fs::path &path = file.path();
+        std::string name = path.filename().u8string();
+        bool compressed = path.extension() == ".zz";
 
-        std::stringstream original;
-        std::stringstream decompressed;
+        if (!compressed && path.extension() != ".osr")
+            continue;
 
-        original << stream.rdbuf();
+        int32_t score_id = 0;
 
-        stream.close();
+        try {
+            score_id = std::stoi(name.substr(0, name.find('.')));
+        } catch (const std::exception &ex) {
+            LOG_F(WARNING, "Skipping %s while moving replays into shards.", name.c_str());
+            continue;
+        }
 
-        boost::iostreams::filtering_streambuf<boost::iostreams::input> output;
-        output.push(boost::iostreams::zlib_decompressor());
-        output.push(original);
+        fs::path target = get_path(score_id);
 
-        boost::iostreams::copy(output, result);
+        if (!compressed) {
+            std::error_code error;
+            fs::rename(path, target, error);
 
-    } else {
-        filename = dir / std::string(std::to_string(s.id) + ".osr");
-        std::ifstream stream = std::ifstream(filename);
+            if (error) {
+                LOG_F(WARNING, "Unable to move replay %s into its shard: %s", name.c_str(), error.message().c_str());
+                continue;
+            }
 
-        result << stream.rdbuf();
+            migrated++;
+            continue;
+        }
+
+        std::ifstream stream(path, std::ios::binary);
+        std::stringstream decompressed;
+
+        try {
+            boost::iostreams::filtering_streambuf<boost::iostreams::input> input;
+            input.push(boost::iostreams::zlib_decompressor());
+            input.push(stream);
+
+            boost::iostreams::copy(input, decompressed);
+        } catch (const std::exception &ex) {
+            LOG_F(WARNING, "Unable to decompress replay %s: %s", name.c_str(), ex.what());
+            continue;
+        }
 
         stream.close();
-    }
 
-    return result.str();
-}
+        if (!write_file(target, decompressed.str())) {
+            LOG_F(WARNING, "Unable to move replay %s into its shard.", name.c_str());
+            continue;
+        }
 
-bool shiro::replays::has_replay(const shiro::scores::score &s) {
-    if (fs::exists(dir / std::string(std::to_string(s.id) + ".osr")))
-        return true;
+        fs::remove(path);
+        migrated++;
+    }
 
-    return fs::exists(dir / std::string(std::to_string(s.id) + ".osr.zz"));
+    if (migrated > 0)
+        LOG_F(INFO, "Moved %lu replays into shards.", migrated);
 }
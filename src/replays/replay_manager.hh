@@ -28,11 +28,16 @@ namespace shiro::replays {
 
     void init();
 
+    // Saves replays that are still queued
+    void destroy();
+
+    // Spools the raw replay to disk and queues it, the .osr file is built and written in the background
     void save_replay(const scores::score &s, const beatmaps::beatmap &beatmap, int32_t game_version, std::string replay);
 
     std::string calculate_diagram(const scores::score &s, std::string replay);
 
-    std::string get_replay(const scores::score &s);
+    // Only the lzma compressed replay frames, read straight from the .osr without loading the rest of it
+    std::string get_raw_replay(const scores::score &s);
 
     bool has_replay(const scores::score &s);
 
@@ -142,9 +142,12 @@ void shiro::routes::api::ci_trigger::handle(const crow::request &request, crow::
     io::osu_writer restart_writer;
     restart_writer.bancho_restart(10000);
 
-    users::manager::iterate([&announce_writer, &restart_writer](std::shared_ptr<users::user> user) {
-        user->queue.enqueue(announce_writer);
-        user->queue.enqueue_next(restart_writer);
+    io::packet_chunk announce_chunk = io::make_chunk(announce_writer);
+    io::packet_chunk restart_chunk = io::make_chunk(restart_writer);
+
+    users::manager::iterate([&announce_chunk, &restart_chunk](std::shared_ptr<users::user> user) {
+        user->queue.enqueue(announce_chunk);
+        user->queue.enqueue_next(restart_chunk);
     }, true);
 
     std::thread deploy_thread([]() {
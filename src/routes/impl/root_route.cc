@@ -89,7 +89,7 @@ void shiro::routes::root::handle(const crow::request &request, crow::response &r
     std::string result = writer.serialize();
 
     if (!user->queue.is_empty())
-        result.append(user->queue.serialize());
+        user->queue.serialize(result);
 
     response.end(result);
 }
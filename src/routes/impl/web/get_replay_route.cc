@@ -74,32 +74,16 @@ void shiro::routes::web::get_replay::handle(const crow::request &request, crow::
         return;
     }
 
-    if (!replays::has_replay(s)) {
+    // osu! only wants the raw replay frames, not the whole .osr file
+    std::string replay = replays::get_raw_replay(s);
+
+    if (replay.empty()) {
         response.code = 404;
         response.end();
         return;
     }
 
-    std::string replay = replays::get_replay(s);
-    io::buffer buffer(replay);
-    io::buffer replay_buffer;
-
-    // Extract raw replay
-    buffer.seek(5);
-    buffer.read_string();
-    buffer.read_string();
-    buffer.read_string();
-    buffer.advance(23);
-    buffer.read_string();
-    buffer.advance(8);
-
-    int32_t size = buffer.read<int32_t>();
-
-    for (int32_t i = 0; i < size; i++) {
-        replay_buffer.write<uint8_t>(buffer.read<uint8_t>());
-    }
-
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::scores score_table {};
 
     db(update(score_table).set(
@@ -108,5 +92,6 @@ void shiro::routes::web::get_replay::handle(const crow::request &request, crow::
 
     response.set_header("Content-Type", "application/zip");
     response.set_header("Content-Disposition", "attachment; filename=replay.osr");
-    response.end(replay_buffer.serialize());
+    response.body = std::move(replay);
+    response.end();
 }
@@ -16,10 +16,14 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include "../../../beatmaps/beatmap.hh"
 #include "../../../beatmaps/beatmap_helper.hh"
 #include "../../../geoloc/country_ids.hh"
 #include "../../../logger/sentry_logger.hh"
+#include "../../../replays/replay_manager.hh"
+#include "../../../scores/leaderboard_cache.hh"
 #include "../../../scores/score_helper.hh"
 #include "../../../thirdparty/loguru.hh"
 #include "../../../users/user_manager.hh"
@@ -79,12 +83,28 @@ void shiro::routes::web::get_scores::handle(const crow::request &request, crow::
 
     beatmap.fetch();
 
-    int32_t mods_list = (int32_t) utils::mods::none;
-    std::vector<scores::score> score_list;
+    uint8_t mode = user->stats.play_mode;
+    char *play_mode = request.url_params.get("m");
+
+    if (play_mode != nullptr) {
+        try {
+            mode = (uint8_t) boost::lexical_cast<int32_t>(play_mode);
+        } catch (const boost::bad_lexical_cast &ex) {
+            LOG_F(ERROR, "Unable to convert sent values to play mode: %s.", ex.what());
+            logging::sentry::exception(ex);
+
+            response.code = 500;
+            response.end();
+            return;
+        }
+    }
+
+    int32_t mods_list = scores::leaderboard_cache::any_mods;
 
     switch (scoreboard_type) {
-        case 1: {
-            score_list = scores::helper::fetch_all_scores(md5sum);
+        case 1:
+        case 3:
+        case 4: {
             break;
         }
         case 2: {
@@ -107,15 +127,6 @@ void shiro::routes::web::get_scores::handle(const crow::request &request, crow::
                 return;
             }
 
-            score_list = scores::helper::fetch_mod_scores(md5sum, mods_list);
-            break;
-        }
-        case 3: {
-            score_list = scores::helper::fetch_friend_scores(md5sum, user);
-            break;
-        }
-        case 4: {
-            score_list = scores::helper::fetch_country_scores(md5sum, geoloc::get_country_id(user->country));
             break;
         }
         default: {
@@ -125,24 +136,54 @@ void shiro::routes::web::get_scores::handle(const crow::request &request, crow::
         }
     }
 
-    std::string res = beatmap.build_header(score_list);
+    if (!beatmaps::helper::has_leaderboard(beatmaps::helper::fix_beatmap_status(beatmap.ranked_status))) {
+        response.end(beatmap.build_header(0));
+        return;
+    }
+
+    std::shared_ptr<const scores::leaderboard_cache::board> board = scores::leaderboard_cache::fetch(md5sum, mode, mods_list);
+    uint8_t country = geoloc::get_country_id(user->country);
+
+    // Friend and country rankings are filtered views of the global board
+    std::vector<const scores::leaderboard_cache::entry*> score_list;
 
-    if (beatmaps::helper::has_leaderboard(beatmaps::helper::fix_beatmap_status(beatmap.ranked_status))) {
+    for (const scores::leaderboard_cache::entry &entry : board->entries) {
+        if (scoreboard_type == 3 && entry.s.user_id != user->user_id &&
+            std::find(user->friends.begin(), user->friends.end(), entry.s.user_id) == user->friends.end())
+            continue;
+
+        if (scoreboard_type == 4 && entry.country != country)
+            continue;
+
+        score_list.emplace_back(&entry);
+    }
+
+    size_t displayed = std::min(score_list.size(), scores::leaderboard_cache::displayed_scores);
+    std::string res = beatmap.build_header(displayed);
+
+    auto own_entry = std::find_if(score_list.begin(), score_list.end(), [&user](const scores::leaderboard_cache::entry *entry) {
+        return entry->s.user_id == user->user_id;
+    });
+
+    if (own_entry != score_list.end()) {
+        int32_t position = (int32_t) (own_entry - score_list.begin()) + 1;
+        res.append((*own_entry)->s.to_string((*own_entry)->username, position, scores::leaderboard_cache::has_replay(**own_entry)));
+    } else if (user->hidden && scoreboard_type != 2) {
+        // Restricted players are not on public boards but still see their own best score
         scores::score top_score_user = scores::helper::fetch_top_score_user(beatmap.beatmap_md5, user);
 
         if (top_score_user.id == -1) {
             res.append("\n");
         } else {
-            if (scoreboard_type == 2 && top_score_user.mods != mods_list) {
-                res.append("\n");
-            } else {
-                res.append(top_score_user.to_string(score_list));
-            }
+            res.append(top_score_user.to_string(user->presence.username, -1, replays::has_replay(top_score_user)));
         }
+    } else {
+        res.append("\n");
+    }
 
-        for (scores::score &submitted_score : score_list) {
-            res.append(submitted_score.to_string(score_list));
-        }
+    for (size_t i = 0; i < displayed; i++) {
+        const scores::leaderboard_cache::entry *entry = score_list.at(i);
+        res.append(entry->s.to_string(entry->username, (int32_t) i + 1, scores::leaderboard_cache::has_replay(*entry)));
     }
 
     response.end(res);
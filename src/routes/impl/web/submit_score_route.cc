@@ -19,8 +19,11 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <memory>
+#include <sqlpp11/exception.h>
+#include <string>
 
 #include "../../../beatmaps/beatmap.hh"
+#include "../../../beatmaps/beatmap_counters.hh"
 #include "../../../beatmaps/beatmap_helper.hh"
 #include "../../../config/score_submission_file.hh"
 #include "../../../database/tables/score_table.hh"
@@ -28,9 +31,11 @@
 #include "../../../pp/pp_score_metric.hh"
 #include "../../../ranking/ranking_helper.hh"
 #include "../../../replays/replay_manager.hh"
+#include "../../../scores/leaderboard_cache.hh"
 #include "../../../scores/score.hh"
 #include "../../../scores/score_helper.hh"
 #include "../../../scores/table_display.hh"
+#include "../../../scores/top_plays.hh"
 #include "../../../thirdparty/loguru.hh"
 #include "../../../users/user.hh"
 #include "../../../users/user_manager.hh"
@@ -155,7 +160,7 @@ void shiro::routes::web::submit_score::handle(const crow::request &request, crow
         return;
     }
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::scores score_table {};
 
     int32_t game_version = 20131216;
@@ -237,8 +242,6 @@ void shiro::routes::web::submit_score::handle(const crow::request &request, crow
         return;
     }
 
-    user->stats.play_count++;
-
     beatmaps::beatmap beatmap;
     beatmap.beatmap_md5 = score.beatmap_md5;
 
@@ -248,7 +251,6 @@ void shiro::routes::web::submit_score::handle(const crow::request &request, crow
         beatmap.pass_count++;
 
     beatmap.play_count++;
-    beatmap.update_play_metadata();
 
     if (fields.find("replay-bin") == fields.end()) {
         response.code = 400;
@@ -321,27 +323,42 @@ void shiro::routes::web::submit_score::handle(const crow::request &request, crow
     std::unique_ptr<scores::table_display> display = std::make_unique<scores::table_display>(user, beatmap, score, legacy);
     display->init();
 
-    score.id = db(insert_into(score_table).set(
-            score_table.user_id = score.user_id,
-            score_table.hash = score.hash,
-            score_table.beatmap_md5 = score.beatmap_md5,
-            score_table.ranking = score.rank,
-            score_table.score = score.total_score,
-            score_table.max_combo = score.max_combo,
-            score_table.pp = score.pp,
-            score_table.accuracy = score.accuracy,
-            score_table.mods = score.mods,
-            score_table.fc = score.fc,
-            score_table.passed = score.passed,
-            score_table._300_count = score._300_count,
-            score_table._100_count = score._100_count,
-            score_table._50_count = score._50_count,
-            score_table.katus_count = score.katus_count,
-            score_table.gekis_count = score.gekis_count,
-            score_table.miss_count = score.miss_count,
-            score_table.play_mode = score.play_mode,
-            score_table.time = score.time
-    ));
+    // The unique hash index rejects a resubmission that got past the lookup above concurrently
+    try {
+        score.id = db(insert_into(score_table).set(
+                score_table.user_id = score.user_id,
+                score_table.hash = score.hash,
+                score_table.beatmap_md5 = score.beatmap_md5,
+                score_table.ranking = score.rank,
+                score_table.score = score.total_score,
+                score_table.max_combo = score.max_combo,
+                score_table.pp = score.pp,
+                score_table.accuracy = score.accuracy,
+                score_table.mods = score.mods,
+                score_table.fc = score.fc,
+                score_table.passed = score.passed,
+                score_table._300_count = score._300_count,
+                score_table._100_count = score._100_count,
+                score_table._50_count = score._50_count,
+                score_table.katus_count = score.katus_count,
+                score_table.gekis_count = score.gekis_count,
+                score_table.miss_count = score.miss_count,
+                score_table.play_mode = score.play_mode,
+                score_table.time = score.time
+        ));
+    } catch (const sqlpp::exception &ex) {
+        if (std::string(ex.what()).find("Duplicate entry") == std::string::npos)
+            throw;
+
+        response.end("error: dup");
+
+        LOG_F(WARNING, "%s resubmitted a previously submitted score.", user->presence.username.c_str());
+        return;
+    }
+
+    // Only count the play once the score is stored, a rejected duplicate must not count twice
+    user->stats.play_count++;
+    beatmaps::counters::add(beatmap, score.passed);
 
     if (overwrite)
         user->stats.total_score += score.total_score;
@@ -362,8 +379,11 @@ void shiro::routes::web::submit_score::handle(const crow::request &request, crow
         return;
     }
 
+    scores::leaderboard_cache::submit(score, user);
+    scores::top_plays::submit(score, beatmap);
+
     scores::score top_score = scores::helper::fetch_top_score_user(beatmap.beatmap_md5, user);
-    int32_t scoreboard_position = scores::helper::get_scoreboard_position(top_score, scores::helper::fetch_all_scores(beatmap.beatmap_md5, 5));
+    int32_t scoreboard_position = scores::leaderboard_cache::fetch(beatmap.beatmap_md5, score.play_mode)->get_position(user->user_id);
 
     if (top_score.hash == score.hash && !user->hidden) {
         if (scoreboard_position == 1) {
@@ -391,7 +411,7 @@ void shiro::routes::web::submit_score::handle(const crow::request &request, crow
     user->save_stats();
 
     if (overwrite && !user->hidden)
-        ranking::helper::recalculate_ranks((utils::play_mode) score.play_mode);
+        ranking::helper::update_user((utils::play_mode) score.play_mode, user->user_id, user->stats.pp);
 
     response.end(display->build());
 }
@@ -0,0 +1,218 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <exception>
+
+#include "../thirdparty/loguru.hh"
+#include "task_scheduler.hh"
+
+shiro::task_scheduler::context::context(clock::duration interval)
+    : interval(interval) {
+    // Initialized in initializer list
+}
+
+void shiro::task_scheduler::context::repeat() {
+    this->repeated = true;
+}
+
+void shiro::task_scheduler::context::repeat(clock::duration interval) {
+    this->repeated = true;
+    this->interval = interval;
+}
+
+bool shiro::task_scheduler::context::is_repeated() const {
+    return this->repeated;
+}
+
+shiro::task_scheduler::clock::duration shiro::task_scheduler::context::get_interval() const {
+    return this->interval;
+}
+
+shiro::task_scheduler::~task_scheduler() {
+    this->stop();
+}
+
+void shiro::task_scheduler::start(size_t worker_count) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    this->stopping = false;
+
+    for (size_t i = this->workers.size(); i < worker_count; i++) {
+        this->workers.emplace_back(&task_scheduler::work, this);
+    }
+}
+
+void shiro::task_scheduler::stop() {
+    std::vector<std::thread> threads;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        this->stopping = true;
+        this->pending.clear();
+
+        std::swap(threads, this->workers);
+    }
+
+    this->condition.notify_all();
+
+    for (std::thread &thread : threads) {
+        // Shutdown may be triggered from within a task, that worker exits once the task returns
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();
+            continue;
+        }
+
+        thread.join();
+    }
+}
+
+void shiro::task_scheduler::schedule(clock::duration delay, const std::string &name, task function) {
+    entry scheduled;
+
+    scheduled.name = name;
+    scheduled.interval = delay;
+    scheduled.function = std::move(function);
+
+    this->add(delay, std::move(scheduled));
+}
+
+void shiro::task_scheduler::schedule_every(clock::duration interval, const std::string &name, std::function<void()> function) {
+    this->schedule_every(interval, interval, name, std::move(function));
+}
+
+void shiro::task_scheduler::schedule_every(clock::duration delay, clock::duration interval, const std::string &name, std::function<void()> function) {
+    entry scheduled;
+
+    scheduled.name = name;
+    scheduled.interval = interval;
+    scheduled.repeating = true;
+    scheduled.function = [function = std::move(function)](context &) {
+        function();
+    };
+
+    this->add(delay, std::move(scheduled));
+}
+
+shiro::task_scheduler::statistics shiro::task_scheduler::get_statistics() {
+    statistics stats;
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    stats.workers = this->workers.size();
+    stats.pending = this->pending.size();
+    stats.running = this->running;
+
+    for (const auto &[name, task_stats] : this->metrics) {
+        stats.tasks.emplace_back(task_stats);
+    }
+
+    std::sort(stats.tasks.begin(), stats.tasks.end(), [](const task_statistics &left, const task_statistics &right) {
+        return left.name < right.name;
+    });
+
+    return stats;
+}
+
+void shiro::task_scheduler::add(clock::duration delay, entry scheduled) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        if (this->stopping)
+            return;
+
+        this->metrics[scheduled.name].name = scheduled.name;
+        this->pending.emplace(clock::now() + delay, std::move(scheduled));
+    }
+
+    this->condition.notify_one();
+}
+
+void shiro::task_scheduler::work() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    while (!this->stopping) {
+        if (this->pending.empty()) {
+            this->condition.wait(lock);
+            continue;
+        }
+
+        clock::time_point deadline = this->pending.begin()->first;
+
+        if (clock::now() < deadline) {
+            this->condition.wait_until(lock, deadline);
+            continue;
+        }
+
+        entry current = std::move(this->pending.begin()->second);
+        this->pending.erase(this->pending.begin());
+
+        task_statistics &task_stats = this->metrics[current.name];
+        task_stats.running = true;
+        this->running++;
+
+        lock.unlock();
+
+        // Another task may already be due, let the next worker pick it up while this one runs
+        this->condition.notify_one();
+
+        clock::time_point started = clock::now();
+        context ctx(current.interval);
+        bool failed = false;
+
+        try {
+            current.function(ctx);
+        } catch (const std::exception &ex) {
+            LOG_F(ERROR, "Scheduled task %s threw an exception: %s", current.name.c_str(), ex.what());
+            failed = true;
+        }
+
+        clock::time_point finished = clock::now();
+
+        lock.lock();
+
+        std::chrono::microseconds runtime = std::chrono::duration_cast<std::chrono::microseconds>(finished - started);
+        std::chrono::microseconds lag = std::chrono::duration_cast<std::chrono::microseconds>(started - deadline);
+
+        task_stats.running = false;
+        task_stats.runs++;
+        task_stats.last_runtime = runtime;
+        task_stats.total_runtime += runtime;
+        task_stats.max_runtime = std::max(task_stats.max_runtime, runtime);
+        task_stats.last_lag = lag;
+        task_stats.max_lag = std::max(task_stats.max_lag, lag);
+
+        if (failed)
+            task_stats.failures++;
+
+        this->running--;
+
+        if (this->stopping || (!ctx.is_repeated() && !current.repeating))
+            continue;
+
+        current.interval = ctx.get_interval();
+
+        // Repeats keep their rate, a task that fell behind a whole interval skips the missed runs instead of bursting
+        clock::time_point next = deadline + current.interval;
+
+        if (next < finished)
+            next = finished + current.interval;
+
+        this->pending.emplace(next, std::move(current));
+    }
+}
@@ -0,0 +1,133 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_TASK_SCHEDULER_HH
+#define SHIRO_TASK_SCHEDULER_HH
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace shiro {
+
+    // Runs delayed and repeating tasks on a small pool of workers that sleep until the next deadline.
+    // A task never runs concurrently with itself, different tasks may run in parallel.
+    class task_scheduler {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        class context {
+        private:
+            bool repeated = false;
+            clock::duration interval;
+
+        public:
+            explicit context(clock::duration interval);
+
+            // Runs the task again one interval after its previous deadline
+            void repeat();
+            void repeat(clock::duration interval);
+
+            bool is_repeated() const;
+            clock::duration get_interval() const;
+
+        };
+
+        using task = std::function<void(context&)>;
+
+        struct task_statistics {
+            std::string name;
+            bool running = false;
+
+            uint64_t runs = 0;
+            uint64_t failures = 0;
+
+            std::chrono::microseconds last_runtime { 0 };
+            std::chrono::microseconds total_runtime { 0 };
+            std::chrono::microseconds max_runtime { 0 };
+
+            // Time between the deadline of a run and the moment a worker started it
+            std::chrono::microseconds last_lag { 0 };
+            std::chrono::microseconds max_lag { 0 };
+        };
+
+        struct statistics {
+            size_t workers = 0;
+            size_t pending = 0;
+            size_t running = 0;
+
+            std::vector<task_statistics> tasks;
+        };
+
+    private:
+        struct entry {
+            std::string name;
+            clock::duration interval;
+            task function;
+
+            // Tasks added with schedule_every run until the scheduler stops, even if a run throws
+            bool repeating = false;
+        };
+
+        std::multimap<clock::time_point, entry> pending;
+        std::unordered_map<std::string, task_statistics> metrics;
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        size_t running = 0;
+        bool stopping = false;
+
+        void add(clock::duration delay, entry scheduled);
+
+        void work();
+
+    public:
+        task_scheduler() = default;
+        ~task_scheduler();
+
+        task_scheduler(const task_scheduler&) = delete;
+        task_scheduler &operator=(const task_scheduler&) = delete;
+
+        void start(size_t worker_count);
+
+        // Drops all pending tasks and waits for running ones to finish
+        void stop();
+
+        // Runs once after the delay, the task decides through its context whether it runs again
+        void schedule(clock::duration delay, const std::string &name, task function);
+
+        // Runs every interval, starting one interval or the given delay from now
+        void schedule_every(clock::duration interval, const std::string &name, std::function<void()> function);
+        void schedule_every(clock::duration delay, clock::duration interval, const std::string &name, std::function<void()> function);
+
+        statistics get_statistics();
+
+    };
+
+}
+
+#endif //SHIRO_TASK_SCHEDULER_HH
@@ -0,0 +1,372 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_set>
+
+#include "../beatmaps/beatmap.hh"
+#include "../config/score_submission_file.hh"
+#include "../database/tables/user_table.hh"
+#include "../geoloc/country_ids.hh"
+#include "../replays/replay_manager.hh"
+#include "../thirdparty/loguru.hh"
+#include "../users/user_manager.hh"
+#include "../shiro.hh"
+#include "leaderboard_cache.hh"
+#include "score_helper.hh"
+
+namespace shiro::scores::leaderboard_cache {
+
+    struct cached_board {
+        std::shared_ptr<const board> value;
+        std::list<std::string>::iterator usage;
+        size_t memory_usage = 0;
+    };
+
+    static std::unordered_map<std::string, cached_board> boards;
+    static std::list<std::string> usage; // Most recently used board is at the front
+    static std::mutex mutex;
+
+    static size_t memory_usage = 0;
+    static size_t memory_budget = 0;
+
+    // Bumped for a beatmap whenever its scores change, so a board that was materialized
+    // concurrently with a submission is not cached with the new score missing
+    static std::array<std::atomic<uint64_t>, 64> generations {};
+
+    static std::atomic<uint64_t> hits { 0 };
+    static std::atomic<uint64_t> misses { 0 };
+    static std::atomic<uint64_t> evictions { 0 };
+    static std::atomic<uint64_t> updates { 0 };
+
+    static std::string make_key(const std::string &beatmap_md5, uint8_t mode, int32_t mods);
+    static std::atomic<uint64_t> &get_generation(const std::string &beatmap_md5);
+
+    static std::shared_ptr<board> materialize(const std::string &beatmap_md5, uint8_t mode, int32_t mods);
+    static bool ranks_before(const entry &left, const entry &right);
+
+    // Both need to be called while holding the mutex
+    static void store(const std::string &key, const std::shared_ptr<const board> &value);
+    static void erase(std::unordered_map<std::string, cached_board>::iterator iterator);
+
+}
+
+const shiro::scores::leaderboard_cache::entry *shiro::scores::leaderboard_cache::board::find(int32_t user_id) const {
+    auto iterator = this->positions.find(user_id);
+
+    if (iterator == this->positions.end())
+        return nullptr;
+
+    return &this->entries.at(iterator->second);
+}
+
+int32_t shiro::scores::leaderboard_cache::board::get_position(int32_t user_id) const {
+    auto iterator = this->positions.find(user_id);
+
+    if (iterator == this->positions.end())
+        return -1;
+
+    return (int32_t) iterator->second + 1;
+}
+
+size_t shiro::scores::leaderboard_cache::board::get_memory_usage() const {
+    // Rough estimate, unordered_map nodes are counted as value plus two pointers
+    size_t memory = sizeof(board) + this->entries.capacity() * sizeof(entry);
+    memory += this->positions.size() * (sizeof(std::pair<const int32_t, size_t>) + 2 * sizeof(void*));
+    memory += this->positions.bucket_count() * sizeof(void*);
+
+    for (const entry &value : this->entries) {
+        memory += value.s.hash.capacity() + value.s.beatmap_md5.capacity() + value.s.rank.capacity() + value.username.capacity();
+    }
+
+    return memory;
+}
+
+void shiro::scores::leaderboard_cache::board::reindex() {
+    this->positions.clear();
+    this->positions.reserve(this->entries.size());
+
+    for (size_t i = 0; i < this->entries.size(); i++) {
+        this->positions.emplace(this->entries.at(i).s.user_id, i);
+    }
+}
+
+void shiro::scores::leaderboard_cache::init() {
+    memory_budget = (size_t) config::score_submission::leaderboard_cache_size * 1024 * 1024;
+
+    if (memory_budget == 0)
+        LOG_F(INFO, "Beatmap leaderboard caching is disabled.");
+}
+
+std::shared_ptr<const shiro::scores::leaderboard_cache::board> shiro::scores::leaderboard_cache::fetch(const std::string &beatmap_md5, uint8_t mode, int32_t mods) {
+    std::string key = make_key(beatmap_md5, mode, mods);
+
+    if (memory_budget > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iterator = boards.find(key);
+
+        if (iterator != boards.end()) {
+            usage.splice(usage.begin(), usage, iterator->second.usage);
+            hits++;
+
+            return iterator->second.value;
+        }
+    }
+
+    misses++;
+
+    uint64_t generation = get_generation(beatmap_md5).load();
+    std::shared_ptr<const board> result = materialize(beatmap_md5, mode, mods);
+
+    if (memory_budget == 0)
+        return result;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (get_generation(beatmap_md5).load() == generation)
+        store(key, result);
+
+    return result;
+}
+
+void shiro::scores::leaderboard_cache::submit(const shiro::scores::score &s, const std::shared_ptr<shiro::users::user> &user) {
+    if (!s.passed || user->hidden || !helper::is_ranked(s, beatmaps::beatmap()))
+        return;
+
+    get_generation(s.beatmap_md5)++;
+
+    if (memory_budget == 0)
+        return;
+
+    entry value;
+    value.s = s;
+    value.username = user->presence.username;
+    value.country = geoloc::get_country_id(user->country);
+    value.replay = true; // Queued by the submission before the board is updated
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (int32_t mods : { any_mods, s.mods }) {
+        std::string key = make_key(s.beatmap_md5, s.play_mode, mods);
+        auto iterator = boards.find(key);
+
+        if (iterator == boards.end())
+            continue;
+
+        const board &current = *iterator->second.value;
+        const entry *previous = current.find(s.user_id);
+
+        // The previous score of this user stays on the board if it is at least as good
+        if (previous != nullptr && !ranks_before(value, *previous))
+            continue;
+
+        std::shared_ptr<board> updated = std::make_shared<board>(current);
+
+        if (previous != nullptr)
+            updated->entries.erase(updated->entries.begin() + current.positions.at(s.user_id));
+
+        auto position = std::upper_bound(updated->entries.begin(), updated->entries.end(), value, ranks_before);
+        updated->entries.insert(position, value);
+        updated->reindex();
+
+        store(key, updated);
+        updates++;
+    }
+}
+
+void shiro::scores::leaderboard_cache::invalidate(const std::string &beatmap_md5) {
+    get_generation(beatmap_md5)++;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string prefix = beatmap_md5 + ":";
+
+    for (auto iterator = boards.begin(); iterator != boards.end();) {
+        auto current = iterator++;
+
+        if (current->first.compare(0, prefix.size(), prefix) == 0)
+            erase(current);
+    }
+}
+
+void shiro::scores::leaderboard_cache::clear() {
+    for (std::atomic<uint64_t> &generation : generations) {
+        generation++;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    boards.clear();
+    usage.clear();
+    memory_usage = 0;
+}
+
+bool shiro::scores::leaderboard_cache::has_replay(const entry &value) {
+    if (value.replay.has_value())
+        return value.replay.value();
+
+    return replays::has_replay(value.s);
+}
+
+shiro::scores::leaderboard_cache::statistics shiro::scores::leaderboard_cache::get_statistics() {
+    statistics stats;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        stats.boards = boards.size();
+        stats.memory_usage = memory_usage;
+    }
+
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.updates = updates;
+    stats.memory_budget = memory_budget;
+
+    return stats;
+}
+
+std::string shiro::scores::leaderboard_cache::make_key(const std::string &beatmap_md5, uint8_t mode, int32_t mods) {
+    return beatmap_md5 + ":" + std::to_string(mode) + ":" + std::to_string(mods);
+}
+
+std::atomic<uint64_t> &shiro::scores::leaderboard_cache::get_generation(const std::string &beatmap_md5) {
+    return generations.at(std::hash<std::string>()(beatmap_md5) % generations.size());
+}
+
+std::shared_ptr<shiro::scores::leaderboard_cache::board> shiro::scores::leaderboard_cache::materialize(const std::string &beatmap_md5, uint8_t mode, int32_t mods) {
+    std::shared_ptr<board> result = std::make_shared<board>();
+
+    std::optional<int32_t> mods_filter = std::nullopt;
+
+    if (mods != any_mods)
+        mods_filter = mods;
+
+    std::vector<score> scores = helper::fetch_mode_scores(beatmap_md5, mode, mods_filter);
+
+    if (scores.empty())
+        return result;
+
+    std::unordered_map<int32_t, entry> best;
+
+    for (score &s : scores) {
+        entry value;
+        value.s = std::move(s);
+
+        best.emplace(value.s.user_id, std::move(value));
+    }
+
+    // Usernames and countries of online players are known, the others are loaded in one go
+    std::vector<int32_t> offline_ids;
+
+    for (auto &[user_id, value] : best) {
+        std::shared_ptr<users::user> user = users::manager::get_user_by_id(user_id);
+
+        if (user == nullptr) {
+            offline_ids.emplace_back(user_id);
+            continue;
+        }
+
+        value.username = user->presence.username;
+        value.country = geoloc::get_country_id(user->country);
+    }
+
+    if (!offline_ids.empty()) {
+        auto db = db_connection->get_connection();
+        const tables::users user_table {};
+
+        auto users = db(select(user_table.id, user_table.username, user_table.country).from(user_table).where(
+                user_table.id.in(sqlpp::value_list(offline_ids))
+        ));
+
+        std::unordered_set<int32_t> found;
+
+        for (const auto &row : users) {
+            entry &value = best.at((int32_t) row.id);
+
+            value.username = row.username;
+            value.country = geoloc::get_country_id(row.country);
+            found.emplace((int32_t) row.id);
+        }
+
+        // Scores of deleted users are not shown
+        for (int32_t user_id : offline_ids) {
+            if (found.find(user_id) == found.end())
+                best.erase(user_id);
+        }
+    }
+
+    result->entries.reserve(best.size());
+
+    for (auto &[_, value] : best) {
+        result->entries.emplace_back(std::move(value));
+    }
+
+    std::sort(result->entries.begin(), result->entries.end(), ranks_before);
+    result->reindex();
+
+    // Checking every replay would cost one stat per player, the rest is looked up when it is displayed
+    size_t displayed = std::min(result->entries.size(), displayed_scores);
+
+    for (size_t i = 0; i < displayed; i++) {
+        entry &value = result->entries.at(i);
+        value.replay = replays::has_replay(value.s);
+    }
+
+    return result;
+}
+
+bool shiro::scores::leaderboard_cache::ranks_before(const entry &left, const entry &right) {
+    if (left.s.total_score != right.s.total_score)
+        return left.s.total_score > right.s.total_score;
+
+    return left.s.id < right.s.id;
+}
+
+void shiro::scores::leaderboard_cache::store(const std::string &key, const std::shared_ptr<const board> &value) {
+    size_t memory = value->get_memory_usage() + key.capacity();
+    auto iterator = boards.find(key);
+
+    if (iterator != boards.end())
+        erase(iterator);
+
+    // Boards larger than the whole budget are served but never cached
+    if (memory > memory_budget)
+        return;
+
+    usage.push_front(key);
+    boards.emplace(key, cached_board { value, usage.begin(), memory });
+    memory_usage += memory;
+
+    while (memory_usage > memory_budget && !usage.empty()) {
+        erase(boards.find(usage.back()));
+        evictions++;
+    }
+}
+
+void shiro::scores::leaderboard_cache::erase(std::unordered_map<std::string, cached_board>::iterator iterator) {
+    memory_usage -= iterator->second.memory_usage;
+    usage.erase(iterator->second.usage);
+    boards.erase(iterator);
+}
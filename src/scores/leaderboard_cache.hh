@@ -0,0 +1,102 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_LEADERBOARD_CACHE_HH
+#define SHIRO_LEADERBOARD_CACHE_HH
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../users/user.hh"
+#include "score.hh"
+
+namespace shiro::scores::leaderboard_cache {
+
+    // Mods value of the board that contains scores with any mods
+    constexpr int32_t any_mods = -1;
+
+    // Scores the client displays, only these have their replay looked up when a board is materialized
+    constexpr size_t displayed_scores = 50;
+
+    struct entry {
+        score s;
+        std::string username = "";
+        uint8_t country = 0;
+
+        // Known for the top displayed_scores entries and for submitted scores, read it through has_replay()
+        std::optional<bool> replay = std::nullopt;
+    };
+
+    // Best passed and ranked score of every player on a beatmap in one play mode, sorted by score.
+    // Boards are immutable once they are shared, updates replace the whole board.
+    //
+    // Boards hold every player instead of only the displayed top, because friend and country rankings
+    // are filtered views of the global board and the position of any player is needed after submission.
+    // An entry takes roughly 350 bytes, so a board with 10,000 players uses about 3.5 MiB. All boards
+    // together stay within leaderboard_cache_size; a board larger than that is served but never cached.
+    class board {
+    public:
+        std::vector<entry> entries;
+        std::unordered_map<int32_t, size_t> positions; // user id -> index in entries
+
+        // Returns nullptr if the user has no score on this board
+        const entry *find(int32_t user_id) const;
+
+        // 1-based position of the user on this board, -1 if the user has no score on it
+        int32_t get_position(int32_t user_id) const;
+
+        size_t get_memory_usage() const;
+
+        void reindex();
+
+    };
+
+    struct statistics {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t updates = 0;
+
+        size_t boards = 0;
+        size_t memory_usage = 0; // In bytes
+        size_t memory_budget = 0; // In bytes
+    };
+
+    void init();
+
+    // Returns the cached board or materializes it from the database
+    std::shared_ptr<const board> fetch(const std::string &beatmap_md5, uint8_t mode, int32_t mods = any_mods);
+
+    // Updates cached boards in place after a score has been submitted, its replay has to be saved already
+    void submit(const score &s, const std::shared_ptr<users::user> &user);
+
+    // Checks the replay store only for entries whose replay is not known yet
+    bool has_replay(const entry &value);
+
+    void invalidate(const std::string &beatmap_md5);
+    void clear();
+
+    statistics get_statistics();
+
+}
+
+#endif //SHIRO_LEADERBOARD_CACHE_HH
@@ -26,7 +26,6 @@
 #include "score_helper.hh"
 
 std::string shiro::scores::score::to_string(std::vector<score> &scores) {
-    std::stringstream stream;
     std::shared_ptr<users::user> user = users::manager::get_user_by_id(this->user_id);
 
     if (user == nullptr) {
@@ -35,8 +34,14 @@ std::string shiro::scores::score::to_string(std::vector<score> &scores) {
             return "";
     }
 
+    return this->to_string(user->presence.username, helper::get_scoreboard_position(*this, scores), replays::has_replay(*this));
+}
+
+std::string shiro::scores::score::to_string(const std::string &username, int32_t position, bool has_replay) const {
+    std::stringstream stream;
+
     stream << this->id << "|";
-    stream << user->presence.username << "|";
+    stream << username << "|";
     stream << this->total_score << "|";
     stream << this->max_combo << "|";
     stream << this->_50_count << "|";
@@ -48,9 +53,9 @@ std::string shiro::scores::score::to_string(std::vector<score> &scores) {
     stream << (this->fc ? "True" : "False") << "|";
     stream << this->mods << "|";
     stream << this->user_id << "|";
-    stream << helper::get_scoreboard_position(*this, scores) << "|";
+    stream << position << "|";
     stream << this->time << "|";
-    stream << (replays::has_replay(*this) ? "1" : "0") << std::endl;
+    stream << (has_replay ? "1" : "0") << std::endl;
 
     return stream.str();
 }
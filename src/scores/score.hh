@@ -62,6 +62,7 @@ namespace shiro::scores {
         int32_t time = 0;
 
         std::string to_string(std::vector<score> &scores);
+        std::string to_string(const std::string &username, int32_t position, bool has_replay) const;
 
     };
 
@@ -16,36 +16,36 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "../beatmaps/beatmap.hh"
 #include "../beatmaps/beatmap_helper.hh"
 #include "../config/score_submission_file.hh"
+#include "../database/tables/punishments_table.hh"
 #include "../database/tables/score_table.hh"
+#include "../database/tables/user_table.hh"
 #include "../geoloc/country_ids.hh"
 #include "../thirdparty/loguru.hh"
 #include "../thirdparty/oppai.hh"
 #include "../users/user_manager.hh"
 #include "../users/user_punishments.hh"
 #include "../utils/mods.hh"
+#include "../utils/punishment_type.hh"
 #include "score_helper.hh"
 
-shiro::scores::score shiro::scores::helper::fetch_top_score_user(std::string beatmap_md5sum, std::shared_ptr<shiro::users::user> user) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::scores score_table {};
-
-    auto result = db(select(all_of(score_table)).from(score_table).where(score_table.beatmap_md5 == beatmap_md5sum and score_table.user_id == user->user_id));
-
-    if (result.empty())
-        return score(-1);
+namespace shiro::scores::helper {
 
-    std::vector<score> scores;
+    SQLPP_ALIAS_PROVIDER(best_score);
 
-    for (const auto &row : result) {
+    template <typename R>
+    static score from_row(const R &row) {
         score s;
 
         s.id = row.id;
         s.user_id = row.user_id;
         s.hash = row.hash;
-        s.beatmap_md5 = beatmap_md5sum;
+        s.beatmap_md5 = row.beatmap_md5;
 
         s.rank = row.ranking;
         s.total_score = row.score;
@@ -68,406 +68,199 @@ shiro::scores::score shiro::scores::helper::fetch_top_score_user(std::string bea
         s.play_mode = row.play_mode;
         s.time = row.time;
 
-        if (!s.passed)
-            continue;
-
-        if (!is_ranked(s, beatmaps::beatmap()))
-            continue;
-
-        scores.emplace_back(s);
+        return s;
     }
 
-    if (scores.empty())
-        return score(-1);
-
-    std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
-        return s_left.total_score > s_right.total_score;
-    });
-
-    return scores.at(0);
-}
-
-std::vector<shiro::scores::score> shiro::scores::helper::fetch_all_scores(std::string beatmap_md5sum, size_t limit) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::scores score_table {};
-
-    auto result = db(select(all_of(score_table)).from(score_table).where(score_table.beatmap_md5 == beatmap_md5sum));
-
-    if (result.empty())
-        return {};
+    static std::vector<int32_t> get_ranked_modes() {
+        std::vector<int32_t> modes;
 
-    beatmaps::beatmap map;
-    map.beatmap_md5 = beatmap_md5sum;
+        for (uint8_t mode = 0; mode <= (uint8_t) utils::play_mode::mania; mode++) {
+            if (is_mode_ranked((utils::play_mode) mode))
+                modes.emplace_back(mode);
+        }
 
-    if (!map.fetch_db()) {
-        LOG_F(ERROR, "Tried to fetch scores for beatmap hash %s without it being in database.", beatmap_md5sum.c_str());
-        return {};
+        return modes;
     }
 
-    std::vector<score> scores;
-
-    for (const auto &row : result) {
-        score s;
-
-        s.id = row.id;
-        s.user_id = row.user_id;
-        s.hash = row.hash;
-        s.beatmap_md5 = beatmap_md5sum;
-
-        s.rank = row.ranking;
-        s.total_score = row.score;
-        s.max_combo = row.max_combo;
-        s.pp = row.pp;
-
-        s.accuracy = row.accuracy;
-        s.mods = row.mods;
-
-        s.fc = row.fc;
-        s.passed = row.passed;
-
-        s._300_count = row._300_count;
-        s._100_count = row._100_count;
-        s._50_count = row._50_count;
-        s.katus_count = row.katus_count;
-        s.gekis_count = row.gekis_count;
-        s.miss_count = row.miss_count;
-
-        s.play_mode = row.play_mode;
-        s.time = row.time;
-
-        if (!s.passed)
-            continue;
-
-        if (!users::punishments::has_scores(s.user_id))
-            continue;
-
-        if (!is_ranked(s, beatmaps::beatmap()))
-            continue;
-
-        if (map.last_update > s.time)
-            continue;
-
-        scores.emplace_back(s);
+    // Same rules as is_ranked, evaluated by the database. Requires at least one ranked play mode.
+    static auto ranked_condition(const tables::scores &score_table) {
+        return score_table.passed == true and
+               score_table.play_mode.in(sqlpp::value_list(get_ranked_modes())) and
+               (score_table.mods & (int32_t) get_unranked_mods()) == 0;
     }
 
-    scores.erase(std::remove_if(scores.begin(), scores.end(), [&](const score &s) {
-        for (const score &score : scores) {
-            if (score.hash == s.hash)
-                continue;
-
-            if (score.user_id == s.user_id && score.total_score > s.total_score)
-                return true;
-        }
-
-        return false;
-    }), scores.end());
-
-    std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
-        return s_left.total_score > s_right.total_score;
-    });
-
-    if (scores.size() > limit)
-        scores.resize(limit);
+    // Excludes scores of restricted and banned users
+    static auto visible_condition(const tables::scores &score_table) {
+        const tables::punishments punishments_table {};
 
-    return scores;
-}
-
-std::vector<shiro::scores::score> shiro::scores::helper::fetch_country_scores(std::string beatmap_md5sum, uint8_t country, size_t limit) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::scores score_table {};
-
-    auto result = db(select(all_of(score_table)).from(score_table).where(score_table.beatmap_md5 == beatmap_md5sum));
-
-    if (result.empty())
-        return {};
-
-    beatmaps::beatmap map;
-    map.beatmap_md5 = beatmap_md5sum;
-
-    if (!map.fetch_db()) {
-        LOG_F(ERROR, "Tried to fetch scores for beatmap hash %s without it being in database.", beatmap_md5sum.c_str());
-        return {};
+        return score_table.user_id.not_in(select(punishments_table.user_id).from(punishments_table).where(
+                punishments_table.active == true and (
+                    punishments_table.type == (uint16_t) utils::punishment_type::restrict or
+                    punishments_table.type == (uint16_t) utils::punishment_type::ban
+                )
+        ));
     }
 
-    std::vector<score> scores;
+    // Best score of every user on a beatmap, sorted by score. The earlier score wins ties.
+    template <typename C>
+    static std::vector<score> fetch_leaderboard(const std::string &beatmap_md5sum, const C &condition, size_t limit) {
+        if (get_ranked_modes().empty())
+            return {};
 
-    for (const auto &row : result) {
-        score s;
+        beatmaps::beatmap map;
+        map.beatmap_md5 = beatmap_md5sum;
 
-        s.id = row.id;
-        s.user_id = row.user_id;
-        s.hash = row.hash;
-        s.beatmap_md5 = beatmap_md5sum;
-
-        s.rank = row.ranking;
-        s.total_score = row.score;
-        s.max_combo = row.max_combo;
-        s.pp = row.pp;
+        if (!map.fetch_db()) {
+            LOG_F(ERROR, "Tried to fetch scores for beatmap hash %s without it being in database.", beatmap_md5sum.c_str());
+            return {};
+        }
 
-        s.accuracy = row.accuracy;
-        s.mods = row.mods;
+        auto db = db_connection->get_connection();
+        const tables::scores score_table {};
 
-        s.fc = row.fc;
-        s.passed = row.passed;
+        auto filter = score_table.beatmap_md5 == beatmap_md5sum and score_table.time >= map.last_update and
+                ranked_condition(score_table) and visible_condition(score_table) and condition;
 
-        s._300_count = row._300_count;
-        s._100_count = row._100_count;
-        s._50_count = row._50_count;
-        s.katus_count = row.katus_count;
-        s.gekis_count = row.gekis_count;
-        s.miss_count = row.miss_count;
+        // Selecting the best score per user and limiting happens in SQL, only the winning rows are loaded afterwards
+        auto best_scores = db(select(score_table.user_id, sqlpp::max(score_table.score).as(best_score)).from(score_table).where(
+                filter
+        ).group_by(score_table.user_id).order_by(sqlpp::max(score_table.score).desc()).limit(limit));
 
-        s.play_mode = row.play_mode;
-        s.time = row.time;
+        std::vector<int32_t> user_ids;
+        std::unordered_map<int32_t, int64_t> user_best;
 
-        if (!s.passed)
-            continue;
+        for (const auto &row : best_scores) {
+            user_ids.emplace_back(row.user_id);
+            user_best.emplace(row.user_id, row.best_score);
+        }
 
-        if (!users::punishments::has_scores(s.user_id))
-            continue;
+        if (user_ids.empty())
+            return {};
 
-        if (!is_ranked(s, beatmaps::beatmap()))
-            continue;
+        auto result = db(select(all_of(score_table)).from(score_table).where(
+                filter and score_table.user_id.in(sqlpp::value_list(user_ids))
+        ));
 
-        if (map.last_update > s.time)
-            continue;
+        std::unordered_map<int32_t, score> best;
 
-        scores.emplace_back(s);
-    }
+        for (const auto &row : result) {
+            score s = from_row(row);
 
-    scores.erase(std::remove_if(scores.begin(), scores.end(), [&](const score &s) {
-        std::shared_ptr<users::user> user = users::manager::get_user_by_id(s.user_id);
+            if (s.total_score != user_best.at(s.user_id))
+                continue;
 
-        if (user == nullptr) {
-            user = std::make_shared<users::user>(s.user_id);
+            auto iterator = best.find(s.user_id);
 
-            if (!user->init())
-                return true;
+            if (iterator == best.end() || s.id < iterator->second.id)
+                best.insert_or_assign(s.user_id, s);
         }
 
-        uint8_t user_country = geoloc::get_country_id(user->country);
-        if (user_country != country)
-            return true;
+        std::vector<score> scores;
+        scores.reserve(best.size());
 
-        for (const score &score : scores) {
-            if (s.hash == score.hash || s.user_id != score.user_id)
-                continue;
-
-            if (score.total_score > s.total_score)
-                return true;
+        for (auto &[_, s] : best) {
+            scores.emplace_back(std::move(s));
         }
 
-        return false;
-    }), scores.end());
+        std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
+            if (s_left.total_score != s_right.total_score)
+                return s_left.total_score > s_right.total_score;
 
-    std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
-        return s_left.total_score > s_right.total_score;
-    });
+            return s_left.id < s_right.id;
+        });
 
-    if (scores.size() > limit)
-        scores.resize(limit);
+        return scores;
+    }
 
-    return scores;
 }
 
-std::vector<shiro::scores::score> shiro::scores::helper::fetch_mod_scores(std::string beatmap_md5sum, int32_t mods, size_t limit) {
-    sqlpp::mysql::connection db(db_connection->get_config());
+shiro::scores::score shiro::scores::helper::fetch_top_score_user(std::string beatmap_md5sum, std::shared_ptr<shiro::users::user> user) {
+    if (get_ranked_modes().empty())
+        return score(-1);
+
+    auto db = db_connection->get_connection();
     const tables::scores score_table {};
 
-    auto result = db(select(all_of(score_table)).from(score_table).where(score_table.beatmap_md5 == beatmap_md5sum));
+    auto result = db(select(all_of(score_table)).from(score_table).where(
+            score_table.beatmap_md5 == beatmap_md5sum and
+            score_table.user_id == user->user_id and
+            ranked_condition(score_table)
+    ).order_by(score_table.score.desc(), score_table.id.asc()).limit(1u));
 
     if (result.empty())
-        return {};
-
-    beatmaps::beatmap map;
-    map.beatmap_md5 = beatmap_md5sum;
-
-    if (!map.fetch_db()) {
-        LOG_F(ERROR, "Tried to fetch scores for beatmap hash %s without it being in database.", beatmap_md5sum.c_str());
-        return {};
-    }
-
-    std::vector<score> scores;
-
-    for (const auto &row : result) {
-        score s;
-
-        s.id = row.id;
-        s.user_id = row.user_id;
-        s.hash = row.hash;
-        s.beatmap_md5 = beatmap_md5sum;
-
-        s.rank = row.ranking;
-        s.total_score = row.score;
-        s.max_combo = row.max_combo;
-        s.pp = row.pp;
-
-        s.accuracy = row.accuracy;
-        s.mods = row.mods;
-
-        s.fc = row.fc;
-        s.passed = row.passed;
-
-        s._300_count = row._300_count;
-        s._100_count = row._100_count;
-        s._50_count = row._50_count;
-        s.katus_count = row.katus_count;
-        s.gekis_count = row.gekis_count;
-        s.miss_count = row.miss_count;
+        return score(-1);
 
-        s.play_mode = row.play_mode;
-        s.time = row.time;
+    return from_row(result.front());
+}
 
-        if (!s.passed)
-            continue;
+shiro::scores::score shiro::scores::helper::fetch_top_score_user(const std::string &beatmap_md5sum, int32_t user_id, const utils::play_mode &mode) {
+    if (!is_mode_ranked(mode))
+        return score(-1);
 
-        if (!users::punishments::has_scores(s.user_id))
-            continue;
+    auto db = db_connection->get_connection();
+    const tables::scores score_table {};
 
-        if (!is_ranked(s, beatmaps::beatmap()))
-            continue;
+    auto result = db(select(all_of(score_table)).from(score_table).where(
+            score_table.beatmap_md5 == beatmap_md5sum and
+            score_table.user_id == user_id and
+            score_table.play_mode == (uint8_t) mode and
+            ranked_condition(score_table)
+    ).order_by(score_table.score.desc(), score_table.id.asc()).limit(1u));
 
-        if (map.last_update > s.time)
-            continue;
+    if (result.empty())
+        return score(-1);
 
-        scores.emplace_back(s);
-    }
+    return from_row(result.front());
+}
 
-    scores.erase(std::remove_if(scores.begin(), scores.end(), [&](const score &s) {
-        if (s.mods != mods)
-            return true;
+std::vector<shiro::scores::score> shiro::scores::helper::fetch_all_scores(std::string beatmap_md5sum, size_t limit) {
+    return fetch_leaderboard(beatmap_md5sum, sqlpp::value(true), limit);
+}
 
-        for (const score &score : scores) {
-            if (s.hash == score.hash || s.user_id != score.user_id)
-                continue;
+std::vector<shiro::scores::score> shiro::scores::helper::fetch_country_scores(std::string beatmap_md5sum, uint8_t country, size_t limit) {
+    std::string country_code = "XX";
 
-            if (score.total_score > s.total_score)
-                return true;
+    for (const auto &[code, id] : geoloc::country_ids) {
+        if (id == country) {
+            country_code = code;
+            break;
         }
+    }
 
-        return false;
-    }), scores.end());
+    const tables::scores score_table {};
+    const tables::users user_table {};
 
-    std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
-        return s_left.total_score > s_right.total_score;
-    });
+    return fetch_leaderboard(beatmap_md5sum, score_table.user_id.in(
+            select(user_table.id).from(user_table).where(user_table.country == country_code)
+    ), limit);
+}
 
-    if (scores.size() > limit)
-        scores.resize(limit);
+std::vector<shiro::scores::score> shiro::scores::helper::fetch_mod_scores(std::string beatmap_md5sum, int32_t mods, size_t limit) {
+    const tables::scores score_table {};
 
-    return scores;
+    return fetch_leaderboard(beatmap_md5sum, score_table.mods == mods, limit);
 }
 
 std::vector<shiro::scores::score> shiro::scores::helper::fetch_friend_scores(std::string beatmap_md5sum, std::shared_ptr<shiro::users::user> user, size_t limit) {
-    sqlpp::mysql::connection db(db_connection->get_config());
     const tables::scores score_table {};
 
-    auto result = db(select(all_of(score_table)).from(score_table).where(score_table.beatmap_md5 == beatmap_md5sum));
+    std::vector<int32_t> user_ids = user->friends;
+    user_ids.emplace_back(user->user_id);
 
-    if (result.empty())
-        return {};
-
-    beatmaps::beatmap map;
-    map.beatmap_md5 = beatmap_md5sum;
-
-    if (!map.fetch_db()) {
-        LOG_F(ERROR, "Tried to fetch scores for beatmap hash %s without it being in database.", beatmap_md5sum.c_str());
-        return {};
-    }
-
-    std::vector<score> scores;
-
-    for (const auto &row : result) {
-        score s;
-
-        s.id = row.id;
-        s.user_id = row.user_id;
-        s.hash = row.hash;
-        s.beatmap_md5 = beatmap_md5sum;
-
-        s.rank = row.ranking;
-        s.total_score = row.score;
-        s.max_combo = row.max_combo;
-        s.pp = row.pp;
-
-        s.accuracy = row.accuracy;
-        s.mods = row.mods;
-
-        s.fc = row.fc;
-        s.passed = row.passed;
-
-        s._300_count = row._300_count;
-        s._100_count = row._100_count;
-        s._50_count = row._50_count;
-        s.katus_count = row.katus_count;
-        s.gekis_count = row.gekis_count;
-        s.miss_count = row.miss_count;
-
-        s.play_mode = row.play_mode;
-        s.time = row.time;
-
-        if (!s.passed)
-            continue;
-
-        if (!users::punishments::has_scores(s.user_id))
-            continue;
-
-        if (!is_ranked(s, beatmaps::beatmap()))
-            continue;
-
-        if (map.last_update > s.time)
-            continue;
-
-        scores.emplace_back(s);
-    }
-
-    scores.erase(std::remove_if(scores.begin(), scores.end(), [&](const score &s) {
-        std::shared_ptr<users::user> score_user = users::manager::get_user_by_id(s.user_id);
-
-        if (score_user == nullptr) {
-            score_user = std::make_shared<users::user>(s.user_id);
-
-            if (!score_user->init())
-                return true;
-        }
-
-        if (score_user->user_id == user->user_id)
-            return false;
-
-        return std::find(user->friends.begin(), user->friends.end(), score_user->user_id) == user->friends.end();
-    }), scores.end());
-
-    scores.erase(std::remove_if(scores.begin(), scores.end(), [&](const score &s) {
-        for (const score &score : scores) {
-            if (score.hash == s.hash || score.user_id != s.user_id)
-                continue;
-
-            if (score.total_score > s.total_score)
-                return true;
-        }
-
-        return false;
-    }), scores.end());
+    return fetch_leaderboard(beatmap_md5sum, score_table.user_id.in(sqlpp::value_list(user_ids)), limit);
+}
 
-    std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
-        return s_left.total_score > s_right.total_score;
-    });
+std::vector<shiro::scores::score> shiro::scores::helper::fetch_mode_scores(const std::string &beatmap_md5sum, uint8_t mode, std::optional<int32_t> mods, size_t limit) {
+    const tables::scores score_table {};
 
-    if (scores.size() > limit)
-        scores.resize(limit);
+    if (mods.has_value())
+        return fetch_leaderboard(beatmap_md5sum, score_table.play_mode == mode and score_table.mods == mods.value(), limit);
 
-    return scores;
+    return fetch_leaderboard(beatmap_md5sum, score_table.play_mode == mode, limit);
 }
 
 std::vector<shiro::scores::score> shiro::scores::helper::fetch_user_scores(std::string beatmap_md5sum, std::shared_ptr<shiro::users::user> user, size_t limit) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::scores score_table {};
-
-    auto result = db(select(all_of(score_table)).from(score_table).where(
-            score_table.beatmap_md5 == beatmap_md5sum and score_table.user_id == user->user_id
-    ).limit(limit));
-
-    if (result.empty())
+    if (get_ranked_modes().empty())
         return {};
 
     beatmaps::beatmap map;
@@ -478,178 +271,94 @@ std::vector<shiro::scores::score> shiro::scores::helper::fetch_user_scores(std::
         return {};
     }
 
-    std::vector<score> scores;
-
-    for (const auto &row : result) {
-        score s;
-
-        s.id = row.id;
-        s.user_id = row.user_id;
-        s.hash = row.hash;
-        s.beatmap_md5 = beatmap_md5sum;
-
-        s.rank = row.ranking;
-        s.total_score = row.score;
-        s.max_combo = row.max_combo;
-        s.pp = row.pp;
-
-        s.accuracy = row.accuracy;
-        s.mods = row.mods;
-
-        s.fc = row.fc;
-        s.passed = row.passed;
-
-        s._300_count = row._300_count;
-        s._100_count = row._100_count;
-        s._50_count = row._50_count;
-        s.katus_count = row.katus_count;
-        s.gekis_count = row.gekis_count;
-        s.miss_count = row.miss_count;
-
-        s.play_mode = row.play_mode;
-        s.time = row.time;
-
-        if (!s.passed)
-            continue;
+    auto db = db_connection->get_connection();
+    const tables::scores score_table {};
 
-        if (!is_ranked(s, beatmaps::beatmap()))
-            continue;
+    auto result = db(select(all_of(score_table)).from(score_table).where(
+            score_table.beatmap_md5 == beatmap_md5sum and
+            score_table.user_id == user->user_id and
+            score_table.time >= map.last_update and
+            ranked_condition(score_table)
+    ).order_by(score_table.score.desc(), score_table.id.asc()).limit(limit));
 
-        if (map.last_update > s.time)
-            continue;
+    std::vector<score> scores;
 
-        scores.emplace_back(s);
+    for (const auto &row : result) {
+        scores.emplace_back(from_row(row));
     }
 
-    std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
-        return s_left.total_score > s_right.total_score;
-    });
-
     return scores;
 }
 
 std::vector<shiro::scores::score> shiro::scores::helper::fetch_all_user_scores(int32_t user_id, size_t limit) {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::scores score_table {};
 
-    auto result = db(select(all_of(score_table)).from(score_table).where(score_table.user_id == user_id).limit(limit));
-
-    if (result.empty())
-        return {};
+    auto result = db(select(all_of(score_table)).from(score_table).where(
+            score_table.user_id == user_id
+    ).order_by(score_table.score.desc()).limit(limit));
 
     std::vector<score> scores;
 
     for (const auto &row : result) {
-        score s;
-
-        s.id = row.id;
-        s.user_id = row.user_id;
-        s.hash = row.hash;
-        s.beatmap_md5 = row.beatmap_md5;
-
-        s.rank = row.ranking;
-        s.total_score = row.score;
-        s.max_combo = row.max_combo;
-        s.pp = row.pp;
-
-        s.accuracy = row.accuracy;
-        s.mods = row.mods;
-
-        s.fc = row.fc;
-        s.passed = row.passed;
-
-        s._300_count = row._300_count;
-        s._100_count = row._100_count;
-        s._50_count = row._50_count;
-        s.katus_count = row.katus_count;
-        s.gekis_count = row.gekis_count;
-        s.miss_count = row.miss_count;
-
-        s.play_mode = row.play_mode;
-        s.time = row.time;
-
-        scores.emplace_back(s);
+        scores.emplace_back(from_row(row));
     }
 
-    std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
-        return s_left.total_score > s_right.total_score;
-    });
-
     return scores;
 }
 
 std::vector<shiro::scores::score> shiro::scores::helper::fetch_top100_user(shiro::utils::play_mode mode, int32_t user_id) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::scores score_table {};
+    if (!is_mode_ranked(mode))
+        return {};
 
-    auto result = db(select(all_of(score_table)).from(score_table).where(score_table.user_id == user_id and score_table.play_mode == (uint8_t) mode));
+    auto db = db_connection->get_connection();
+    const tables::scores score_table {};
 
-    if (result.empty())
-        return {};
+    auto result = db(select(all_of(score_table)).from(score_table).where(
+            score_table.user_id == user_id and
+            score_table.play_mode == (uint8_t) mode and
+            ranked_condition(score_table)
+    ).order_by(score_table.pp.desc()));
 
-    std::vector<score> scores;
+    // Best score (by score) of every beatmap, whether a beatmap has a leaderboard is only looked up once
+    std::unordered_map<std::string, score> best;
+    std::unordered_map<std::string, bool> leaderboards;
 
     for (const auto &row : result) {
-        score s;
+        score s = from_row(row);
 
-        s.id = row.id;
-        s.user_id = row.user_id;
-        s.hash = row.hash;
-        s.beatmap_md5 = row.beatmap_md5;
+        auto leaderboard = leaderboards.find(s.beatmap_md5);
 
-        s.rank = row.ranking;
-        s.total_score = row.score;
-        s.max_combo = row.max_combo;
-        s.pp = row.pp;
+        if (leaderboard == leaderboards.end()) {
+            beatmaps::beatmap beatmap;
+            beatmap.beatmap_md5 = s.beatmap_md5;
 
-        s.accuracy = row.accuracy;
-        s.mods = row.mods;
-
-        s.fc = row.fc;
-        s.passed = row.passed;
+            // How do we have a score on the beatmap without having the beatmap in the db?
+            if (!beatmap.fetch_db())
+                LOG_F(ERROR, "Found score for user %i without having beatmap hash %s in database.", user_id, s.beatmap_md5.c_str());
 
-        s._300_count = row._300_count;
-        s._100_count = row._100_count;
-        s._50_count = row._50_count;
-        s.katus_count = row.katus_count;
-        s.gekis_count = row.gekis_count;
-        s.miss_count = row.miss_count;
-
-        s.play_mode = row.play_mode;
-        s.time = row.time;
+            bool has_leaderboard = beatmap.id != 0 && beatmaps::helper::has_leaderboard(beatmaps::helper::fix_beatmap_status(beatmap.ranked_status));
+            leaderboard = leaderboards.emplace(s.beatmap_md5, has_leaderboard).first;
+        }
 
-        if (!s.passed)
+        if (!leaderboard->second)
             continue;
 
-        if (!is_ranked(s, beatmaps::beatmap()))
-            continue;
+        auto iterator = best.find(s.beatmap_md5);
 
-        scores.emplace_back(s);
-    }
-
-    scores.erase(std::remove_if(scores.begin(), scores.end(), [&](const score &s) {
-        beatmaps::beatmap beatmap;
-        beatmap.beatmap_md5 = s.beatmap_md5;
-
-        // How do we have a score on the beatmap without having the beatmap in the db?
-        if (!beatmap.fetch_db()) {
-            LOG_F(ERROR, "Found score for user %i without having beatmap hash %s in database.", user_id, s.beatmap_md5.c_str());
-            return true;
+        if (iterator == best.end()) {
+            best.emplace(s.beatmap_md5, std::move(s));
+        } else if (s.total_score > iterator->second.total_score) {
+            iterator->second = std::move(s);
         }
+    }
 
-        if (!beatmaps::helper::has_leaderboard(beatmaps::helper::fix_beatmap_status(beatmap.ranked_status)))
-            return true;
-
-        for (const score &score : scores) {
-            if (s.hash == score.hash || s.beatmap_md5 != score.beatmap_md5)
-                continue;
-
-            if (score.total_score > s.total_score)
-                return true;
-        }
+    std::vector<score> scores;
+    scores.reserve(best.size());
 
-        return false;
-    }), scores.end());
+    for (auto &[_, s] : best) {
+        scores.emplace_back(std::move(s));
+    }
 
     std::sort(scores.begin(), scores.end(), [](const score &s_left, const score &s_right) {
         return s_left.pp > s_right.pp;
@@ -662,7 +371,7 @@ std::vector<shiro::scores::score> shiro::scores::helper::fetch_top100_user(shiro
 }
 
 std::optional<shiro::scores::score> shiro::scores::helper::get_latest_score(int32_t user_id, const utils::play_mode &mode) {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::scores score_table {};
 
     auto result = db(select(all_of(score_table)).from(score_table).where(
@@ -674,41 +383,11 @@ std::optional<shiro::scores::score> shiro::scores::helper::get_latest_score(int3
         return std::nullopt;
 
     // We are ordering by time (descending) so the front value will have the highest timestamp which is the latest in unix time
-    const auto &row = result.front();
-
-    score s(-1);
-
-    s.id = row.id;
-    s.user_id = row.user_id;
-    s.hash = row.hash;
-    s.beatmap_md5 = row.beatmap_md5;
-
-    s.rank = row.ranking;
-    s.total_score = row.score;
-    s.max_combo = row.max_combo;
-    s.pp = row.pp;
-
-    s.accuracy = row.accuracy;
-    s.mods = row.mods;
-
-    s.fc = row.fc;
-    s.passed = row.passed;
-
-    s._300_count = row._300_count;
-    s._100_count = row._100_count;
-    s._50_count = row._50_count;
-    s.katus_count = row.katus_count;
-    s.gekis_count = row.gekis_count;
-    s.miss_count = row.miss_count;
-
-    s.play_mode = row.play_mode;
-    s.time = row.time;
-
-    return s;
+    return from_row(result.front());
 }
 
 shiro::scores::score shiro::scores::helper::get_score(int32_t id) {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::scores score_table {};
 
     auto result = db(select(all_of(score_table)).from(score_table).where(score_table.id == id).limit(1u));
@@ -716,36 +395,7 @@ shiro::scores::score shiro::scores::helper::get_score(int32_t id) {
     if (result.empty())
         return score(-1);
 
-    const auto &row = result.front();
-    score s(-1);
-
-    s.id = row.id;
-    s.user_id = row.user_id;
-    s.hash = row.hash;
-    s.beatmap_md5 = row.beatmap_md5;
-
-    s.rank = row.ranking;
-    s.total_score = row.score;
-    s.max_combo = row.max_combo;
-    s.pp = row.pp;
-
-    s.accuracy = row.accuracy;
-    s.mods = row.mods;
-
-    s.fc = row.fc;
-    s.passed = row.passed;
-
-    s._300_count = row._300_count;
-    s._100_count = row._100_count;
-    s._50_count = row._50_count;
-    s.katus_count = row.katus_count;
-    s.gekis_count = row.gekis_count;
-    s.miss_count = row.miss_count;
-
-    s.play_mode = row.play_mode;
-    s.time = row.time;
-
-    return s;
+    return from_row(result.front());
 }
 
 int32_t shiro::scores::helper::get_scoreboard_position(const shiro::scores::score &s, std::vector<score> scores) {
@@ -764,125 +414,128 @@ int32_t shiro::scores::helper::get_scoreboard_position(const shiro::scores::scor
 }
 
 bool shiro::scores::helper::is_ranked(const shiro::scores::score &score, const shiro::beatmaps::beatmap &beatmap) {
-    bool ranked = true;
-    int32_t mods = score.mods;
+    bool ranked = is_mode_ranked((utils::play_mode) score.play_mode);
 
-    switch ((utils::play_mode) score.play_mode) {
+    if (((uint32_t) score.mods & get_unranked_mods()) != 0)
+        ranked = false;
+
+    if (beatmap.id != 0)
+        ranked &= beatmaps::helper::has_leaderboard(beatmaps::helper::fix_beatmap_status(beatmap.ranked_status));
+
+    return ranked;
+}
+
+bool shiro::scores::helper::is_mode_ranked(const utils::play_mode &mode) {
+    switch (mode) {
         case utils::play_mode::standard:
-            ranked &= config::score_submission::std_ranked;
-            break;
+            return config::score_submission::std_ranked;
         case utils::play_mode::taiko:
-            ranked &= config::score_submission::taiko_ranked;
-            break;
+            return config::score_submission::taiko_ranked;
         case utils::play_mode::fruits:
-            ranked &= config::score_submission::catch_ranked;
-            break;
+            return config::score_submission::catch_ranked;
         case utils::play_mode::mania:
-            ranked &= config::score_submission::mania_ranked;
-            break;
+            return config::score_submission::mania_ranked;
     }
 
-    if (mods & (int32_t) utils::mods::none)
-        ranked &= config::score_submission::nomod_ranked;
+    return true;
+}
 
-    if (mods & (int32_t) utils::mods::no_fail)
-        ranked &= config::score_submission::no_fail_ranked;
+uint32_t shiro::scores::helper::get_unranked_mods() {
+    uint32_t mods = 0;
 
-    if (mods & (int32_t) utils::mods::easy)
-        ranked &= config::score_submission::easy_ranked;
+    if (!config::score_submission::no_fail_ranked)
+        mods |= (uint32_t) utils::mods::no_fail;
 
-    if (mods & (int32_t) utils::mods::touch_device)
-        ranked &= config::score_submission::touch_device_ranked;
+    if (!config::score_submission::easy_ranked)
+        mods |= (uint32_t) utils::mods::easy;
 
-    if (mods & (int32_t) utils::mods::hidden)
-        ranked &= config::score_submission::hidden_ranked;
+    if (!config::score_submission::touch_device_ranked)
+        mods |= (uint32_t) utils::mods::touch_device;
 
-    if (mods & (int32_t) utils::mods::hard_rock)
-        ranked &= config::score_submission::hard_rock_ranked;
+    if (!config::score_submission::hidden_ranked)
+        mods |= (uint32_t) utils::mods::hidden;
 
-    if (mods & (int32_t) utils::mods::sudden_death)
-        ranked &= config::score_submission::sudden_death_ranked;
+    if (!config::score_submission::hard_rock_ranked)
+        mods |= (uint32_t) utils::mods::hard_rock;
 
-    if (mods & (int32_t) utils::mods::double_time)
-        ranked &= config::score_submission::double_time_ranked;
+    if (!config::score_submission::sudden_death_ranked)
+        mods |= (uint32_t) utils::mods::sudden_death;
 
-    if (mods & (int32_t) utils::mods::relax)
-        ranked &= config::score_submission::relax_ranked;
+    if (!config::score_submission::double_time_ranked)
+        mods |= (uint32_t) utils::mods::double_time;
 
-    if (mods & (int32_t) utils::mods::half_time)
-        ranked &= config::score_submission::half_time_ranked;
+    if (!config::score_submission::relax_ranked)
+        mods |= (uint32_t) utils::mods::relax;
 
-    if (mods & (int32_t) utils::mods::nightcore)
-        ranked &= config::score_submission::nightcore_ranked;
+    if (!config::score_submission::half_time_ranked)
+        mods |= (uint32_t) utils::mods::half_time;
 
-    if (mods & (int32_t) utils::mods::flashlight)
-        ranked &= config::score_submission::flashlight_ranked;
+    if (!config::score_submission::nightcore_ranked)
+        mods |= (uint32_t) utils::mods::nightcore;
 
-    if (mods & (int32_t) utils::mods::auto_play)
-        ranked &= config::score_submission::auto_play_ranked;
+    if (!config::score_submission::flashlight_ranked)
+        mods |= (uint32_t) utils::mods::flashlight;
 
-    if (mods & (int32_t) utils::mods::spun_out)
-        ranked &= config::score_submission::spun_out_ranked;
+    if (!config::score_submission::auto_play_ranked)
+        mods |= (uint32_t) utils::mods::auto_play;
 
-    if (mods & (int32_t) utils::mods::auto_pilot)
-        ranked &= config::score_submission::auto_pilot_ranked;
+    if (!config::score_submission::spun_out_ranked)
+        mods |= (uint32_t) utils::mods::spun_out;
 
-    if (mods & (int32_t) utils::mods::perfect)
-        ranked &= config::score_submission::perfect_ranked;
+    if (!config::score_submission::auto_pilot_ranked)
+        mods |= (uint32_t) utils::mods::auto_pilot;
 
-    // Special mods
+    if (!config::score_submission::perfect_ranked)
+        mods |= (uint32_t) utils::mods::perfect;
 
-    if (mods & (int32_t) utils::mods::fade_in)
-        ranked &= config::score_submission::fade_in_ranked;
+    if (!config::score_submission::fade_in_ranked)
+        mods |= (uint32_t) utils::mods::fade_in;
 
-    if (mods & (int32_t) utils::mods::random)
-        ranked &= config::score_submission::random_ranked;
+    if (!config::score_submission::random_ranked)
+        mods |= (uint32_t) utils::mods::random;
 
-    if (mods & (int32_t) utils::mods::cinema)
-        ranked &= config::score_submission::cinema_ranked;
+    if (!config::score_submission::cinema_ranked)
+        mods |= (uint32_t) utils::mods::cinema;
 
-    if (mods & (int32_t) utils::mods::target)
-        ranked &= config::score_submission::target_ranked;
+    if (!config::score_submission::target_ranked)
+        mods |= (uint32_t) utils::mods::target;
 
-    if (mods & (int32_t) utils::mods::score_v2)
-        ranked &= config::score_submission::score_v2_ranked;
+    if (!config::score_submission::score_v2_ranked)
+        mods |= (uint32_t) utils::mods::score_v2;
 
     // Keys
 
-    if (mods & (int32_t) utils::mods::key_1)
-        ranked &= config::score_submission::key_1_ranked;
-
-    if (mods & (int32_t) utils::mods::key_2)
-        ranked &= config::score_submission::key_2_ranked;
+    if (!config::score_submission::key_1_ranked)
+        mods |= (uint32_t) utils::mods::key_1;
 
-    if (mods & (int32_t) utils::mods::key_3)
-        ranked &= config::score_submission::key_3_ranked;
+    if (!config::score_submission::key_2_ranked)
+        mods |= (uint32_t) utils::mods::key_2;
 
-    if (mods & (int32_t) utils::mods::key_4)
-        ranked &= config::score_submission::key_4_ranked;
+    if (!config::score_submission::key_3_ranked)
+        mods |= (uint32_t) utils::mods::key_3;
 
-    if (mods & (int32_t) utils::mods::key_5)
-        ranked &= config::score_submission::key_5_ranked;
+    if (!config::score_submission::key_4_ranked)
+        mods |= (uint32_t) utils::mods::key_4;
 
-    if (mods & (int32_t) utils::mods::key_6)
-        ranked &= config::score_submission::key_6_ranked;
+    if (!config::score_submission::key_5_ranked)
+        mods |= (uint32_t) utils::mods::key_5;
 
-    if (mods & (int32_t) utils::mods::key_7)
-        ranked &= config::score_submission::key_7_ranked;
+    if (!config::score_submission::key_6_ranked)
+        mods |= (uint32_t) utils::mods::key_6;
 
-    if (mods & (int32_t) utils::mods::key_8)
-        ranked &= config::score_submission::key_8_ranked;
+    if (!config::score_submission::key_7_ranked)
+        mods |= (uint32_t) utils::mods::key_7;
 
-    if (mods & (int32_t) utils::mods::key_9)
-        ranked &= config::score_submission::key_9_ranked;
+    if (!config::score_submission::key_8_ranked)
+        mods |= (uint32_t) utils::mods::key_8;
 
-    if (mods & (int32_t) utils::mods::key_coop)
-        ranked &= config::score_submission::key_coop_ranked;
+    if (!config::score_submission::key_9_ranked)
+        mods |= (uint32_t) utils::mods::key_9;
 
-    if (beatmap.id != 0)
-        ranked &= beatmaps::helper::has_leaderboard(beatmaps::helper::fix_beatmap_status(beatmap.ranked_status));
+    if (!config::score_submission::key_coop_ranked)
+        mods |= (uint32_t) utils::mods::key_coop;
 
-    return ranked;
+    return mods;
 }
 
 std::tuple<bool, std::string> shiro::scores::helper::is_flagged(const shiro::scores::score &score, const shiro::beatmaps::beatmap &beatmap) {
@@ -31,6 +31,7 @@
 namespace shiro::scores::helper {
 
     score fetch_top_score_user(std::string beatmap_md5sum, std::shared_ptr<users::user> user);
+    score fetch_top_score_user(const std::string &beatmap_md5sum, int32_t user_id, const utils::play_mode &mode);
 
     std::vector<score> fetch_all_scores(std::string beatmap_md5sum, size_t limit = 50);
 
@@ -40,6 +41,9 @@ namespace shiro::scores::helper {
 
     std::vector<score> fetch_friend_scores(std::string beatmap_md5sum, std::shared_ptr<users::user> user, size_t limit = 50);
 
+    // Leaderboard of a single play mode, optionally only containing scores with the given mods
+    std::vector<score> fetch_mode_scores(const std::string &beatmap_md5sum, uint8_t mode, std::optional<int32_t> mods = std::nullopt, size_t limit = std::numeric_limits<size_t>::max());
+
     std::vector<score> fetch_user_scores(std::string beatmap_md5sum, std::shared_ptr<users::user> user, size_t limit = std::numeric_limits<size_t>::max());
 
     int32_t get_scoreboard_position(const score &s, std::vector<score> scores);
@@ -54,6 +58,10 @@ namespace shiro::scores::helper {
     score get_score(int32_t id);
 
     bool is_ranked(const score &score, const beatmaps::beatmap &beatmap);
+    bool is_mode_ranked(const utils::play_mode &mode);
+
+    // Bitmask of all mods that are configured as unranked
+    uint32_t get_unranked_mods();
 
     std::tuple<bool, std::string> is_flagged(const score &score, const beatmaps::beatmap &beatmap);
 
@@ -21,6 +21,7 @@
 #include <utility>
 
 #include "../ranking/ranking_helper.hh"
+#include "leaderboard_cache.hh"
 #include "score_helper.hh"
 #include "table_display.hh"
 
@@ -35,7 +36,7 @@ shiro::scores::table_display::table_display(std::shared_ptr<users::user> user, b
 void shiro::scores::table_display::init() {
     scores::score old_top_score = helper::fetch_top_score_user(this->beatmap.beatmap_md5, this->user);
     this->old_top_score = old_top_score;
-    this->old_scoreboard_pos = helper::get_scoreboard_position(old_top_score, helper::fetch_all_scores(this->beatmap.beatmap_md5, 5));
+    this->old_scoreboard_pos = leaderboard_cache::fetch(this->beatmap.beatmap_md5, this->score.play_mode)->get_position(this->user->user_id);
 
     if (this->old_scoreboard_pos == -1)
         this->old_scoreboard_pos = 0;
@@ -0,0 +1,205 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+#include "../thirdparty/loguru.hh"
+#include "../shiro.hh"
+#include "score_helper.hh"
+#include "top_plays.hh"
+
+namespace shiro::scores::top_plays {
+
+    struct cached_plays {
+        std::vector<play> plays; // Sorted by pp, at most max_plays entries
+        std::chrono::steady_clock::time_point last_access;
+    };
+
+    constexpr size_t max_plays = 100;
+    constexpr std::chrono::minutes idle_timeout = std::chrono::minutes(30);
+
+    static std::unordered_map<int64_t, cached_plays> cache;
+    static std::mutex mutex;
+
+    // Bumped whenever plays of a user change, so plays loaded concurrently are not cached when outdated
+    static std::array<std::atomic<uint64_t>, 64> generations {};
+
+    static int64_t make_key(const utils::play_mode &mode, int32_t user_id);
+    static std::atomic<uint64_t> &get_generation(int32_t user_id);
+
+    static play make_play(const score &s);
+    static bool ranks_before(const play &left, const play &right);
+
+}
+
+void shiro::scores::top_plays::init() {
+    scheduler.schedule_every(1min, "scores::top_plays", []() {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto iterator = cache.begin(); iterator != cache.end();) {
+            if (now - iterator->second.last_access > idle_timeout) {
+                iterator = cache.erase(iterator);
+                continue;
+            }
+
+            iterator++;
+        }
+    });
+}
+
+std::vector<shiro::scores::top_plays::play> shiro::scores::top_plays::get(const utils::play_mode &mode, int32_t user_id) {
+    int64_t key = make_key(mode, user_id);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iterator = cache.find(key);
+
+        if (iterator != cache.end()) {
+            iterator->second.last_access = std::chrono::steady_clock::now();
+            return iterator->second.plays;
+        }
+    }
+
+    uint64_t generation = get_generation(user_id).load();
+    std::vector<score> scores = helper::fetch_top100_user(mode, user_id);
+
+    std::vector<play> plays;
+    plays.reserve(scores.size());
+
+    for (const score &s : scores) {
+        plays.emplace_back(make_play(s));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (get_generation(user_id).load() == generation)
+        cache.insert_or_assign(key, cached_plays { plays, std::chrono::steady_clock::now() });
+
+    return plays;
+}
+
+void shiro::scores::top_plays::submit(const shiro::scores::score &s, const shiro::beatmaps::beatmap &beatmap) {
+    if (!s.passed || !helper::is_ranked(s, beatmap))
+        return;
+
+    get_generation(s.user_id)++;
+
+    int64_t key = make_key((utils::play_mode) s.play_mode, s.user_id);
+    std::unique_lock<std::mutex> lock(mutex);
+    auto iterator = cache.find(key);
+
+    if (iterator == cache.end())
+        return;
+
+    std::vector<play> &plays = iterator->second.plays;
+    play submitted = make_play(s);
+
+    auto previous = std::find_if(plays.begin(), plays.end(), [&s](const play &p) {
+        return p.beatmap_md5 == s.beatmap_md5;
+    });
+
+    if (previous != plays.end()) {
+        // Only the best score (by score) on a beatmap counts
+        if (submitted.total_score <= previous->total_score)
+            return;
+
+        float lowest_pp = plays.back().pp;
+        plays.erase(previous);
+
+        // A full list only knows its own plays, if the new score fell below the cut off an uncached play might be better
+        if (plays.size() + 1 >= max_plays && submitted.pp < lowest_pp) {
+            cache.erase(iterator);
+            return;
+        }
+    } else if (plays.size() >= max_plays) {
+        if (submitted.pp <= plays.back().pp)
+            return;
+
+        lock.unlock();
+
+        // The beatmap may have a better (by score) but lower pp play that is not part of the list
+        score best = helper::fetch_top_score_user(s.beatmap_md5, s.user_id, (utils::play_mode) s.play_mode);
+
+        lock.lock();
+        iterator = cache.find(key);
+
+        if (iterator == cache.end() || best.id != s.id)
+            return;
+
+        std::vector<play> &current = iterator->second.plays;
+
+        if (current.size() >= max_plays) {
+            if (submitted.pp <= current.back().pp)
+                return;
+
+            current.pop_back();
+        }
+    }
+
+    std::vector<play> &updated = iterator->second.plays;
+    updated.insert(std::upper_bound(updated.begin(), updated.end(), submitted, ranks_before), submitted);
+}
+
+void shiro::scores::top_plays::invalidate(int32_t user_id) {
+    get_generation(user_id)++;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (uint8_t mode = 0; mode <= (uint8_t) utils::play_mode::mania; mode++) {
+        cache.erase(make_key((utils::play_mode) mode, user_id));
+    }
+}
+
+void shiro::scores::top_plays::clear() {
+    for (std::atomic<uint64_t> &generation : generations) {
+        generation++;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.clear();
+}
+
+int64_t shiro::scores::top_plays::make_key(const utils::play_mode &mode, int32_t user_id) {
+    return ((int64_t) user_id << 8) | (uint8_t) mode;
+}
+
+std::atomic<uint64_t> &shiro::scores::top_plays::get_generation(int32_t user_id) {
+    return generations.at((uint32_t) user_id % generations.size());
+}
+
+shiro::scores::top_plays::play shiro::scores::top_plays::make_play(const shiro::scores::score &s) {
+    play result;
+
+    result.score_id = s.id;
+    result.beatmap_md5 = s.beatmap_md5;
+    result.total_score = s.total_score;
+    result.pp = s.pp;
+    result.accuracy = s.accuracy;
+
+    return result;
+}
+
+bool shiro::scores::top_plays::ranks_before(const play &left, const play &right) {
+    return left.pp > right.pp;
+}
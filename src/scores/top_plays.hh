@@ -0,0 +1,53 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_TOP_PLAYS_HH
+#define SHIRO_TOP_PLAYS_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../beatmaps/beatmap.hh"
+#include "../utils/play_mode.hh"
+#include "score.hh"
+
+namespace shiro::scores::top_plays {
+
+    struct play {
+        int32_t score_id = 0;
+        std::string beatmap_md5 = "";
+        int64_t total_score = 0;
+        float pp = 0.0f;
+        float accuracy = 0.0f;
+    };
+
+    void init();
+
+    // Top 100 plays of a user (best score per beatmap, sorted by pp), loaded from the database on first access
+    std::vector<play> get(const utils::play_mode &mode, int32_t user_id);
+
+    // Updates the cached plays after a score has been stored in the database
+    void submit(const score &s, const beatmaps::beatmap &beatmap);
+
+    void invalidate(int32_t user_id);
+    void clear();
+
+}
+
+#endif //SHIRO_TOP_PLAYS_HH
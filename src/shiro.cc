@@ -18,9 +18,11 @@
 
 #include <cstdlib>
 #include <curl/curl.h>
-#include <thread>
 
+#include "beatmaps/beatmap_cache.hh"
+#include "beatmaps/beatmap_counters.hh"
 #include "beatmaps/beatmap_helper.hh"
+#include "beatmaps/osu_api.hh"
 #include "bot/bot.hh"
 #include "channels/channel_manager.hh"
 #include "channels/console_osu_bridge.hh"
@@ -41,19 +43,25 @@
 #include "native/signal_handler.hh"
 #include "native/system_statistics.hh"
 #include "permissions/role_manager.hh"
+#include "pp/pp_difficulty_cache.hh"
+#include "pp/pp_recalculator.hh"
+#include "ranking/ranking_helper.hh"
 #include "replays/replay_manager.hh"
 #include "routes/routes.hh"
+#include "scores/leaderboard_cache.hh"
+#include "scores/top_plays.hh"
 #include "thirdparty/cli11.hh"
 #include "thirdparty/loguru.hh"
 #include "users/user_activity.hh"
 #include "users/user_punishments.hh"
 #include "users/user_timeout.hh"
 #include "utils/crypto.hh"
+#include "utils/curler.hh"
 #include "shiro.hh"
 
 std::shared_ptr<shiro::database> shiro::db_connection = nullptr;
 std::shared_ptr<shiro::redis> shiro::redis_connection = nullptr;
-tsc::TaskScheduler shiro::scheduler;
+shiro::task_scheduler shiro::scheduler;
 std::time_t shiro::start_time = std::time(nullptr);
 std::string shiro::commit = "78f8303";
 
@@ -61,6 +69,7 @@ int shiro::init(int argc, char **argv) {
     logging::init(argc, argv);
 
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    utils::curl::init();
 
     std::srand(utils::crypto::make_seed());
 
@@ -80,6 +89,7 @@ int shiro::init(int argc, char **argv) {
     config::score_submission::parse();
 
     beatmaps::helper::init();
+    beatmaps::osu_api::init();
     direct::init();
     geoloc::init();
 
@@ -98,13 +108,8 @@ int shiro::init(int argc, char **argv) {
     redis_connection->connect();
     redis_connection->setup();
 
-    std::thread scheduler_updater([]() {
-        while (true) {
-            std::this_thread::sleep_for(1ms);
-            scheduler.Update(1ms);
-        }
-    });
-    scheduler_updater.detach(); // The root of all suffering is attachment
+    // Scheduled tasks mostly wait on the database, a few workers keep a slow one from delaying the rest
+    scheduler.start(4);
 
     roles::manager::init();
 
@@ -117,9 +122,18 @@ int shiro::init(int argc, char **argv) {
     users::punishments::init();
     users::timeout::init();
 
+    ranking::helper::init();
+
     channels::bridge::install();
 
+    beatmaps::cache::init();
+    beatmaps::counters::init();
     replays::init();
+    scores::leaderboard_cache::init();
+    pp::difficulty_cache::init();
+    scores::top_plays::init();
+
+    pp::recalculator::init();
 
     native::system_stats::init();
     native::signal_handler::install();
@@ -133,13 +147,19 @@ int shiro::init(int argc, char **argv) {
 }
 
 void shiro::destroy() {
+    scheduler.stop();
+
+    beatmaps::counters::flush();
+    users::activity::flush();
+    replays::destroy();
+
     redis_connection->disconnect();
 
+    beatmaps::osu_api::destroy();
+    utils::curl::destroy();
     curl_global_cleanup();
 
     geoloc::maxmind::destroy();
 
-    scheduler.CancelAll();
-
     LOG_F(INFO, "Thank you and goodbye.");
 }
@@ -26,7 +26,7 @@
 
 #include "database/database.hh"
 #include "redis/redis.hh"
-#include "thirdparty/taskscheduler.hh"
+#include "scheduler/task_scheduler.hh"
 
 namespace shiro {
 
@@ -34,7 +34,7 @@ namespace shiro {
     extern std::shared_ptr<redis> redis_connection;
 
     using namespace std::chrono_literals;
-    extern tsc::TaskScheduler scheduler;
+    extern task_scheduler scheduler;
 
     extern std::time_t start_time;
     extern std::string commit;
@@ -38,7 +38,7 @@ shiro::users::user::user(const std::string &username) {
 }
 
 bool shiro::users::user::init() {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::users user_table {};
     const tables::relationships relationships_table {};
 
@@ -80,7 +80,7 @@ bool shiro::users::user::init() {
 }
 
 void shiro::users::user::update() {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::users user_table {};
 
     auto result = db(select(all_of(user_table)).from(user_table).where(user_table.id == this->user_id).limit(1u));
@@ -130,7 +130,7 @@ void shiro::users::user::update() {
 }
 
 void shiro::users::user::save_stats() {
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::users user_table {};
 
     switch (this->stats.play_mode) {
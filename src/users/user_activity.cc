@@ -16,9 +16,15 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <chrono>
+#include <mutex>
+#include <sqlpp11/exception.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-#include "../database/tables/user_table.hh"
 #include "../scores/score.hh"
 #include "../scores/score_helper.hh"
 #include "../thirdparty/loguru.hh"
@@ -27,21 +33,121 @@
 #include "user_activity.hh"
 #include "user_manager.hh"
 
-void shiro::users::activity::init() {
-    scheduler.Schedule(1min, [](tsc::TaskContext ctx) {
-        sqlpp::mysql::connection db(db_connection->get_config());
-        const tables::users user_table {};
+namespace shiro::users::activity {
+
+    // Users per UPDATE statement
+    constexpr size_t batch_size = 1000;
+
+    // Last written last_seen of every online user, only touched by flush() which never runs concurrently
+    static std::unordered_map<int32_t, int64_t> flushed;
 
-        users::manager::iterate([&db, &user_table](std::shared_ptr<users::user> user) {
-            db(update(user_table).set(
-                    user_table.last_seen = user->last_ping.count()
-            ).where(user_table.id == user->user_id));
-        }, true);
+    // Final pings of users that logged out since the last flush
+    static std::unordered_map<int32_t, int64_t> departed;
+    static std::mutex departed_mutex;
+
+}
 
-        ctx.Repeat();
+void shiro::users::activity::init() {
+    scheduler.schedule_every(1min, "users::activity", []() {
+        flush();
     });
 }
 
+void shiro::users::activity::flush() {
+    std::vector<std::pair<int32_t, int64_t>> snapshot;
+    std::unordered_map<int32_t, int64_t> departed_users;
+
+    // Only copy under the manager lock, logins and logouts wait for it
+    users::manager::iterate([&snapshot](std::shared_ptr<users::user> user) {
+        snapshot.emplace_back(user->user_id, user->last_ping.count());
+    }, true);
+
+    {
+        std::lock_guard<std::mutex> lock(departed_mutex);
+        departed_users.swap(departed);
+    }
+
+    // Online users whose stored last_seen is current, users that went offline are dropped from it
+    std::unordered_map<int32_t, int64_t> written;
+    std::vector<std::pair<int32_t, int64_t>> dirty;
+
+    written.reserve(snapshot.size());
+
+    for (const auto &[user_id, last_ping] : snapshot) {
+        // Logged in again since, the current session has the newer ping
+        departed_users.erase(user_id);
+
+        auto iterator = flushed.find(user_id);
+
+        if (iterator == flushed.end() || iterator->second != last_ping)
+            dirty.emplace_back(user_id, last_ping);
+        else
+            written[user_id] = last_ping;
+    }
+
+    size_t online = dirty.size();
+
+    for (const auto &[user_id, last_ping] : departed_users) {
+        auto iterator = flushed.find(user_id);
+
+        if (iterator == flushed.end() || iterator->second != last_ping)
+            dirty.emplace_back(user_id, last_ping);
+    }
+
+    size_t begin = 0;
+
+    try {
+        if (!dirty.empty()) {
+            auto db = db_connection->get_connection();
+
+            for (; begin < dirty.size(); begin += batch_size) {
+                size_t end = std::min(begin + batch_size, dirty.size());
+
+                std::string cases;
+                std::string ids;
+
+                for (size_t i = begin; i < end; i++) {
+                    const auto &[user_id, last_ping] = dirty.at(i);
+
+                    cases += " WHEN " + std::to_string(user_id) + " THEN " + std::to_string(last_ping);
+
+                    if (!ids.empty())
+                        ids += ", ";
+
+                    ids += std::to_string(user_id);
+                }
+
+                db->execute("UPDATE `users` SET last_seen = CASE id" + cases + " ELSE last_seen END WHERE id IN (" + ids + ");");
+
+                for (size_t i = begin; i < std::min(end, online); i++) {
+                    written.insert(dirty.at(i));
+                }
+            }
+        }
+    } catch (const sqlpp::exception &ex) {
+        LOG_F(ERROR, "Unable to write last seen of %zu users, retrying with the next flush: %s", dirty.size() - begin, ex.what());
+
+        // Online users that weren't written are missing from written and are retried anyway
+        std::lock_guard<std::mutex> lock(departed_mutex);
+
+        for (size_t i = std::max(begin, online); i < dirty.size(); i++) {
+            const auto &[user_id, last_ping] = dirty.at(i);
+            int64_t &final_ping = departed[user_id];
+
+            final_ping = std::max(final_ping, last_ping);
+        }
+    }
+
+    flushed = std::move(written);
+}
+
+void shiro::users::activity::logout(int32_t user_id, int64_t last_ping) {
+    std::lock_guard<std::mutex> lock(departed_mutex);
+    int64_t &final_ping = departed[user_id];
+
+    final_ping = std::max(final_ping, last_ping);
+}
+
 bool shiro::users::activity::is_inactive(int32_t id, const utils::play_mode &mode) {
     using days = std::chrono::duration<int32_t, std::ratio<86400>>;
 
@@ -19,12 +19,21 @@
 #ifndef SHIRO_USER_ACTIVITY_HH
 #define SHIRO_USER_ACTIVITY_HH
 
+#include <cstdint>
+
 #include "../utils/play_mode.hh"
 
 namespace shiro::users::activity {
 
     void init();
 
+    // Writes last_seen of every online user whose last ping changed since the previous flush,
+    // and of users that logged out since then
+    void flush();
+
+    // Keeps the final ping of a user that logged out, it is written with the next flush
+    void logout(int32_t user_id, int64_t last_ping);
+
     // A user is inactive if they haven't submitted a score in over 90 days
     bool is_inactive(int32_t id, const utils::play_mode &mode);
 
@@ -0,0 +1,112 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHIRO_USER_INDEX_HH
+#define SHIRO_USER_INDEX_HH
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace shiro::users {
+
+    class user;
+
+    // Hash index over online users split into independently locked shards, so lookups
+    // for different keys do not contend on one lock. Multiple sessions may share a key
+    // (e.g. tournament clients logged into the same account), the oldest one is returned.
+    template <typename K, size_t shard_count = 16>
+    class sharded_index {
+    private:
+        struct shard {
+            std::shared_timed_mutex mutex;
+            std::unordered_map<K, std::vector<std::shared_ptr<user>>> entries;
+        };
+
+        std::array<shard, shard_count> shards;
+
+        shard &get_shard(const K &key) {
+            return this->shards[std::hash<K>()(key) % shard_count];
+        }
+
+    public:
+        void insert(const K &key, const std::shared_ptr<user> &value) {
+            shard &target = this->get_shard(key);
+            std::unique_lock<std::shared_timed_mutex> lock(target.mutex);
+
+            target.entries[key].emplace_back(value);
+        }
+
+        void erase(const K &key, const std::shared_ptr<user> &value) {
+            shard &target = this->get_shard(key);
+            std::unique_lock<std::shared_timed_mutex> lock(target.mutex);
+
+            auto iterator = target.entries.find(key);
+
+            if (iterator == target.entries.end())
+                return;
+
+            std::vector<std::shared_ptr<user>> &sessions = iterator->second;
+            sessions.erase(std::remove(sessions.begin(), sessions.end(), value), sessions.end());
+
+            if (sessions.empty())
+                target.entries.erase(iterator);
+        }
+
+        std::shared_ptr<user> find(const K &key) {
+            shard &target = this->get_shard(key);
+            std::shared_lock<std::shared_timed_mutex> lock(target.mutex);
+
+            auto iterator = target.entries.find(key);
+
+            if (iterator == target.entries.end())
+                return nullptr;
+
+            return iterator->second.front();
+        }
+
+        bool contains(const K &key) {
+            shard &target = this->get_shard(key);
+            std::shared_lock<std::shared_timed_mutex> lock(target.mutex);
+
+            return target.entries.find(key) != target.entries.end();
+        }
+
+        bool contains(const K &key, const std::shared_ptr<user> &value) {
+            shard &target = this->get_shard(key);
+            std::shared_lock<std::shared_timed_mutex> lock(target.mutex);
+
+            auto iterator = target.entries.find(key);
+
+            if (iterator == target.entries.end())
+                return false;
+
+            const std::vector<std::shared_ptr<user>> &sessions = iterator->second;
+            return std::find(sessions.begin(), sessions.end(), value) != sessions.end();
+        }
+
+    };
+
+}
+
+#endif //SHIRO_USER_INDEX_HH
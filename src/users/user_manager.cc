@@ -17,15 +17,24 @@
  */
 
 #include <algorithm>
+#include <unordered_set>
+#include <boost/algorithm/string/case_conv.hpp>
 
 #include "../database/tables/user_table.hh"
 #include "../thirdparty/loguru.hh"
 #include "../utils/osu_client.hh"
+#include "user_activity.hh"
+#include "user_index.hh"
 #include "user_manager.hh"
 
 std::vector<std::shared_ptr<shiro::users::user>> shiro::users::manager::online_users;
 std::shared_timed_mutex shiro::users::manager::mutex;
 
+// Lookup indexes, only modified while holding the unique lock on the manager mutex
+static shiro::users::sharded_index<int32_t> id_index;
+static shiro::users::sharded_index<std::string> token_index;
+static shiro::users::sharded_index<std::string> username_index;
+
 void shiro::users::manager::login_user(std::shared_ptr<shiro::users::user> user) {
     if (user == nullptr || user->token.empty())
         return;
@@ -33,10 +42,16 @@ void shiro::users::manager::login_user(std::shared_ptr<shiro::users::user> user)
     if (is_online(user))
         logout_user(user);
 
-    // Disallow other threads from both writing and reading
-    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    {
+        // Disallow other threads from both writing and reading
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+
+        online_users.emplace_back(user);
 
-    online_users.emplace_back(user);
+        id_index.insert(user->user_id, user);
+        token_index.insert(user->token, user);
+        username_index.insert(boost::algorithm::to_lower_copy(user->presence.username), user);
+    }
 
     LOG_F(INFO, "User %s logged in successfully.", user->presence.username.c_str());
 
@@ -48,138 +63,92 @@ void shiro::users::manager::logout_user(std::shared_ptr<shiro::users::user> user
     if (user == nullptr || !is_online(user))
         return;
 
-    // Disallow other threads from both writing and reading
-    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    logout_users({ user });
+}
 
-    auto iterator = std::find(online_users.begin(), online_users.end(), user);
+void shiro::users::manager::logout_users(const std::vector<std::shared_ptr<shiro::users::user>> &users) {
+    std::vector<std::shared_ptr<user>> removed;
+    std::unordered_set<const user*> removed_pointers;
 
-    if (iterator == online_users.end())
-        return;
+    {
+        // Disallow other threads from both writing and reading
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
 
-    online_users.erase(iterator);
+        for (const std::shared_ptr<user> &user : users) {
+            if (user == nullptr || !id_index.contains(user->user_id, user))
+                continue;
 
-    LOG_F(INFO, "User %s logged out successfully.", user->presence.username.c_str());
+            removed.emplace_back(user);
+            removed_pointers.insert(user.get());
 
-    if (user->client_type != +utils::clients::osu_client::aschente && !user->hidden)
-        redis_connection->get()->decr("shiro.online_users", nullptr).commit();
-}
-
-void shiro::users::manager::logout_user(int32_t user_id) {
-    if (!is_online(user_id))
-        return;
+            id_index.erase(user->user_id, user);
+            token_index.erase(user->token, user);
+            username_index.erase(boost::algorithm::to_lower_copy(user->presence.username), user);
+        }
 
-    std::shared_ptr<user> target_user = nullptr;
-    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+        if (removed.empty())
+            return;
 
-    for (const std::shared_ptr<user> &user : online_users) {
-        if (user->user_id == user_id) {
-            target_user = user;
-            break;
-        }
+        // A single pass keeps the login order no matter how many users are removed
+        online_users.erase(std::remove_if(online_users.begin(), online_users.end(), [&removed_pointers](const std::shared_ptr<user> &user) {
+            return removed_pointers.find(user.get()) != removed_pointers.end();
+        }), online_users.end());
     }
 
-    if (target_user == nullptr)
-        return;
+    // Redis and the activity log are slow compared to the indexes, nobody waits on the lock for them
+    int32_t visible = 0;
+
+    for (const std::shared_ptr<user> &user : removed) {
+        activity::logout(user->user_id, user->last_ping.count());
 
-    // Release the lock so we can logout without dead-locking
-    lock.release();
+        LOG_F(INFO, "User %s logged out successfully.", user->presence.username.c_str());
 
-    logout_user(target_user);
+        if (user->client_type != +utils::clients::osu_client::aschente && !user->hidden)
+            visible++;
+    }
+
+    if (visible > 0)
+        redis_connection->get()->decrby("shiro.online_users", visible, nullptr).commit();
+}
+
+void shiro::users::manager::logout_user(int32_t user_id) {
+    logout_user(get_user_by_id(user_id));
 }
 
 bool shiro::users::manager::is_online(std::shared_ptr<shiro::users::user> user) {
     if (user == nullptr)
         return false;
 
-    // Disallow other threads from writing (but not from reading)
-    std::shared_lock<std::shared_timed_mutex> lock(mutex);
-
-    return std::find(online_users.begin(), online_users.end(), user) != online_users.end();
+    return id_index.contains(user->user_id, user);
 }
 
 bool shiro::users::manager::is_online(int32_t user_id) {
-    // Disallow other threads from writing (but not from reading)
-    std::shared_lock<std::shared_timed_mutex> lock(mutex);
-
-    for (const std::shared_ptr<user> &user : online_users) {
-        if (user->user_id != user_id)
-            continue;
-
-        return true;
-    }
-
-    return false;
+    return id_index.contains(user_id);
 }
 
 bool shiro::users::manager::is_online(const std::string &token) {
     if (token.empty())
         return false;
 
-    // Disallow other threads from writing (but not from reading)
-    std::shared_lock<std::shared_timed_mutex> lock(mutex);
-
-    for (const std::shared_ptr<user> &user : online_users) {
-        if (user->token != token)
-            continue;
-
-        return true;
-    }
-
-    return false;
+    return token_index.contains(token);
 }
 
 std::shared_ptr<shiro::users::user> shiro::users::manager::get_user_by_username(const std::string &username) {
     if (username.empty())
         return nullptr;
 
-    // Disallow other threads from writing (but not from reading)
-    std::shared_lock<std::shared_timed_mutex> lock(mutex);
-
-    for (const std::shared_ptr<user> &user : online_users) {
-        if (user->presence.username != username)
-            continue;
-
-        return user;
-    }
-
-    return nullptr;
+    return username_index.find(boost::algorithm::to_lower_copy(username));
 }
 
 std::shared_ptr<shiro::users::user> shiro::users::manager::get_user_by_id(int32_t id) {
-    if (!is_online(id))
-        return nullptr;
-
-    // Disallow other threads from writing (but not from reading)
-    std::shared_lock<std::shared_timed_mutex> lock(mutex);
-
-    for (const std::shared_ptr<user> &user : online_users) {
-        if (user->user_id != id)
-            continue;
-
-        return user;
-    }
-
-    return nullptr;
+    return id_index.find(id);
 }
 
 std::shared_ptr<shiro::users::user> shiro::users::manager::get_user_by_token(const std::string &token) {
     if (token.empty())
         return nullptr;
 
-    if (!is_online(token))
-        return nullptr;
-
-    // Disallow other threads from writing (but not from reading)
-    std::shared_lock<std::shared_timed_mutex> lock(mutex);
-
-    for (const std::shared_ptr<user> &user : online_users) {
-        if (user->token != token)
-            continue;
-
-        return user;
-    }
-
-    return nullptr;
+    return token_index.find(token);
 }
 
 std::string shiro::users::manager::get_username_by_id(int32_t id) {
@@ -188,7 +157,7 @@ std::string shiro::users::manager::get_username_by_id(int32_t id) {
     if (user != nullptr)
         return user->presence.username;
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::users user_table {};
 
     auto result = db(select(all_of(user_table)).from(user_table).where(user_table.id == id).limit(1u));
@@ -205,7 +174,7 @@ int32_t shiro::users::manager::get_id_by_username(const std::string &username) {
     if (user != nullptr)
         return user->user_id;
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::users user_table {};
 
     auto result = db(select(all_of(user_table)).from(user_table).where(user_table.username == username).limit(1u));
@@ -242,6 +211,31 @@ void shiro::users::manager::iterate(const std::function<void(size_t, std::shared
     }
 }
 
+void shiro::users::manager::broadcast(shiro::io::osu_writer &writer, bool skip_bot, bool skip_hidden, const std::function<bool(std::shared_ptr<user>)> &filter) {
+    if (writer.get_buffer().is_empty())
+        return;
+
+    broadcast(io::make_chunk(writer), skip_bot, skip_hidden, filter);
+}
+
+void shiro::users::manager::broadcast(const shiro::io::packet_chunk &chunk, bool skip_bot, bool skip_hidden, const std::function<bool(std::shared_ptr<user>)> &filter) {
+    // Disallow other threads from writing (but not from reading)
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+
+    for (const std::shared_ptr<user> &user : online_users) {
+        if (skip_bot && user->user_id == 1)
+            continue;
+
+        if (skip_hidden && user->hidden)
+            continue;
+
+        if (filter && !filter(user))
+            continue;
+
+        user->queue.enqueue(chunk);
+    }
+}
+
 size_t shiro::users::manager::get_online_users() {
     // Disallow other threads from writing (but not from reading)
     std::shared_lock<std::shared_timed_mutex> lock(mutex);
@@ -19,14 +19,19 @@
 #ifndef SHIRO_USER_MANAGER_HH
 #define SHIRO_USER_MANAGER_HH
 
+#include <functional>
 #include <memory>
 #include <shared_mutex>
 #include <vector>
 
+#include "../io/osu_writer.hh"
+#include "../io/queue.hh"
+
 #include "user.hh"
 
 namespace shiro::users::manager {
 
+    // Online users in login order, lookups by id, token or username go through hashed indexes instead
     extern std::vector<std::shared_ptr<user>> online_users;
     extern std::shared_timed_mutex mutex;
 
@@ -37,10 +42,14 @@ namespace shiro::users::manager {
     void logout_user(std::shared_ptr<user> user);
     void logout_user(int32_t user_id);
 
+    // Removes several users at once, cheaper than one logout_user call per user
+    void logout_users(const std::vector<std::shared_ptr<user>> &users);
+
     bool is_online(std::shared_ptr<user> user);
     bool is_online(int32_t user_id);
     bool is_online(const std::string &token);
 
+    // Username lookups are case-insensitive
     std::shared_ptr<user> get_user_by_username(const std::string &username);
     std::shared_ptr<user> get_user_by_id(int32_t id);
     std::shared_ptr<user> get_user_by_token(const std::string &token);
@@ -53,6 +62,10 @@ namespace shiro::users::manager {
     void iterate(const std::function<void(std::shared_ptr<user>)> &callback, bool skip_bot = false);
     void iterate(const std::function<void(size_t, std::shared_ptr<user>)> &callback, bool skip_bot = false);
 
+    // Serializes the packets once and shares them with the queue of every online user that passes the filters
+    void broadcast(io::osu_writer &writer, bool skip_bot = true, bool skip_hidden = false, const std::function<bool(std::shared_ptr<user>)> &filter = nullptr);
+    void broadcast(const io::packet_chunk &chunk, bool skip_bot = true, bool skip_hidden = false, const std::function<bool(std::shared_ptr<user>)> &filter = nullptr);
+
     size_t get_online_users();
 
 }
@@ -16,8 +16,18 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "../config/ipc_file.hh"
 #include "../database/tables/punishments_table.hh"
+#include "../ranking/ranking_helper.hh"
+#include "../scores/leaderboard_cache.hh"
 #include "../thirdparty/loguru.hh"
 #include "../utils/bot_utils.hh"
 #include "../utils/login_responses.hh"
@@ -26,69 +36,81 @@
 #include "user_manager.hh"
 #include "user_punishments.hh"
 
-void shiro::users::punishments::init() {
-    scheduler.Schedule(1min, [](tsc::TaskContext ctx) {
-        sqlpp::mysql::connection db(db_connection->get_config());
-        const tables::punishments punishments_table {};
+namespace shiro::users::punishments {
 
-        auto result = db(select(all_of(punishments_table)).from(punishments_table).where(
-                punishments_table.active == true
-        ));
+    constexpr int64_t permanent = std::numeric_limits<int64_t>::max();
 
-        if (result.empty()) {
-            ctx.Repeat();
-            return;
-        }
+    // Active punishments of a single user, each punishment is active until the stored unix timestamp
+    struct state {
+        int64_t silenced_until = 0;
+        int64_t restricted_until = 0;
+        int64_t banned_until = 0;
 
-        std::chrono::seconds seconds = std::chrono::duration_cast<std::chrono::seconds>(
-                std::chrono::system_clock::now().time_since_epoch()
-        );
+        int32_t silence_time = 0;
+        uint32_t silence_duration = 0;
+    };
 
-        for (const auto &row : result) {
-            if (row.duration.is_null())
-                continue;
+    struct expiry {
+        int32_t id = 0;
+        int32_t user_id = 0;
+        utils::punishment_type type = utils::punishment_type::kick;
+    };
 
-            utils::punishment_type type = (utils::punishment_type) static_cast<uint16_t>(row.type);
-            int32_t timestamp = row.time;
-            int32_t duration = row.duration;
+    using state_map = std::unordered_map<int32_t, state>;
 
-            if (seconds.count() >= (timestamp + duration)) {
-                db(update(punishments_table).set(
-                        punishments_table.active = false
-                ).where(punishments_table.id == row.id));
-
-                switch (type) {
-                    case utils::punishment_type::silence: {
-                        LOG_F(INFO, "User %i has been unsilenced automatically.", (int32_t) row.id);
-                        break;
-                    }
-                    case utils::punishment_type::restrict: {
-                        std::shared_ptr<user> user = manager::get_user_by_id(row.id);
-
-                        if (user != nullptr) {
-                            io::osu_writer writer;
-
-                            writer.announce("Your restriction has ended. Please login again.");
-                            writer.login_reply((int32_t) utils::login_responses::account_password_reset);
-
-                            user->queue.enqueue(writer);
-                        }
-
-                        LOG_F(INFO, "User %i has been unrestricted automatically.", (int32_t) row.id);
-                        break;
-                    }
-                    case utils::punishment_type::ban: {
-                        LOG_F(INFO, "User %i has been unbanned automatically.", (int32_t) row.id);
-                        break;
-                    }
-                    default: {
-                        break;
-                    }
-                }
-            }
-        }
+    static state_map active;
+    static std::shared_timed_mutex mutex;
+
+    // Punishments with a duration ordered by the time they end, guarded by update_mutex
+    static std::multimap<int64_t, expiry> deadlines;
+
+    // Deadline the pending expiry task fires at, 0 if none is scheduled. Guarded by update_mutex
+    static int64_t armed_deadline = 0;
+
+    // Restoring a user needs the rankings, which are initialized after punishments
+    static int64_t first_expiry = 0;
+
+    // Number and id sum of the active rows as shiro last wrote or loaded them, guarded by update_mutex.
+    // A different result from the database means punishments were changed outside of shiro.
+    static int64_t known_rows = 0;
+    static int64_t known_id_sum = 0;
+
+    SQLPP_ALIAS_PROVIDER(active_rows);
+    SQLPP_ALIAS_PROVIDER(active_id_sum);
+
+    // Serializes database writes with reloads so a reload can't drop a punishment that was just inserted
+    static std::mutex update_mutex;
+
+    // The initial load doesn't notify, rankings aren't initialized yet at that point
+    static void refresh(bool initial);
+
+    // Reloads all active punishments if they were changed directly in the database
+    static void check();
+
+    // Schedules expire() for the earliest deadline unless it already runs by then, needs update_mutex
+    static void arm();
+
+    // Deactivates all punishments that have ended in a single statement
+    static void expire(int64_t deadline);
+
+    static void add(state_map &states, int32_t user_id, utils::punishment_type type, int32_t time, int64_t until);
 
-        ctx.Repeat();
+    static void notify(int32_t user_id, bool has_scores);
+
+    static state get_state(int32_t user_id);
+
+    static int64_t get_current_time();
+
+}
+
+void shiro::users::punishments::init() {
+    first_expiry = get_current_time() + 60;
+
+    refresh(true);
+
+    // Punishments can also be lifted by changing the database directly
+    scheduler.schedule_every(1min, "users::punishments::check", []() {
+        check();
     });
 }
 
@@ -97,7 +119,7 @@ void shiro::users::punishments::kick(int32_t user_id, int32_t origin, const std:
             std::chrono::system_clock::now().time_since_epoch()
     );
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::punishments punishments_table {};
 
     db(insert_into(punishments_table).set(
@@ -127,6 +149,8 @@ void shiro::users::punishments::kick(int32_t user_id, int32_t origin, const std:
 }
 
 void shiro::users::punishments::silence(int32_t user_id, int32_t origin, uint32_t duration, const std::string &reason) {
+    std::unique_lock<std::mutex> update_lock(update_mutex);
+
     if (is_silenced(user_id))
         return;
 
@@ -134,10 +158,14 @@ void shiro::users::punishments::silence(int32_t user_id, int32_t origin, uint32_
             std::chrono::system_clock::now().time_since_epoch()
     );
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::punishments punishments_table {};
 
-    db(insert_into(punishments_table).set(
+    expiry entry;
+
+    entry.user_id = user_id;
+    entry.type = utils::punishment_type::silence;
+    entry.id = db(insert_into(punishments_table).set(
             punishments_table.user_id = user_id,
             punishments_table.origin_id = origin,
             punishments_table.type = (uint16_t) utils::punishment_type::silence,
@@ -147,6 +175,19 @@ void shiro::users::punishments::silence(int32_t user_id, int32_t origin, uint32_
             punishments_table.reason = reason
     ));
 
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+        add(active, user_id, utils::punishment_type::silence, seconds.count(), seconds.count() + duration);
+    }
+
+    deadlines.emplace(seconds.count() + duration, entry);
+
+    known_rows++;
+    known_id_sum += entry.id;
+
+    arm();
+    update_lock.unlock();
+
     std::shared_ptr<user> user = manager::get_user_by_id(user_id);
     std::string username = manager::get_username_by_id(user_id);
     std::string origin_username = manager::get_username_by_id(origin);
@@ -159,9 +200,7 @@ void shiro::users::punishments::silence(int32_t user_id, int32_t origin, uint32_
     io::osu_writer global_writer;
     global_writer.user_silenced(user_id);
 
-    users::manager::iterate([user, &global_writer](std::shared_ptr<users::user> online_user) {
-        online_user->queue.enqueue(global_writer);
-    }, true);
+    users::manager::broadcast(global_writer);
 
     utils::bot::respond(
             "You have been silenced for " + std::to_string(duration) + " seconds for " + reason + ".",
@@ -175,6 +214,8 @@ void shiro::users::punishments::silence(int32_t user_id, int32_t origin, uint32_
 }
 
 void shiro::users::punishments::restrict(int32_t user_id, int32_t origin, const std::string &reason) {
+    std::unique_lock<std::mutex> update_lock(update_mutex);
+
     if (is_restricted(user_id))
         return;
 
@@ -182,10 +223,10 @@ void shiro::users::punishments::restrict(int32_t user_id, int32_t origin, const
             std::chrono::system_clock::now().time_since_epoch()
     );
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::punishments punishments_table {};
 
-    db(insert_into(punishments_table).set(
+    int32_t id = db(insert_into(punishments_table).set(
             punishments_table.user_id = user_id,
             punishments_table.origin_id = origin,
             punishments_table.type = (uint16_t) utils::punishment_type::restrict,
@@ -194,12 +235,25 @@ void shiro::users::punishments::restrict(int32_t user_id, int32_t origin, const
             punishments_table.reason = reason
     ));
 
+    known_rows++;
+    known_id_sum += id;
+
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+        add(active, user_id, utils::punishment_type::restrict, seconds.count(), permanent);
+    }
+
+    update_lock.unlock();
+
     std::shared_ptr<user> user = manager::get_user_by_id(user_id);
     std::string username = manager::get_username_by_id(user_id);
     std::string origin_username = manager::get_username_by_id(origin);
 
     LOG_F(INFO, "%s has been restricted for %s by %s.", username.c_str(), reason.c_str(), origin_username.c_str());
 
+    ranking::helper::remove_user(user_id);
+    scores::leaderboard_cache::clear();
+
     if (user == nullptr)
         return;
 
@@ -221,15 +275,14 @@ void shiro::users::punishments::restrict(int32_t user_id, int32_t origin, const
 
     writer.user_quit(quit);
 
-    users::manager::iterate([user_id, &writer](std::shared_ptr<users::user> online_user) {
-        if (online_user->user_id == user_id)
-            return;
-
-        online_user->queue.enqueue(writer);
+    users::manager::broadcast(writer, true, false, [user_id](std::shared_ptr<users::user> online_user) {
+        return online_user->user_id != user_id;
     });
 }
 
 void shiro::users::punishments::ban(int32_t user_id, int32_t origin, const std::string &reason) {
+    std::unique_lock<std::mutex> update_lock(update_mutex);
+
     if (is_banned(user_id))
         return;
 
@@ -237,10 +290,10 @@ void shiro::users::punishments::ban(int32_t user_id, int32_t origin, const std::
             std::chrono::system_clock::now().time_since_epoch()
     );
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    auto db = db_connection->get_connection();
     const tables::punishments punishments_table {};
 
-    db(insert_into(punishments_table).set(
+    int32_t id = db(insert_into(punishments_table).set(
             punishments_table.user_id = user_id,
             punishments_table.origin_id = origin,
             punishments_table.type = (uint16_t) utils::punishment_type::ban,
@@ -249,12 +302,25 @@ void shiro::users::punishments::ban(int32_t user_id, int32_t origin, const std::
             punishments_table.reason = reason
     ));
 
+    known_rows++;
+    known_id_sum += id;
+
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+        add(active, user_id, utils::punishment_type::ban, seconds.count(), permanent);
+    }
+
+    update_lock.unlock();
+
     std::shared_ptr<user> user = manager::get_user_by_id(user_id);
     std::string username = manager::get_username_by_id(user_id);
     std::string origin_username = manager::get_username_by_id(origin);
 
     LOG_F(INFO, "%s has been banned for %s by %s.", username.c_str(), reason.c_str(), origin_username.c_str());
 
+    ranking::helper::remove_user(user_id);
+    scores::leaderboard_cache::clear();
+
     if (user == nullptr)
         return;
 
@@ -267,42 +333,15 @@ void shiro::users::punishments::ban(int32_t user_id, int32_t origin, const std::
 }
 
 bool shiro::users::punishments::is_silenced(int32_t user_id) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::punishments punishments_table {};
-
-    auto result = db(select(all_of(punishments_table)).from(punishments_table).where(
-            punishments_table.user_id == user_id and
-            punishments_table.type == (uint16_t) utils::punishment_type::silence and
-            punishments_table.active == true
-    ).limit(1u));
-
-    return !result.empty();
+    return get_current_time() < get_state(user_id).silenced_until;
 }
 
 bool shiro::users::punishments::is_restricted(int32_t user_id) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::punishments punishments_table {};
-
-    auto result = db(select(all_of(punishments_table)).from(punishments_table).where(
-            punishments_table.user_id == user_id and
-            punishments_table.type == (uint16_t) utils::punishment_type::restrict and
-            punishments_table.active == true
-    ).limit(1u));
-
-    return !result.empty();
+    return get_current_time() < get_state(user_id).restricted_until;
 }
 
 bool shiro::users::punishments::is_banned(int32_t user_id) {
-    sqlpp::mysql::connection db(db_connection->get_config());
-    const tables::punishments punishments_table {};
-
-    auto result = db(select(all_of(punishments_table)).from(punishments_table).where(
-            punishments_table.user_id == user_id and
-            punishments_table.type == (uint16_t) utils::punishment_type::ban and
-            punishments_table.active == true
-    ).limit(1u));
-
-    return !result.empty();
+    return get_current_time() < get_state(user_id).banned_until;
 }
 
 bool shiro::users::punishments::can_chat(int32_t user_id) {
@@ -322,22 +361,285 @@ bool shiro::users::punishments::has_scores(int32_t user_id) {
 }
 
 std::tuple<int32_t, uint32_t> shiro::users::punishments::get_silence_time(int32_t user_id) {
-    if (!is_silenced(user_id))
+    state current = get_state(user_id);
+
+    if (get_current_time() >= current.silenced_until)
         return {};
 
-    sqlpp::mysql::connection db(db_connection->get_config());
+    return std::make_pair(current.silence_time, current.silence_duration);
+}
+
+void shiro::users::punishments::refresh(bool initial) {
+    std::unique_lock<std::mutex> update_lock(update_mutex);
+
+    auto db = db_connection->get_connection();
     const tables::punishments punishments_table {};
 
     auto result = db(select(all_of(punishments_table)).from(punishments_table).where(
-            punishments_table.user_id == user_id and
-            punishments_table.type == (uint16_t) utils::punishment_type::silence and
             punishments_table.active == true
-    ).limit(1u));
+    ));
+
+    state_map states;
+    std::multimap<int64_t, expiry> scheduled;
+
+    known_rows = 0;
+    known_id_sum = 0;
+
+    for (const auto &row : result) {
+        expiry entry;
+
+        entry.id = row.id;
+        entry.user_id = row.user_id;
+        entry.type = (utils::punishment_type) static_cast<uint16_t>(row.type);
+
+        int32_t timestamp = row.time;
+        int64_t until = permanent;
+
+        if (!row.duration.is_null()) {
+            int32_t duration = row.duration;
+
+            until = (int64_t) timestamp + duration;
+            scheduled.emplace(until, entry);
+        }
+
+        add(states, entry.user_id, entry.type, timestamp, until);
+
+        known_rows++;
+        known_id_sum += entry.id;
+    }
+
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+        std::swap(states, active);
+    }
+
+    deadlines = std::move(scheduled);
+    arm();
 
-    if (result.empty())
+    update_lock.unlock();
+
+    if (initial)
+        return;
+
+    const state_map &previous = states;
+    int64_t now = get_current_time();
+
+    auto scored = [now](const state &s) {
+        return now >= s.restricted_until && now >= s.banned_until;
+    };
+
+    std::vector<std::pair<int32_t, bool>> changes;
+
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(mutex);
+
+        for (const auto &[user_id, before] : previous) {
+            auto iterator = active.find(user_id);
+            bool after = iterator == active.end() || scored(iterator->second);
+
+            if (scored(before) != after)
+                changes.emplace_back(user_id, after);
+        }
+
+        for (const auto &[user_id, after] : active) {
+            if (previous.find(user_id) == previous.end() && !scored(after))
+                changes.emplace_back(user_id, false);
+        }
+    }
+
+    for (const auto &[user_id, has_scores] : changes) {
+        notify(user_id, has_scores);
+    }
+}
+
+void shiro::users::punishments::check() {
+    {
+        std::lock_guard<std::mutex> update_lock(update_mutex);
+
+        auto db = db_connection->get_connection();
+        const tables::punishments punishments_table {};
+
+        // Only reads the index on active, instead of loading every active punishment
+        auto result = db(select(
+                sqlpp::count(punishments_table.id).as(active_rows),
+                sqlpp::sum(punishments_table.id).as(active_id_sum)
+        ).from(punishments_table).where(punishments_table.active == true));
+
+        const auto &row = result.front();
+        int64_t rows = row.active_rows;
+        int64_t id_sum = row.active_id_sum.is_null() ? 0 : (int64_t) row.active_id_sum;
+
+        if (rows == known_rows && id_sum == known_id_sum)
+            return;
+    }
+
+    LOG_F(INFO, "Punishments have been changed in the database, reloading them.");
+    refresh(false);
+}
+
+void shiro::users::punishments::arm() {
+    if (deadlines.empty())
+        return;
+
+    int64_t deadline = std::max(deadlines.begin()->first, first_expiry);
+
+    if (armed_deadline != 0 && armed_deadline <= deadline)
+        return;
+
+    armed_deadline = deadline;
+
+    // Deadlines are whole seconds, counting from the current whole second never fires early
+    std::chrono::seconds delay(std::max<int64_t>(deadline - get_current_time(), 0));
+
+    scheduler.schedule(delay, "users::punishments::expire", [deadline](task_scheduler::context &) {
+        expire(deadline);
+    });
+}
+
+void shiro::users::punishments::expire(int64_t deadline) {
+    std::unique_lock<std::mutex> update_lock(update_mutex);
+    int64_t now = get_current_time();
+
+    // An earlier deadline was armed since this one, that task has taken over
+    if (armed_deadline != deadline)
+        return;
+
+    armed_deadline = 0;
+
+    if (deadlines.empty() || deadlines.begin()->first > now) {
+        arm();
+        return;
+    }
+
+    auto end = deadlines.upper_bound(now);
+    std::vector<expiry> expired;
+    std::vector<int32_t> ids;
+
+    for (auto iterator = deadlines.begin(); iterator != end; iterator++) {
+        expired.emplace_back(iterator->second);
+        ids.emplace_back(iterator->second.id);
+
+        known_rows--;
+        known_id_sum -= iterator->second.id;
+    }
+
+    deadlines.erase(deadlines.begin(), end);
+    arm();
+
+    auto db = db_connection->get_connection();
+    const tables::punishments punishments_table {};
+
+    db(update(punishments_table).set(
+            punishments_table.active = false
+    ).where(punishments_table.id.in(sqlpp::value_list(ids))));
+
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+
+        for (const expiry &entry : expired) {
+            auto iterator = active.find(entry.user_id);
+
+            if (iterator == active.end())
+                continue;
+
+            const state &current = iterator->second;
+
+            if (now >= current.silenced_until && now >= current.restricted_until && now >= current.banned_until)
+                active.erase(iterator);
+        }
+    }
+
+    update_lock.unlock();
+
+    for (const expiry &entry : expired) {
+        switch (entry.type) {
+            case utils::punishment_type::silence: {
+                LOG_F(INFO, "User %i has been unsilenced automatically.", entry.user_id);
+                break;
+            }
+            case utils::punishment_type::restrict: {
+                std::shared_ptr<user> user = manager::get_user_by_id(entry.user_id);
+
+                if (user != nullptr && !is_restricted(entry.user_id)) {
+                    io::osu_writer writer;
+
+                    writer.announce("Your restriction has ended. Please login again.");
+                    writer.login_reply((int32_t) utils::login_responses::account_password_reset);
+
+                    user->queue.enqueue(writer);
+                }
+
+                ranking::helper::restore_user(entry.user_id);
+                scores::leaderboard_cache::clear();
+
+                LOG_F(INFO, "User %i has been unrestricted automatically.", entry.user_id);
+                break;
+            }
+            case utils::punishment_type::ban: {
+                ranking::helper::restore_user(entry.user_id);
+                scores::leaderboard_cache::clear();
+
+                LOG_F(INFO, "User %i has been unbanned automatically.", entry.user_id);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
+
+void shiro::users::punishments::add(state_map &states, int32_t user_id, utils::punishment_type type, int32_t time, int64_t until) {
+    state &current = states[user_id];
+
+    switch (type) {
+        case utils::punishment_type::silence: {
+            if (until <= current.silenced_until)
+                break;
+
+            current.silenced_until = until;
+            current.silence_time = time;
+            current.silence_duration = (uint32_t) (until - time);
+            break;
+        }
+        case utils::punishment_type::restrict: {
+            current.restricted_until = std::max(current.restricted_until, until);
+            break;
+        }
+        case utils::punishment_type::ban: {
+            current.banned_until = std::max(current.banned_until, until);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void shiro::users::punishments::notify(int32_t user_id, bool has_scores) {
+    if (has_scores) {
+        ranking::helper::restore_user(user_id);
+        LOG_F(INFO, "User %i is no longer restricted or banned.", user_id);
+    } else {
+        ranking::helper::remove_user(user_id);
+        LOG_F(INFO, "User %i has been restricted or banned outside of shiro.", user_id);
+    }
+
+    scores::leaderboard_cache::clear();
+}
+
+shiro::users::punishments::state shiro::users::punishments::get_state(int32_t user_id) {
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    auto iterator = active.find(user_id);
+
+    if (iterator == active.end())
         return {};
 
-    const auto &row = result.front();
+    return iterator->second;
+}
 
-    return std::make_pair(row.time, row.duration);
+int64_t shiro::users::punishments::get_current_time() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+    ).count();
 }
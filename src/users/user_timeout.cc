@@ -16,48 +16,125 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <mutex>
+#include <vector>
 
+#include "../multiplayer/match_manager.hh"
 #include "../thirdparty/loguru.hh"
 #include "../shiro.hh"
 #include "user_timeout.hh"
 #include "user_manager.hh"
 
+namespace shiro::users::timeout {
+
+    // Seconds without a ping after which a user is logged out
+    constexpr int64_t timeout = 60;
+
+    // One bucket per second, deadlines are at most timeout seconds ahead so a bucket never holds a later turn
+    constexpr int64_t wheel_size = 64;
+
+    // Users are filed under the second their session would expire. Pings only update last_ping, once a bucket
+    // is due every user in it is either re-filed under their new deadline or timed out.
+    static std::array<std::vector<std::weak_ptr<user>>, wheel_size> wheel;
+    static int64_t position = 0;
+    static std::mutex mutex;
+
+    // Requires the mutex to be held
+    static void arm(const std::shared_ptr<user> &user, int64_t deadline);
+
+    static void sweep();
+
+    static int64_t get_current_time();
+
+}
+
 void shiro::users::timeout::init() {
-    scheduler.Schedule(60s, [](tsc::TaskContext ctx) {
-        std::vector<std::shared_ptr<users::user>> dead;
-        std::chrono::seconds now = std::chrono::duration_cast<std::chrono::seconds>(
-                std::chrono::system_clock::now().time_since_epoch()
-        );
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        position = get_current_time();
+    }
 
-        // Iterate over all users to find out which ones are dead
-        users::manager::iterate([now, &dead](std::shared_ptr<users::user> user) {
-            int64_t difference = std::chrono::duration_cast<std::chrono::seconds>(now - user->last_ping).count();
+    scheduler.schedule_every(1s, "users::timeout", []() {
+        sweep();
+    });
+}
 
-            if (difference < 60)
-                return;
+void shiro::users::timeout::watch(std::shared_ptr<user> user) {
+    // The bot never pings
+    if (user == nullptr || user->user_id == 1)
+        return;
 
-            dead.push_back(user);
-        }, true);
+    std::lock_guard<std::mutex> lock(mutex);
+    arm(user, user->last_ping.count() + timeout);
+}
+
+void shiro::users::timeout::arm(const std::shared_ptr<user> &user, int64_t deadline) {
+    // A deadline past the end of the wheel fires early and is simply re-filed
+    deadline = std::clamp(deadline, position + 1, position + wheel_size - 1);
 
-        io::osu_writer writer;
-        io::layouts::user_quit quit;
+    wheel.at(deadline % wheel_size).emplace_back(user);
+}
 
-        quit.state = 0;
+void shiro::users::timeout::sweep() {
+    int64_t now = get_current_time();
+    std::vector<std::shared_ptr<user>> dead;
 
-        for (const std::shared_ptr<users::user> &user : dead) {
-            LOG_F(WARNING, "User %s didn't send a ping in 60 seconds, timing out.", user->presence.username.c_str());
-            users::manager::logout_user(user);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
 
-            quit.user_id = user->user_id;
+        while (position < now) {
+            position++;
 
-            writer.user_quit(quit);
+            std::vector<std::weak_ptr<user>> due;
+            std::swap(due, wheel.at(position % wheel_size));
+
+            for (const std::weak_ptr<user> &entry : due) {
+                std::shared_ptr<user> user = entry.lock();
+
+                // Logged out or replaced by a newer session in the meantime
+                if (user == nullptr || !manager::is_online(user))
+                    continue;
+
+                int64_t deadline = user->last_ping.count() + timeout;
+
+                if (deadline > now) {
+                    arm(user, deadline);
+                    continue;
+                }
+
+                dead.emplace_back(user);
+            }
         }
+    }
 
-        users::manager::iterate([&writer](std::shared_ptr<users::user> user) {
-            user->queue.enqueue(writer);
-        }, true);
+    if (dead.empty())
+        return;
 
-        ctx.Repeat();
-    });
+    io::osu_writer writer;
+    io::layouts::user_quit quit;
+
+    quit.state = 0;
+
+    for (const std::shared_ptr<user> &user : dead) {
+        LOG_F(WARNING, "User %s didn't send a ping in %li seconds, timing out.", user->presence.username.c_str(), (long) timeout);
+        multiplayer::match_manager::leave_match(user);
+
+        if (user->hidden)
+            continue;
+
+        quit.user_id = user->user_id;
+        writer.user_quit(quit);
+    }
+
+    users::manager::logout_users(dead);
+    users::manager::broadcast(writer);
+}
+
+int64_t shiro::users::timeout::get_current_time() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+    ).count();
 }
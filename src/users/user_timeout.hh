@@ -19,10 +19,17 @@
 #ifndef SHIRO_USER_TIMEOUT_HH
 #define SHIRO_USER_TIMEOUT_HH
 
+#include <memory>
+
+#include "user.hh"
+
 namespace shiro::users::timeout {
 
     void init();
 
+    // Starts tracking the pings of a freshly logged in user, they are logged out after a minute without one
+    void watch(std::shared_ptr<user> user);
+
 }
 
 #endif //SHIRO_USER_TIMEOUT_HH
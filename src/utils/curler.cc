@@ -16,16 +16,77 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <curl/curl.h>
+#include <array>
+#include <mutex>
+#include <vector>
 
 #include "../config/direct_file.hh"
 #include "../logger/sentry_logger.hh"
 #include "../thirdparty/loguru.hh"
 #include "curler.hh"
 
+namespace shiro::utils::curl {
+
+    // Handles keep their connections and TLS sessions alive between requests
+    constexpr size_t max_idle_handles = 16;
+
+    static std::vector<CURL*> idle_handles;
+    static std::mutex handles_mutex;
+
+    static CURLSH *share = nullptr;
+    static std::array<std::mutex, CURL_LOCK_DATA_LAST> share_mutexes;
+
+    static CURL *acquire();
+    static void release(CURL *handle);
+
+    static std::tuple<bool, std::string> perform(CURL *handle, const std::string &url, std::string &output);
+
+    static void lock_share(CURL *handle, curl_lock_data data, curl_lock_access access, void *user_data);
+    static void unlock_share(CURL *handle, curl_lock_data data, void *user_data);
+
+}
+
+void shiro::utils::curl::init() {
+    if (share != nullptr)
+        return;
+
+    share = curl_share_init();
+
+    if (share == nullptr) {
+        LOG_F(WARNING, "Unable to create curl share handle, connections will not be shared between requests.");
+        return;
+    }
+
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_share);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    // Connections are not shared, the shared connection cache closes them far more eagerly than
+    // the cache of each pooled handle does
+}
+
+void shiro::utils::curl::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(handles_mutex);
+
+        for (CURL *handle : idle_handles) {
+            curl_easy_cleanup(handle);
+        }
+
+        idle_handles.clear();
+    }
+
+    if (share == nullptr)
+        return;
+
+    // Handles that are still in use keep the share alive, it is freed when the process exits
+    if (curl_share_cleanup(share) == CURLSHE_OK)
+        share = nullptr;
+}
+
 std::tuple<bool, std::string> shiro::utils::curl::get(const std::string &url) {
-    CURL *curl = curl_easy_init();
-    CURLcode status_code;
+    CURL *curl = acquire();
 
     if (curl == nullptr)
         return { false, "Unable to acquire curl handle." };
@@ -34,31 +95,19 @@ std::tuple<bool, std::string> shiro::utils::curl::get(const std::string &url) {
 
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, internal_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &output);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "shiro (https://github.com/Marc3842h/shiro)");
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 
-    status_code = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-
-    if (status_code == CURLE_OK) {
-        logging::sentry::http_request_out(url, "GET", status_code, url.find("/osu/") == std::string::npos ? output : "");
-        return { true, output };
-    }
-
-    output = curl_easy_strerror(status_code);
-
-    logging::sentry::http_request_out(url, "GET", status_code, output);
-    return { false, output };
+    return perform(curl, url, output);
 }
 
 std::tuple<bool, std::string> shiro::utils::curl::get_direct(const std::string &url) {
-    CURL *curl = curl_easy_init();
-    CURLcode status_code;
+    CURL *curl = acquire();
 
     if (curl == nullptr)
         return { false, "Unable to acquire curl handle." };
 
     std::string output;
+    struct curl_slist *chunk = nullptr;
 
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, internal_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &output);
@@ -80,10 +129,7 @@ std::tuple<bool, std::string> shiro::utils::curl::get_direct(const std::string &
             break;
         }
         case 2: {
-            curl_easy_setopt(curl, CURLOPT_USERAGENT, "shiro (https://github.com/Marc3842h/shiro)");
-
             static std::string header = "Token: " + config::direct::api_key;
-            struct curl_slist *chunk = nullptr;
 
             chunk = curl_slist_append(chunk, "cho-server: shiro (https://github.com/Marc3842h/shiro)");
             chunk = curl_slist_append(chunk, "Content-Type: application/json");
@@ -98,8 +144,121 @@ std::tuple<bool, std::string> shiro::utils::curl::get_direct(const std::string &
         }
     }
 
-    status_code = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
+    auto result = perform(curl, url, output);
+
+    // Header list needs to outlive the request
+    curl_slist_free_all(chunk);
+
+    return result;
+}
+
+std::string shiro::utils::curl::escape_url(const std::string &raw) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    std::string result;
+    result.reserve(raw.size() * 3);
+
+    for (unsigned char c : raw) {
+        // Unreserved characters as defined in RFC 3986, same set curl_easy_escape keeps
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~') {
+            result.push_back((char) c);
+            continue;
+        }
+
+        result.push_back('%');
+        result.push_back(hex[c >> 4]);
+        result.push_back(hex[c & 0x0F]);
+    }
+
+    return result;
+}
+
+std::string shiro::utils::curl::unescape_url(const std::string &raw) {
+    auto from_hex = [](char c) -> int {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+
+        return -1;
+    };
+
+    std::string result;
+    result.reserve(raw.size());
+
+    for (size_t i = 0; i < raw.size(); i++) {
+        // Invalid escape sequences are kept as they are, like curl_easy_unescape does
+        if (raw[i] == '%' && i + 2 < raw.size()) {
+            int high = from_hex(raw[i + 1]);
+            int low = from_hex(raw[i + 2]);
+
+            if (high != -1 && low != -1) {
+                result.push_back((char) ((high << 4) | low));
+                i += 2;
+
+                continue;
+            }
+        }
+
+        result.push_back(raw[i]);
+    }
+
+    return result;
+}
+
+void shiro::utils::curl::setup_handle(CURL *handle) {
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, "shiro (https://github.com/Marc3842h/shiro)");
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+
+    // Uses HTTP/2 if the server offers it during the TLS handshake, otherwise HTTP/1.1
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+
+    if (share != nullptr)
+        curl_easy_setopt(handle, CURLOPT_SHARE, share);
+}
+
+CURL *shiro::utils::curl::acquire() {
+    CURL *handle = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(handles_mutex);
+
+        if (!idle_handles.empty()) {
+            handle = idle_handles.back();
+            idle_handles.pop_back();
+        }
+    }
+
+    if (handle == nullptr)
+        handle = curl_easy_init();
+
+    if (handle != nullptr)
+        setup_handle(handle);
+
+    return handle;
+}
+
+void shiro::utils::curl::release(CURL *handle) {
+    // Resets all options but keeps open connections and caches of the handle
+    curl_easy_reset(handle);
+
+    std::lock_guard<std::mutex> lock(handles_mutex);
+
+    if (idle_handles.size() < max_idle_handles) {
+        idle_handles.emplace_back(handle);
+        return;
+    }
+
+    curl_easy_cleanup(handle);
+}
+
+std::tuple<bool, std::string> shiro::utils::curl::perform(CURL *handle, const std::string &url, std::string &output) {
+    CURLcode status_code = curl_easy_perform(handle);
+    release(handle);
 
     if (status_code == CURLE_OK) {
         logging::sentry::http_request_out(url, "GET", status_code, url.find("/osu/") == std::string::npos ? output : "");
@@ -112,24 +271,12 @@ std::tuple<bool, std::string> shiro::utils::curl::get_direct(const std::string &
     return { false, output };
 }
 
-std::string shiro::utils::curl::escape_url(const std::string &raw) {
-    CURL *curl = curl_easy_init();
-    char *curl_result = curl_easy_escape(curl, raw.c_str(), 0);
-    std::string result = curl_result;
-
-    curl_free(curl_result);
-    curl_easy_cleanup(curl);
-    return result;
+void shiro::utils::curl::lock_share(CURL *handle, curl_lock_data data, curl_lock_access access, void *user_data) {
+    share_mutexes.at(data).lock();
 }
 
-std::string shiro::utils::curl::unescape_url(const std::string &raw) {
-    CURL *curl = curl_easy_init();
-    char *curl_result = curl_easy_unescape(curl, raw.c_str(), 0, nullptr);
-    std::string result = curl_result;
-
-    curl_free(curl_result);
-    curl_easy_cleanup(curl);
-    return result;
+void shiro::utils::curl::unlock_share(CURL *handle, curl_lock_data data, void *user_data) {
+    share_mutexes.at(data).unlock();
 }
 
 size_t shiro::utils::curl::internal_callback(void *raw_data, size_t size, size_t memory, std::string *ptr) {
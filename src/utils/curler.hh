@@ -19,11 +19,16 @@
 #ifndef SHIRO_CURLER_HH
 #define SHIRO_CURLER_HH
 
+#include <curl/curl.h>
 #include <tuple>
 #include <string>
 
 namespace shiro::utils::curl {
 
+    // Sets up the DNS and TLS session cache shared by all handles
+    void init();
+    void destroy();
+
     // Returns a boolean indicating if the request was successful and the response as a string if it was successful.
     std::tuple<bool, std::string> get(const std::string &url);
 
@@ -33,6 +38,9 @@ namespace shiro::utils::curl {
     std::string escape_url(const std::string &raw);
     std::string unescape_url(const std::string &raw);
 
+    // Applies options every outgoing request should use, handle needs to be freshly created or reset
+    void setup_handle(CURL *handle);
+
     size_t internal_callback(void *raw_data, size_t size, size_t memory, std::string *ptr);
 
 }
@@ -36,5 +36,5 @@ std::string shiro::utils::osu_string(std::string value, bool nullable) {
         buffer.write_string(value);
     }
 
-    return buffer.serialize();
+    return buffer.release();
 }
@@ -0,0 +1,100 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Builds the packets a typical bancho poll carries (presence, stats, a chat message and an announcement)
+// through osu_writer, hands them to a user's queue and serializes that queue like the poll response does.
+// Prints packets per second, run it with a Release build.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../src/io/osu_writer.hh"
+#include "../src/io/queue.hh"
+#include "../src/multiplayer/lobby_manager.hh"
+#include "../src/pp/pp_recalculator.hh"
+#include "../src/scores/top_plays.hh"
+#include "../src/users/user_manager.hh"
+
+// The layouts reach into the user, lobby and score managers for things the benchmark never does
+void shiro::multiplayer::lobby_manager::iterate(const std::function<void(std::shared_ptr<users::user>)> &callback) {
+    // No lobby
+}
+
+std::shared_ptr<shiro::users::user> shiro::users::manager::get_user_by_id(int32_t id) {
+    return nullptr;
+}
+
+bool shiro::pp::recalculator::in_progess() {
+    return false;
+}
+
+std::vector<shiro::scores::top_plays::play> shiro::scores::top_plays::get(const shiro::utils::play_mode &mode, int32_t user_id) {
+    return {};
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500000;
+
+    shiro::io::layouts::user_presence presence;
+    presence.user_id = 1000;
+    presence.username = "Marc3842h";
+    presence.country_id = 82;
+    presence.permissions = 7;
+    presence.rank = 42;
+
+    shiro::io::layouts::user_stats stats;
+    stats.user_id = 1000;
+    stats.activity_desc = "Camellia - Exit This Earth's Atomosphere [Evolution]";
+    stats.beatmap_checksum = "d41d8cd98f00b204e9800998ecf8427e";
+    stats.ranked_score = 123456789;
+    stats.accuracy = 0.9876f;
+    stats.play_count = 1234;
+    stats.total_score = 987654321;
+    stats.rank = 42;
+    stats.pp = 4321;
+
+    shiro::io::layouts::message message("Marc3842h", 1000, "hello everyone, anyone up for multi?", "#osu");
+    std::string announcement = "Server restart in 5 minutes.";
+
+    shiro::io::queue queue;
+    size_t bytes = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        shiro::io::osu_writer writer;
+
+        writer.user_presence(presence);
+        writer.user_stats(stats);
+        writer.send_message(message);
+        writer.announce(announcement);
+
+        queue.enqueue(writer);
+        bytes += queue.serialize().size();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double packets = iterations * 4.0;
+
+    std::printf("%.0f packets in %.3f s: %.0f packets/s, %.1f MiB/s\n",
+            packets, elapsed.count(), packets / elapsed.count(), bytes / elapsed.count() / (1024.0 * 1024.0));
+
+    return 0;
+}
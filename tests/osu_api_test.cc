@@ -0,0 +1,205 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Runs the osu! API client against a local stub of the osu! API served by crow.
+// Checks single-flight coalescing, the batched save, the rate limit and shutdown with queued requests.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/beatmaps/beatmap.hh"
+#include "../src/beatmaps/osu_api.hh"
+#include "../src/config/bancho_file.hh"
+#include "../src/config/direct_file.hh"
+#include "../src/logger/sentry_logger.hh"
+#include "../src/thirdparty/crow.hh"
+#include "../src/utils/curler.hh"
+
+namespace shiro::config::bancho {
+    std::string api_key = "key";
+    std::string api_url = "";
+    uint32_t api_requests_per_minute = 0;
+}
+
+namespace shiro::config::direct {
+    int32_t provider = 2;
+    std::string api_key = "";
+}
+
+void shiro::logging::sentry::exception(const std::exception &ex) {
+    // Not reported in tests
+}
+
+void shiro::logging::sentry::http_request_out(const std::string &url, const std::string &method, int32_t status_code, const std::string &reason) {
+    // Not reported in tests
+}
+
+static std::atomic<int32_t> saves { 0 };
+static std::atomic<size_t> saved_beatmaps { 0 };
+
+void shiro::beatmaps::beatmap::save(const std::vector<beatmap> &beatmaps) {
+    saves++;
+    saved_beatmaps += beatmaps.size();
+}
+
+static std::mutex requests_mutex;
+static std::unordered_map<std::string, int32_t> requests;
+static int32_t failures = 0;
+
+static void count(const std::string &request) {
+    std::lock_guard<std::mutex> lock(requests_mutex);
+    requests[request]++;
+}
+
+static void expect(bool condition, const char *description) {
+    std::printf("%s: %s\n", condition ? "PASS" : "FAIL", description);
+
+    if (!condition)
+        failures++;
+}
+
+static std::string make_set() {
+    std::string result = "[";
+    const char *versions[] = { "Easy", "Hard", "Insane" };
+
+    for (int32_t i = 0; i < 3; i++) {
+        if (i > 0)
+            result += ",";
+
+        result += R"({"artist":"a","title":"t","version":")" + std::string(versions[i]) + R"(","file_md5":"md5)" + std::to_string(i) +
+                  R"(","beatmapset_id":"39804","beatmap_id":")" + std::to_string(129891 + i) + R"(","approved":"1","hit_length":"100",)"
+                  R"("mode":"0","diff_approach":"9","diff_overall":"8","diff_size":"4","diff_drain":"5","bpm":"180",)"
+                  R"("difficultyrating":"5.5","diff_aim":"2.7","diff_speed":"2.6","max_combo":"1000",)"
+                  R"("approved_date":"2012-01-01 00:00:00","last_update":"2011-12-01 00:00:00"})";
+    }
+
+    return result + "]";
+}
+
+int main(int argc, char **argv) {
+    uint16_t port = argc > 1 ? (uint16_t) std::atoi(argv[1]) : 18181;
+
+    crow::SimpleApp server;
+    server.loglevel(crow::LogLevel::Warning);
+
+    CROW_ROUTE(server, "/api/get_beatmaps")([](const crow::request &request) {
+        // Slow enough for concurrent callers to pile up on the same transfer
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        if (request.url_params.get("s") != nullptr) {
+            count("set " + std::string(request.url_params.get("s")));
+            return crow::response(make_set());
+        }
+
+        count("beatmap " + std::string(request.url_params.get("b")));
+        return crow::response(R"([{"beatmapset_id":"39804"}])");
+    });
+
+    CROW_ROUTE(server, "/osu/<int>")([](int32_t id) {
+        count("osu " + std::to_string(id));
+        return crow::response("osu file format v14");
+    });
+
+    std::thread server_thread([&server, port]() {
+        server.bindaddr("127.0.0.1").port(port).run();
+    });
+
+    shiro::config::bancho::api_url = "http://127.0.0.1:" + std::to_string(port) + "/";
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    shiro::utils::curl::init();
+
+    // Wait for the server to accept connections
+    for (int32_t attempt = 0; attempt < 50 && !std::get<0>(shiro::utils::curl::get(shiro::config::bancho::api_url + "osu/0")); attempt++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    shiro::beatmaps::osu_api::init();
+
+    std::vector<std::thread> threads;
+    std::atomic<int32_t> fetched { 0 };
+
+    for (int32_t i = 0; i < 50; i++) {
+        threads.emplace_back([&fetched]() {
+            if (shiro::beatmaps::osu_api::fetch_beatmap_set(39804))
+                fetched++;
+        });
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    expect(fetched == 50, "50 concurrent fetches of one set succeed");
+    expect(requests["set 39804"] == 1, "they share a single request");
+    expect(saves == 1 && saved_beatmaps == 3, "the set is saved once with all three beatmaps");
+
+    std::optional<int32_t> set_id = shiro::beatmaps::osu_api::fetch_beatmapset_id(129891);
+    expect(set_id.has_value() && set_id.value() == 39804, "beatmap ids resolve to their set");
+
+    auto [success, contents] = shiro::beatmaps::osu_api::get_osu_file(1).get();
+    expect(success && contents == "osu file format v14", ".osu files are downloaded");
+
+    // 120 requests per minute spaces transfers 500 ms apart
+    shiro::config::bancho::api_requests_per_minute = 120;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::shared_future<shiro::beatmaps::osu_api::response>> pending;
+
+    for (int32_t id = 10; id < 14; id++) {
+        pending.emplace_back(shiro::beatmaps::osu_api::get_osu_file(id));
+    }
+
+    for (auto &future : pending) {
+        future.get();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    expect(elapsed >= std::chrono::milliseconds(1400), "the rate limit spaces out transfers");
+
+    // Requests still queued on shutdown are resolved as failures instead of hanging their callers
+    pending.clear();
+
+    for (int32_t id = 20; id < 24; id++) {
+        pending.emplace_back(shiro::beatmaps::osu_api::get_osu_file(id));
+    }
+
+    shiro::beatmaps::osu_api::destroy();
+
+    bool resolved = true;
+
+    for (auto &future : pending) {
+        resolved &= future.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    }
+
+    expect(resolved, "queued requests resolve on shutdown");
+
+    shiro::utils::curl::destroy();
+    curl_global_cleanup();
+
+    server.stop();
+    server_thread.join();
+
+    return failures == 0 ? 0 : 1;
+}
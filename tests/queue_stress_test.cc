@@ -0,0 +1,97 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Many producers enqueue numbered packets into one io::queue while a single consumer drains it concurrently.
+// Every packet has to arrive exactly once and in the order its producer enqueued it.
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../src/io/queue.hh"
+
+// queue.cc only needs the writer's buffer, the rest of osu_writer pulls in most of the server
+shiro::io::buffer &shiro::io::osu_writer::get_buffer() {
+    return this->buf;
+}
+
+int main(int argc, char **argv) {
+    constexpr int32_t producers = 16;
+    constexpr int32_t packets = 100000;
+
+    shiro::io::queue queue;
+    std::atomic<bool> done { false };
+
+    std::vector<int32_t> last(producers, -1);
+    size_t received = 0;
+    size_t out_of_order = 0;
+
+    std::thread consumer([&]() {
+        auto consume = [&]() {
+            for (const shiro::io::packet_chunk &chunk : queue.drain()) {
+                int32_t producer = 0;
+                int32_t sequence = 0;
+
+                std::memcpy(&producer, chunk->data(), sizeof(producer));
+                std::memcpy(&sequence, chunk->data() + sizeof(producer), sizeof(sequence));
+
+                if (producer < 0 || producer >= producers || sequence != last.at(producer) + 1)
+                    out_of_order++;
+                else
+                    last.at(producer) = sequence;
+
+                received++;
+            }
+        };
+
+        while (!done.load(std::memory_order_acquire)) {
+            consume();
+        }
+
+        consume();
+    });
+
+    std::vector<std::thread> threads;
+
+    for (int32_t producer = 0; producer < producers; producer++) {
+        threads.emplace_back([&queue, producer]() {
+            for (int32_t sequence = 0; sequence < packets; sequence++) {
+                shiro::io::buffer buffer;
+
+                buffer.write<int32_t>(producer);
+                buffer.write<int32_t>(sequence);
+
+                queue.enqueue(buffer);
+            }
+        });
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    done.store(true, std::memory_order_release);
+    consumer.join();
+
+    size_t expected = (size_t) producers * packets;
+    std::printf("Received %zu of %zu packets, %zu out of order.\n", received, expected, out_of_order);
+
+    return received == expected && out_of_order == 0 && queue.is_empty() ? 0 : 1;
+}
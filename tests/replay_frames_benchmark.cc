@@ -0,0 +1,204 @@
+/*
+ * shiro - High performance, high quality osu!Bancho C++ re-implementation
+ * Copyright (C) 2018-2020 Marc3842h, czapek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Decodes replays with replays::decode_frames and with the original path, which decompressed the whole
+// replay first and then split every frame with boost::split and boost::lexical_cast. Pass .osr files as arguments, without any a
+// synthetic replay is generated. Prints frames per second for both, run it with a Release build.
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <lzma.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/io/osu_buffer.hh"
+#include "../src/replays/replay.hh"
+
+// Extracts the compressed frames from an .osr file, empty if the file is unreadable
+static std::string read_osr(const char *path) {
+    std::ifstream stream(path, std::ios::binary);
+
+    if (!stream)
+        return "";
+
+    std::string contents((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    shiro::io::buffer osr(std::move(contents));
+
+    osr.read<uint8_t>(); // mode
+    osr.read<int32_t>(); // version
+    osr.read_string(); // beatmap md5
+    osr.read_string(); // player name
+    osr.read_string(); // replay md5
+    osr.advance(6 * sizeof(int16_t)); // 300s, 100s, 50s, gekis, katus, misses
+    osr.read<int32_t>(); // score
+    osr.read<int16_t>(); // max combo
+    osr.read<uint8_t>(); // perfect
+    osr.read<int32_t>(); // mods
+    osr.read_string(); // life bar
+    osr.read<int64_t>(); // timestamp
+
+    int32_t length = osr.read<int32_t>();
+
+    if (length <= 0 || !osr.can_read(length))
+        return "";
+
+    return std::string(osr.read_view(length));
+}
+
+// Ten minutes of cursor movement at one frame every 16 ms, compressed the way osu! does
+static std::string make_replay() {
+    std::string frames;
+
+    for (int32_t i = 0; i < 37500; i++) {
+        frames += std::to_string(i == 0 ? 0 : 16) + "|" +
+                  std::to_string(256.0f + (i * 37 % 512) / 3.0f) + "|" +
+                  std::to_string(192.0f + (i * 53 % 384) / 7.0f) + "|" +
+                  std::to_string(i % 10 < 3 ? 1 : 0) + ",";
+    }
+
+    lzma_options_lzma options;
+    lzma_lzma_preset(&options, LZMA_PRESET_DEFAULT);
+
+    lzma_stream stream = LZMA_STREAM_INIT;
+
+    if (lzma_alone_encoder(&stream, &options) != LZMA_OK)
+        return "";
+
+    std::string result(frames.size() + 1024, '\0');
+
+    stream.next_in = reinterpret_cast<const uint8_t*>(frames.data());
+    stream.avail_in = frames.size();
+    stream.next_out = reinterpret_cast<uint8_t*>(&result[0]);
+    stream.avail_out = result.size();
+
+    if (lzma_code(&stream, LZMA_FINISH) != LZMA_STREAM_END)
+        result.clear();
+    else
+        result.resize(result.size() - stream.avail_out);
+    lzma_end(&stream);
+
+    return result;
+}
+
+// Decompresses the whole replay, then splits and converts every frame into an action
+static size_t decode_actions(const std::string &compressed) {
+    lzma_stream stream = LZMA_STREAM_INIT;
+
+    if (lzma_auto_decoder(&stream, UINT64_MAX, 0) != LZMA_OK)
+        return 0;
+
+    std::string decompressed;
+    char buffer[16 * 1024];
+    lzma_ret status = LZMA_OK;
+
+    stream.next_in = reinterpret_cast<const uint8_t*>(compressed.data());
+    stream.avail_in = compressed.size();
+
+    while (status == LZMA_OK) {
+        stream.next_out = reinterpret_cast<uint8_t*>(buffer);
+        stream.avail_out = sizeof(buffer);
+
+        status = lzma_code(&stream, LZMA_FINISH);
+        decompressed.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+
+    lzma_end(&stream);
+
+    std::vector<std::string> frames;
+    std::vector<shiro::replays::action> actions;
+
+    boost::split(frames, decompressed, boost::is_any_of(","));
+
+    for (const std::string &frame : frames) {
+        std::vector<std::string> fields;
+        boost::split(fields, frame, boost::is_any_of("|"));
+
+        if (fields.size() < 4)
+            continue;
+
+        shiro::replays::action action;
+
+        try {
+            action.w = boost::lexical_cast<int64_t>(fields.at(0));
+            action.x = boost::lexical_cast<float>(fields.at(1));
+            action.y = boost::lexical_cast<float>(fields.at(2));
+            action.z = boost::lexical_cast<int32_t>(fields.at(3));
+        } catch (const boost::bad_lexical_cast &ex) {
+            continue;
+        }
+
+        actions.push_back(action);
+    }
+
+    return actions.size();
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> replays;
+
+    for (int32_t i = 1; i < argc; i++) {
+        std::string replay = read_osr(argv[i]);
+
+        if (replay.empty()) {
+            std::fprintf(stderr, "%s is not a valid replay\n", argv[i]);
+            continue;
+        }
+
+        replays.emplace_back(std::move(replay));
+    }
+
+    if (replays.empty())
+        replays.emplace_back(make_replay());
+
+    constexpr int32_t rounds = 20;
+
+    size_t frame_count = 0;
+    size_t action_count = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int32_t round = 0; round < rounds; round++) {
+        for (const std::string &replay : replays) {
+            shiro::replays::frames frames;
+            shiro::replays::decode_frames(replay, frames);
+            frame_count += frames.size();
+        }
+    }
+
+    std::chrono::duration<double> streaming = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+
+    for (int32_t round = 0; round < rounds; round++) {
+        for (const std::string &replay : replays) {
+            action_count += decode_actions(replay);
+        }
+    }
+
+    std::chrono::duration<double> buffered = std::chrono::steady_clock::now() - start;
+
+    std::printf("%zu replays, %zu frames each round\n", replays.size(), frame_count / rounds);
+    std::printf("decode_frames:          %.3f s, %.0f frames/s\n", streaming.count(), frame_count / streaming.count());
+    std::printf("boost::split:           %.3f s, %.0f frames/s\n", buffered.count(), action_count / buffered.count());
+
+    return 0;
+}